@@ -0,0 +1,26 @@
+#!/bin/bash
+
+echo "Benchmark: recursive fib, tak and the meta-circular interpreter on each engine"
+echo "--------------------------------------------------------------------------------"
+
+# 确保我们在score目录下
+cd "$(dirname "$0")"
+
+ENGINES="tree vm reg"
+PROGRAMS="bench/fib.scm bench/tak.scm more-tests/7.in"
+
+# bash 的 time 只报告耗时, 程序输出丢弃
+TIMEFORMAT="%3Rs"
+
+for p in $PROGRAMS
+do
+    for e in $ENGINES
+    do
+        printf "%-20s %-6s " $p $e
+        { time ../build/code --engine=$e << EOF > /dev/null
+        $(cat $p)
+        (exit)
+EOF
+        } 2>&1
+    done
+done
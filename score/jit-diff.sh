@@ -0,0 +1,37 @@
+#!/bin/bash
+
+echo "Differential test: JIT output against the interpreter on the score inputs"
+echo "--------------------------------------------------------------------------------"
+
+# 确保我们在score目录下
+cd "$(dirname "$0")"
+
+# 阈值为0, 每个过程第一次调用就编译成本地代码
+JIT="../build/code --engine=vm --jit=on --jit-threshold=0"
+INTERP="../build/code"
+
+run() {
+    $1 << EOF > "$2"
+    $(cat "$3")
+    (exit)
+EOF
+}
+
+FAIL=0
+for f in data/*.in more-tests/*.in
+do
+    [ -f "$f" ] || continue
+    run "$INTERP" interp.out "$f"
+    run "$JIT" jit.out "$f"
+    diff interp.out jit.out > diff_output.txt
+    if [ $? -ne 0 ]; then
+        echo "JIT differs from the interpreter on" $f
+        FAIL=1
+    fi
+done
+rm -f interp.out jit.out
+
+if [ $FAIL -eq 0 ]; then
+    echo "JIT matches the interpreter on every input"
+fi
+exit $FAIL
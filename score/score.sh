@@ -7,7 +7,7 @@ echo "--------------------------------------------------------------------------
 cd "$(dirname "$0")"
 
 L=1
-R=118
+R=127
 for ((i = $L; i <= $R; i = i + 1))
 do
     echo ""
@@ -1,115 +1,323 @@
-/**
- * @file Def.cpp
- * @brief Implementation of primitive functions and reserved words mappings
- * @author luke36
- * 
- * This file defines the mapping tables that associate Scheme function names
- * and special forms with their corresponding internal expression types.
- */
-
-#include "Def.hpp"
-
-/**
- * @brief Mapping of primitive function names to expression types
- * 
- * This map contains all built-in functions that can be called in Scheme.
- * These are functions that have direct implementations in the interpreter
- * and can be used in function application contexts.
- * 
- * Categories:
- * - Arithmetic: +, -, *, /, modulo, expt
- * - Comparison: <, <=, =, >=, >
- * - List operations: cons, car, cdr, list, set-car!, set-cdr!
- * - Logic: not, and, or (and/or support short-circuit evaluation)
- * - Type predicates: eq?, boolean?, number?, null?, pair?, procedure?, symbol?, list?, string?
- * - I/O: display
- * - Control: void, exit
- */
-std::map<std::string, ExprType> primitives = {
-    // Arithmetic operations
-    {"+",        E_PLUS},
-    {"-",        E_MINUS},
-    {"*",        E_MUL},
-    {"/",        E_DIV},
-    {"modulo",   E_MODULO},
-    {"expt",     E_EXPT},
-    
-    // Comparison operations
-    {"<",        E_LT},
-    {"<=",       E_LE},
-    {"=",        E_EQ},
-    {">=",       E_GE},
-    {">",        E_GT},
-
-     // List operations
-    {"cons",      E_CONS},
-    {"car",       E_CAR},
-    {"cdr",       E_CDR},
-    {"list",      E_LIST},
-    {"set-car!",  E_SETCAR},
-    {"set-cdr!",  E_SETCDR},
-
-    // Logic operations
-    {"not",       E_NOT},
-    {"and",       E_AND},
-    {"or",        E_OR},
-    
-    // Type predicates
-    {"eq?",        E_EQQ},
-    {"boolean?",   E_BOOLQ},
-    {"number?",    E_INTQ},      
-    {"null?",      E_NULLQ},
-    {"pair?",      E_PAIRQ},
-    {"procedure?", E_PROCQ},
-    {"symbol?",    E_SYMBOLQ},
-    {"list?",      E_LISTQ},
-    {"string?",    E_STRINGQ},
-    
-    // I/O operations
-    {"display",   E_DISPLAY},
-    
-    // Special values and control
-    {"void",      E_VOID},
-    {"exit",      E_EXIT}
-};
-
-/**
- * @brief Mapping of reserved words (special forms) to expression types
- * 
- * This map contains Scheme special forms that have special syntax and
- * evaluation rules. These cannot be used as regular function names and
- * have special parsing and evaluation semantics.
- * 
- * Categories:
- * - Control flow constructs: begin, quote
- * - Conditional : if, cond
- * - Function definition: lambda
- * - Variable and function definition: define
- * - Binding constructs: let, letrec
- * - Assignment: set!
- * 
- * Note: and/or have been moved to primitives to support function-style usage
- * while maintaining their short-circuit evaluation behavior.
- */
-std::map<std::string, ExprType> reserved_words = {
-    // Control flow constructs
-    {"begin",   E_BEGIN},    
-    {"quote",   E_QUOTE},    
-
-    // Conditional
-    {"if",      E_IF},       
-    {"cond",    E_COND},     
-
-    // Function definition
-    {"lambda",  E_LAMBDA},   
-
-    // Variable and function definition
-    {"define",  E_DEFINE},   
-
-    // Binding constructs
-    {"let",     E_LET},      
-    {"letrec",  E_LETREC},   
-    
-    // Assignment
-    {"set!",    E_SET}      
-};
+/**
+ * @file Def.cpp
+ * @brief Implementation of primitive functions and reserved words mappings
+ * @author luke36
+ * 
+ * This file defines the table that associates Scheme function names and
+ * special forms with their expression types, arities, expression nodes and
+ * native implementations.
+ */
+
+#include "Def.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include <climits>
+#include <unordered_set>
+#include <unordered_map>
+
+/**
+ * @brief Returns the unique copy of a name, adding it on first use
+ */
+Sym intern(const std::string &name) {
+    static std::unordered_set<std::string> table;
+    return &*table.insert(name).first;
+}
+
+// ============================================================================
+// Node factories, called with an argument count the table allows
+// ============================================================================
+
+template <class Op>
+static Expr makeNullary(const std::vector<Expr> &args) {
+    return Expr(new Op());
+}
+
+template <class Op>
+static Expr makeUnary(const std::vector<Expr> &args) {
+    return Expr(new Op(args[0]));
+}
+
+template <class Op>
+static Expr makeBinary(const std::vector<Expr> &args) {
+    return Expr(new Op(args[0], args[1]));
+}
+
+template <class Op>
+static Expr makeVariadic(const std::vector<Expr> &args) {
+    return Expr(new Op(args));
+}
+
+// + and * fill missing operands with their identity
+template <class Op, class OpVar, int identity>
+static Expr makeFold(const std::vector<Expr> &args) {
+    if (args.size() == 0) return Expr(new Op(new Fixnum(identity), new Fixnum(identity)));
+    if (args.size() == 1) return Expr(new Op(new Fixnum(identity), args[0]));
+    if (args.size() == 2) return Expr(new Op(args[0], args[1]));
+    return Expr(new OpVar(args));
+}
+
+// Fused nodes, see AddImm and Cadr; the parser gets them from the
+// factories of the operations they replace
+
+static bool immediate(const Expr &ex) {
+    return ex->e_type == E_FIXNUM && static_cast<Fixnum *>(ex.get())->n != INT_MIN;
+}
+
+static Expr makePlus(const std::vector<Expr> &args) {
+    if (args.size() == 2 && immediate(args[1])) return Expr(new AddImm(args[0], args[1]));
+    if (args.size() == 2 && immediate(args[0])) return Expr(new AddImm(args[1], args[0]));
+    return makeFold<Plus, PlusVar, 0>(args);
+}
+
+static Expr makeMinus(const std::vector<Expr> &args) {
+    if (args.size() == 1) return Expr(new Mult(new Fixnum(-1), args[0]));
+    if (args.size() == 2 && immediate(args[1]))
+        return Expr(new AddImm(args[0], new Fixnum(-static_cast<Fixnum *>(args[1].get())->n)));
+    if (args.size() == 2) return Expr(new Minus(args[0], args[1]));
+    return Expr(new MinusVar(args));
+}
+
+static Expr makeCar(const std::vector<Expr> &args) {
+    if (args[0]->e_type == E_CDR) return Expr(new Cadr(static_cast<Cdr *>(args[0].get())->rand));
+    return Expr(new Car(args[0]));
+}
+
+static Expr makeDiv(const std::vector<Expr> &args) {
+    if (args.size() == 1) return Expr(new Div(new Fixnum(1), args[0]));
+    if (args.size() == 2) return Expr(new Div(args[0], args[1]));
+    return Expr(new DivVar(args));
+}
+
+template <class Op, class OpVar>
+static Expr makeCompare(const std::vector<Expr> &args) {
+    if (args.size() == 2) return Expr(new Op(args[0], args[1]));
+    return Expr(new OpVar(args));
+}
+
+// ============================================================================
+// Native implementations, used when a primitive is a value
+// ============================================================================
+
+// Primitives used as values share the evalRator of their expression node
+static const Expr no_rand(static_cast<ExprBase *>(nullptr));
+
+template <class Op>
+static Value unaryPrim(const std::vector<Value> &args) {
+    static Op op(no_rand);
+    return op.evalRator(args[0]);
+}
+
+template <class Op>
+static Value binaryPrim(const std::vector<Value> &args) {
+    static Op op(no_rand, no_rand);
+    return op.evalRator(args[0], args[1]);
+}
+
+template <class Op>
+static Value variadicPrim(const std::vector<Value> &args) {
+    static Op op((std::vector<Expr>()));
+    return op.evalRator(args);
+}
+
+static Value voidPrim(const std::vector<Value> &args) {
+    return VoidV();
+}
+
+static Value exitPrim(const std::vector<Value> &args) {
+    return TerminateV();
+}
+
+// and/or receive their arguments already evaluated, so only the result
+// rule of AndVar/OrVar applies
+static Value andPrim(const std::vector<Value> &args) {
+    Value temp = BooleanV(true);
+    for (const Value &v: args) {
+        temp = v;
+        if (v.isFalse()) return BooleanV(false);
+    }
+    return temp;
+}
+
+static Value orPrim(const std::vector<Value> &args) {
+    Value temp = BooleanV(false);
+    for (const Value &v: args) {
+        temp = v;
+        if (v.type() != V_BOOL) return v;
+        if (!v.isFalse()) return BooleanV(true);
+    }
+    return temp;
+}
+
+// ============================================================================
+// Builtin table
+// ============================================================================
+
+/**
+ * @brief Every primitive and reserved word
+ *
+ * Categories:
+ * - Arithmetic: +, -, *, /, modulo, expt
+ * - Comparison: <, <=, =, >=, >
+ * - List operations: cons, car, cdr, list, set-car!, set-cdr!
+ * - Logic: not, and, or (and/or support short-circuit evaluation)
+ * - Type predicates: eq?, boolean?, number?, null?, pair?, procedure?, symbol?, list?, string?
+ * - I/O: display
+ * - Control: void, exit
+ * - Continuations: call/cc, call/ec, and their long names
+ * - Reserved words: begin, quote, if, cond, lambda, define, let, letrec, set!, do
+ *
+ * Note: and/or are primitives rather than reserved words so that they can
+ * be used as procedures, while direct calls still short-circuit. The
+ * continuation operators have no native implementation, as they call the
+ * procedure they are given; used as values, they are procedures wrapping
+ * a direct call, see primitiveProc.
+ */
+static constexpr Builtin builtins[] = {
+    // Arithmetic operations
+    {"+",          E_PLUS,    0, -1, makePlus,                   variadicPrim<PlusVar>},
+    {"-",          E_MINUS,   1, -1, makeMinus,                  variadicPrim<MinusVar>},
+    {"*",          E_MUL,     0, -1, makeFold<Mult, MultVar, 1>, variadicPrim<MultVar>},
+    {"/",          E_DIV,     1, -1, makeDiv,                    variadicPrim<DivVar>},
+    {"modulo",     E_MODULO,  2, 2,  makeBinary<Modulo>,         binaryPrim<Modulo>},
+    {"expt",       E_EXPT,    2, 2,  makeBinary<Expt>,           binaryPrim<Expt>},
+
+    // Comparison operations
+    {"<",          E_LT,      1, -1, makeCompare<Less, LessVar>,           variadicPrim<LessVar>},
+    {"<=",         E_LE,      1, -1, makeCompare<LessEq, LessEqVar>,       variadicPrim<LessEqVar>},
+    {"=",          E_EQ,      1, -1, makeCompare<Equal, EqualVar>,         variadicPrim<EqualVar>},
+    {">=",         E_GE,      1, -1, makeCompare<GreaterEq, GreaterEqVar>, variadicPrim<GreaterEqVar>},
+    {">",          E_GT,      1, -1, makeCompare<Greater, GreaterVar>,     variadicPrim<GreaterVar>},
+
+    // List operations
+    {"cons",       E_CONS,    2, 2,  makeBinary<Cons>,           binaryPrim<Cons>},
+    {"car",        E_CAR,     1, 1,  makeCar,                    unaryPrim<Car>},
+    {"cdr",        E_CDR,     1, 1,  makeUnary<Cdr>,             unaryPrim<Cdr>},
+    {"list",       E_LIST,    0, -1, makeVariadic<ListFunc>,     variadicPrim<ListFunc>},
+    {"set-car!",   E_SETCAR,  2, 2,  makeBinary<SetCar>,         binaryPrim<SetCar>},
+    {"set-cdr!",   E_SETCDR,  2, 2,  makeBinary<SetCdr>,         binaryPrim<SetCdr>},
+
+    // Logic operations
+    {"not",        E_NOT,     1, 1,  makeUnary<Not>,             unaryPrim<Not>},
+    {"and",        E_AND,     0, -1, makeVariadic<AndVar>,       andPrim},
+    {"or",         E_OR,      0, -1, makeVariadic<OrVar>,        orPrim},
+
+    // Type predicates
+    {"eq?",        E_EQQ,     2, 2,  makeBinary<IsEq>,           binaryPrim<IsEq>},
+    {"boolean?",   E_BOOLQ,   1, 1,  makeUnary<IsBoolean>,       unaryPrim<IsBoolean>},
+    {"number?",    E_INTQ,    1, 1,  makeUnary<IsFixnum>,        unaryPrim<IsFixnum>},
+    {"null?",      E_NULLQ,   1, 1,  makeUnary<IsNull>,          unaryPrim<IsNull>},
+    {"pair?",      E_PAIRQ,   1, 1,  makeUnary<IsPair>,          unaryPrim<IsPair>},
+    {"procedure?", E_PROCQ,   1, 1,  makeUnary<IsProcedure>,     unaryPrim<IsProcedure>},
+    {"symbol?",    E_SYMBOLQ, 1, 1,  makeUnary<IsSymbol>,        unaryPrim<IsSymbol>},
+    {"list?",      E_LISTQ,   1, 1,  makeUnary<IsList>,          unaryPrim<IsList>},
+    {"string?",    E_STRINGQ, 1, 1,  makeUnary<IsString>,        unaryPrim<IsString>},
+
+    // I/O operations
+    {"display",    E_DISPLAY, 1, 1,  makeUnary<Display>,         unaryPrim<Display>},
+
+    // Special values and control
+    {"void",       E_VOID,    0, 0,  makeNullary<MakeVoid>,      voidPrim},
+    {"exit",       E_EXIT,    0, 0,  makeNullary<Exit>,          exitPrim},
+
+    // Continuations
+    {"call/cc",    E_CALLCC,  1, 1,  makeUnary<CallCC>,          nullptr},
+    {"call-with-current-continuation", E_CALLCC, 1, 1, makeUnary<CallCC>, nullptr},
+    {"call/ec",    E_CALLEC,  1, 1,  makeUnary<CallEC>,          nullptr},
+    {"call-with-escape-continuation",  E_CALLEC, 1, 1, makeUnary<CallEC>, nullptr},
+
+    // Reserved words
+    {"begin",      E_BEGIN,   0, -1, nullptr, nullptr},
+    {"quote",      E_QUOTE,   0, -1, nullptr, nullptr},
+    {"if",         E_IF,      0, -1, nullptr, nullptr},
+    {"cond",       E_COND,    0, -1, nullptr, nullptr},
+    {"lambda",     E_LAMBDA,  0, -1, nullptr, nullptr},
+    {"define",     E_DEFINE,  0, -1, nullptr, nullptr},
+    {"let",        E_LET,     0, -1, nullptr, nullptr},
+    {"letrec",     E_LETREC,  0, -1, nullptr, nullptr},
+    {"do",         E_LOOP,    0, -1, nullptr, nullptr},
+    {"set!",       E_SET,     0, -1, nullptr, nullptr},
+};
+
+/**
+ * @brief Operations of the fused nodes, for builtinOf only: they have no
+ * name of their own, so the parser never finds them
+ */
+static constexpr Builtin fused[] = {
+    {"cadr",       E_CADR,    1, 1,  makeUnary<Cadr>,            unaryPrim<Cadr>},
+    {"+",          E_ADDI,    2, 2,  makeBinary<AddImm>,         binaryPrim<Plus>},
+};
+
+static constexpr int kBuiltins = sizeof(builtins) / sizeof(builtins[0]);
+
+// FNV-1a; kHashSeed is picked so that no two names share a bucket
+static constexpr unsigned kHashSeed = 36;
+static constexpr unsigned kBuckets = 256;
+
+static constexpr unsigned hashName(const char *s, unsigned h) {
+    return *s == 0 ? h : hashName(s + 1, (h ^ static_cast<unsigned char>(*s)) * 16777619u);
+}
+
+static constexpr unsigned bucketOf(int i) {
+    return hashName(builtins[i].name, kHashSeed) % kBuckets;
+}
+
+static constexpr bool distinctFrom(int i, int j) {
+    return j == kBuiltins || (bucketOf(i) != bucketOf(j) && distinctFrom(i, j + 1));
+}
+
+static constexpr bool perfect(int i) {
+    return i == kBuiltins || (distinctFrom(i, i + 1) && perfect(i + 1));
+}
+
+static_assert(perfect(0), "builtin names collide, choose another kHashSeed");
+
+const Builtin *findBuiltin(const std::string &name) {
+    static const struct Index {
+        const Builtin *slot[kBuckets];
+        Index() {
+            for (unsigned i = 0; i < kBuckets; i++) slot[i] = nullptr;
+            for (int i = 0; i < kBuiltins; i++) slot[bucketOf(i)] = &builtins[i];
+        }
+    } index;
+    unsigned h = kHashSeed;
+    for (char c : name) h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+    const Builtin *b = index.slot[h % kBuckets];
+    return b != nullptr && name == b->name ? b : nullptr;
+}
+
+const Builtin *builtinOf(ExprType t) {
+    static const std::unordered_map<int, const Builtin *> of = [] {
+        std::unordered_map<int, const Builtin *> m;
+        for (const Builtin &b : builtins)
+            if (b.fn != nullptr) m[b.type] = &b;
+        for (const Builtin &b : fused) m[b.type] = &b;
+        return m;
+    }();
+    auto it = of.find(t);
+    return it == of.end() ? nullptr : it->second;
+}
+
+// An operator without native implementation as a value: (lambda (f) (op f))
+static Value wrapper(const Builtin &b) {
+    Sym f = intern("f");
+    Expr lam(new Lambda({f}, b.make({Expr(new Var(f))})));
+    resolveProgram(lam);
+    Assoc none = empty();
+    return lam->eval(none);
+}
+
+// One procedure value per primitive, shared by every reference to it
+const Value *primitiveProc(Sym x) {
+    static const std::vector<Value> procs = [] {
+        std::vector<Value> v;
+        for (const Builtin &b : builtins) {
+            if (b.fn != nullptr) v.push_back(PrimitiveV(&b));
+            else if (b.make != nullptr) v.push_back(wrapper(b));
+            else v.push_back(Value(nullptr));
+        }
+        return v;
+    }();
+    const Builtin *b = findBuiltin(*x);
+    if (b == nullptr || procs[b - builtins].get() == nullptr) return nullptr;
+    return &procs[b - builtins];
+}
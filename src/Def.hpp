@@ -1,126 +1,232 @@
-#ifndef DEF_HPP
-#define DEF_HPP
-
-/**
- * @file Def.hpp
- * @brief Core definitions and enumerations for the Scheme interpreter
- * @author luke36
- * 
- * This file contains essential type definitions, enumerations, and forward
- * declarations used throughout the Scheme interpreter implementation.
- */
-
-#include <string>
-#include <utility>
-#include <vector>
-#include <iostream>
-#include <map>
-
-// Forward declarations
-struct Syntax;
-struct Expr;
-struct Value;
-struct AssocList;
-struct Assoc;
-
-/**
- * @brief Expression types enumeration
- * 
- * Defines all possible expression types that can be parsed and evaluated
- * in the Scheme interpreter.
- */
-enum ExprType {
-    // Basic types and literals
-    E_FIXNUM,          
-    E_RATIONAL,        
-    E_STRING,         
-    E_TRUE,            
-    E_FALSE,           
-    E_VOID,          
-    E_EXIT,         
-
-    // Arithmetic operations
-    E_PLUS,
-    E_MINUS,
-    E_MUL,
-    E_DIV,
-    E_MODULO,
-    E_EXPT,
-
-    // Comparison operations
-    E_LT,              
-    E_LE,             
-    E_EQ,             
-    E_GE,             
-    E_GT,             
-
-    // List operations
-    E_CONS,             
-    E_CAR,             
-    E_CDR,             
-    E_LIST,             
-    E_SETCAR,          
-    E_SETCDR,          
-
-    // Logic operations
-    E_NOT,              
-    E_AND,             
-    E_OR,
-    
-    // Type predicates
-    E_EQQ,              
-    E_BOOLQ,           
-    E_INTQ,            
-    E_NULLQ,            
-    E_PAIRQ,            
-    E_PROCQ,           
-    E_SYMBOLQ,         
-    E_LISTQ,                
-    E_STRINGQ,          
-
-    // Control flow constructs
-    E_BEGIN,          
-    E_QUOTE,          
-
-    //Conditional
-    E_IF,             
-    E_COND,            
-
-    // Variables and function definition
-    E_VAR,              
-    E_APPLY,           
-    E_LAMBDA,         
-    E_DEFINE,          
-
-    // Binding constructs
-    E_LET,            
-    E_LETREC,          
-
-    // Assignment
-    E_SET,             
-
-    // I/O operations
-    E_DISPLAY,         
-};
-
-/**
- * @brief Value types enumeration
- * 
- * Defines all possible value types that can be represented and manipulated
- * in the Scheme interpreter runtime.
- */
-enum ValueType {
-    V_INT,              
-    V_RATIONAL,         
-    V_BOOL,             
-    V_SYM,              
-    V_NULL,             
-    V_STRING,           
-    V_PAIR,             
-    V_PROC,             
-    V_VOID,            
-    V_TERMINATE,
-    V_NONERETURN
-};
-
-#endif // DEF_HPP
+#ifndef DEF_HPP
+#define DEF_HPP
+
+/**
+ * @file Def.hpp
+ * @brief Core definitions and enumerations for the Scheme interpreter
+ * @author luke36
+ * 
+ * This file contains essential type definitions, enumerations, and forward
+ * declarations used throughout the Scheme interpreter implementation.
+ */
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <iostream>
+#include <map>
+
+// Forward declarations
+struct Syntax;
+struct Expr;
+struct Value;
+struct AssocList;
+struct Assoc;
+struct Scope;
+struct Lambda;
+struct TailCall;
+struct Chunk;
+struct RegChunk;
+
+/**
+ * @brief Interned identifier
+ *
+ * Every distinct name is stored once in a global table, so two identifiers
+ * are the same name exactly when their pointers are equal.
+ */
+typedef const std::string *Sym;
+
+Sym intern(const std::string &);
+
+/**
+ * @brief Expression types enumeration
+ * 
+ * Defines all possible expression types that can be parsed and evaluated
+ * in the Scheme interpreter.
+ */
+enum ExprType {
+    // Basic types and literals
+    E_FIXNUM,          
+    E_RATIONAL,        
+    E_STRING,         
+    E_TRUE,            
+    E_FALSE,           
+    E_VOID,          
+    E_EXIT,         
+
+    // Arithmetic operations
+    E_PLUS,
+    E_MINUS,
+    E_MUL,
+    E_DIV,
+    E_MODULO,
+    E_EXPT,
+
+    // Comparison operations
+    E_LT,              
+    E_LE,             
+    E_EQ,             
+    E_GE,             
+    E_GT,             
+
+    // List operations
+    E_CONS,             
+    E_CAR,             
+    E_CDR,             
+    E_LIST,             
+    E_SETCAR,          
+    E_SETCDR,          
+
+    // Logic operations
+    E_NOT,              
+    E_AND,             
+    E_OR,
+    
+    // Type predicates
+    E_EQQ,              
+    E_BOOLQ,           
+    E_INTQ,            
+    E_NULLQ,            
+    E_PAIRQ,            
+    E_PROCQ,           
+    E_SYMBOLQ,         
+    E_LISTQ,                
+    E_STRINGQ,          
+
+    // Control flow constructs
+    E_BEGIN,          
+    E_QUOTE,          
+
+    //Conditional
+    E_IF,             
+    E_COND,            
+
+    // Variables and function definition
+    E_VAR,              
+    E_LOCALVAR,
+    E_CLOSUREVAR,
+    E_GLOBALVAR,
+    E_PRIMVAR,
+    E_INVALIDVAR,
+    E_APPLY,           
+    E_LAMBDA,         
+    E_DEFINE,          
+    E_INLINE,
+
+    // Binding constructs
+    E_LET,            
+    E_LETREC,          
+    E_LOOP,
+    E_RECUR,
+
+    // Assignment
+    E_SET,             
+
+    // I/O operations
+    E_DISPLAY,         
+
+    // Continuations
+    E_CALLEC,
+    E_CALLCC,
+
+    // Fused operations, chosen by the node factories
+    E_CADR,
+    E_ADDI,
+
+    // Instrumentation, built with COUNT_EVALS only
+    E_COUNTED,
+};
+
+/**
+ * @brief Value types enumeration
+ * 
+ * Defines all possible value types that can be represented and manipulated
+ * in the Scheme interpreter runtime.
+ */
+enum ValueType {
+    V_INT,              
+    V_RATIONAL,         
+    V_BOOL,             
+    V_SYM,              
+    V_NULL,             
+    V_STRING,           
+    V_PAIR,             
+    V_PROC,             
+    V_PRIM,
+    V_CONT,
+    V_BOX,
+    V_VOID,            
+    V_TERMINATE,
+    V_NONERETURN
+};
+
+/**
+ * @brief Syntax node types enumeration
+ *
+ * Tags the nodes read by readSyntax, so that the parser and quote can tell
+ * them apart without RTTI.
+ */
+enum SyntaxType {
+    S_NUMBER,
+    S_RATIONAL,
+    S_TRUE,
+    S_FALSE,
+    S_SYMBOL,
+    S_STRING,
+    S_LIST
+};
+
+typedef Value (*NativeFn)(const std::vector<Value> &);
+
+/**
+ * @brief Descriptor of a primitive or a reserved word
+ *
+ * One table of these drives the parser, which checks arity and builds the
+ * expression node of a direct call, and the runtime, which calls fn when
+ * the primitive is used as a value. Reserved words have neither.
+ */
+struct Builtin {
+    const char *name;
+    ExprType type;
+    int min_args;
+    int max_args;                             ///< -1 for no limit
+    Expr (*make)(const std::vector<Expr> &);  ///< Node for a call with checked arity
+    NativeFn fn;                              ///< Implementation as a procedure value
+};
+
+/**
+ * @brief Perfect-hash lookup of a primitive or reserved word, nullptr if none
+ */
+const Builtin *findBuiltin(const std::string &);
+
+/**
+ * @brief The primitive whose expression nodes have type t, or nullptr
+ */
+const Builtin *builtinOf(ExprType t);
+
+/**
+ * @brief Evaluation engines the interpreter can run on
+ */
+enum Engine {
+    ENGINE_TREE, ///< ExprBase::eval, recursing on the C++ stack
+    ENGINE_CEK,  ///< evalCEK, with continuations on the heap
+    ENGINE_VM,    ///< evalVM, running compiled bytecode
+    ENGINE_REG,   ///< evalReg, running register bytecode
+    ENGINE_TIERED ///< ExprBase::eval, moving hot procedures to the VM
+};
+
+/**
+ * @brief Settings given on the command line, see main.cpp
+ */
+struct Options {
+    Engine engine;
+    size_t max_depth; ///< Continuation frames ENGINE_CEK, or calls ENGINE_VM and ENGINE_REG, may hold
+    bool jit;                ///< Let ENGINE_VM compile hot procedures to native code
+    unsigned jit_threshold;  ///< Calls a procedure takes before it is compiled
+    unsigned tier_threshold; ///< Calls and loop iterations before ENGINE_TIERED moves a procedure to the VM
+    bool tier_log;           ///< Report on stderr procedures moved to a higher tier
+};
+
+extern Options options;
+
+#endif // DEF_HPP
@@ -0,0 +1,439 @@
+/**
+ * @file cek.cpp
+ * @brief Evaluator keeping its continuation on the heap
+ *
+ * evalCEK runs the same resolved expression trees as ExprBase::eval, but
+ * instead of recursing it pushes a Kont for every expression waiting on a
+ * subexpression. The depth of recursion in the evaluated program is then
+ * only bounded by memory and by options.max_depth, whose excess is
+ * reported as a RuntimeError rather than a stack overflow.
+ *
+ * Expressions without subexpressions to evaluate (constants, variables,
+ * quote, lambda) are evaluated with eval directly.
+ *
+ * The continuation being data, call/cc saves a copy of it, and resuming
+ * the copy replaces the current one; call/ec instead leaves a Kont marking
+ * its extent, and resuming its continuation drops what was pushed above.
+ */
+
+#include "Def.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include "RE.hpp"
+#include <vector>
+
+/**
+ * @brief An expression waiting for the value of one of its subexpressions
+ */
+struct Kont {
+    ExprBase *node;
+    int step;           ///< Subexpressions of node evaluated so far
+    int clause;         ///< Clause being evaluated, for cond
+    size_t base;        ///< Size of the value stack when node was entered
+    const Builtin *op;  ///< Primitive applied by node, if it is a primitive
+    Assoc env;
+};
+
+/**
+ * @brief Continuation saved by call/cc
+ */
+struct SavedKont {
+    Expr root; ///< Form evaluated, which the nodes of top-level Konts belong to
+    std::vector<Kont> ks;
+    std::vector<Value> vals;
+};
+
+// #f is the only false value
+static bool isTrue(const Value &v) {
+    return !v.isFalse();
+}
+
+static bool applicable(const Value &v) {
+    return v.type() == V_PROC || v.type() == V_PRIM || v.type() == V_CONT;
+}
+
+Value evalCEK(ExprBase *root, Assoc &env) {
+    std::vector<Kont> ks;
+    std::vector<Value> vals;   ///< Operand values of the expressions in ks
+    std::vector<Expr *> kids;  ///< Operands of a primitive, refilled as needed
+    std::vector<Value> args;
+    Escapes escapes;
+    ExprBase *c = root;
+    Assoc e = env;
+    Value v(nullptr);
+    bool eval = true;
+
+    auto push = [&](ExprBase *node, const Assoc &k_env, const Builtin *op) {
+        if (ks.size() >= options.max_depth) throw RuntimeError("Recursion depth limit exceeded");
+        ks.push_back(Kont{node, 0, 0, vals.size(), op, k_env});
+    };
+
+    // Whether the call/ec of an escape continuation is still waiting,
+    // which resuming a saved continuation may have changed
+    auto waiting = [&](Continuation *k) {
+        if (k->depth > ks.size()) return false;
+        const Kont &mark = ks[k->depth - 1];
+        return mark.node->e_type == E_CALLEC && mark.step == 1 && vals[mark.base].get() == k;
+    };
+
+    // Returns x from the call/cc or call/ec of k
+    auto resume = [&](Continuation *k, Value x) {
+        if (k->saved != nullptr) {
+            ks = k->saved->ks;
+            vals = k->saved->vals;
+        } else {
+            if (k->owner != &escapes) k->unwind(x);
+            if (!waiting(k)) throw RuntimeError("Continuation resumed after its extent");
+            ks.erase(ks.begin() + k->depth, ks.end());
+            vals.erase(vals.begin() + k->height, vals.end());
+        }
+        v = x;
+    };
+
+    // Applies vals[base] to the n values after it, which are dropped: the
+    // body of a procedure becomes c, other results are returned in v
+    auto apply = [&](size_t base, int n) {
+        Value proc = vals[base];
+        if (proc.type() == V_PROC && static_cast<Procedure *>(proc.get())->lambda()->x.size() == n) {
+            // the body runs in place of the call, so tail calls take no
+            // room
+            Lambda *lam = static_cast<Procedure *>(proc.get())->lambda();
+            e = frame(n + 1, empty());
+            Value *slots = e->slots();
+            for (int i = 0; i < n; i++)
+                slots[i] = lam->boxed[i] ? BoxV(vals[base + 1 + i]) : vals[base + 1 + i];
+            slots[n] = proc;
+            vals.erase(vals.begin() + base, vals.end());
+            c = lam->e.get();
+            eval = true;
+            return;
+        }
+        eval = false;
+        if (proc.type() == V_CONT && n == 1) {
+            resume(static_cast<Continuation *>(proc.get()), vals[base + 1]);
+            return;
+        }
+        if (proc.type() != V_PRIM) throw RuntimeError("Wrong number of arguments");
+        args.assign(vals.begin() + base + 1, vals.end());
+        vals.erase(vals.begin() + base, vals.end());
+        v = static_cast<Primitive *>(proc.get())->call(args);
+    };
+
+    while (true) {
+        if (eval) {
+            // Evaluate c in e: either descend into a subexpression, or
+            // produce v and switch to returning it
+            switch (c->e_type) {
+                case E_IF: {
+                    push(c, e, nullptr);
+                    c = static_cast<If *>(c)->cond.get();
+                    continue;
+                }
+                case E_COND: {
+                    Cond *cd = static_cast<Cond *>(c);
+                    if (cd->clauses.empty()) throw RuntimeError("Wrong in Cond");
+                    if (cd->clauses[0].empty()) throw RuntimeError("No predict?");
+                    push(c, e, nullptr);
+                    c = cd->clauses[0][0].get();
+                    continue;
+                }
+                case E_AND:
+                case E_OR: {
+                    std::vector<Expr> &rands = c->e_type == E_AND ? static_cast<AndVar *>(c)->rands
+                                                                   : static_cast<OrVar *>(c)->rands;
+                    if (rands.empty()) {
+                        v = BooleanV(c->e_type == E_AND);
+                        break;
+                    }
+                    if (rands.size() > 1) push(c, e, nullptr);
+                    c = rands[0].get();
+                    continue;
+                }
+                case E_BEGIN: {
+                    Begin *b = static_cast<Begin *>(c);
+                    if (b->es.empty()) {
+                        v = VoidV();
+                        break;
+                    }
+                    e = b->open(e);
+                    if (b->es.size() > 1) push(c, e, nullptr);
+                    c = b->es[0].get();
+                    continue;
+                }
+                case E_APPLY: {
+                    push(c, e, nullptr);
+                    c = static_cast<Apply *>(c)->rator.get();
+                    continue;
+                }
+                case E_INLINE: {
+                    Inline *in = static_cast<Inline *>(c);
+                    c = (in->current() ? in->body : in->call).get();
+                    continue;
+                }
+                case E_DEFINE: {
+                    Define *d = static_cast<Define *>(c);
+                    d->prepare();
+                    push(c, e, nullptr);
+                    c = d->e.get();
+                    continue;
+                }
+                case E_SET: {
+                    push(c, e, nullptr);
+                    c = static_cast<Set *>(c)->e.get();
+                    continue;
+                }
+                case E_LET:
+                case E_LOOP: {
+                    Let *l = static_cast<Let *>(c);
+                    if (l->bind.empty()) {
+                        e = frame(0, e);
+                        c = l->body.get();
+                        continue;
+                    }
+                    push(c, e, nullptr);
+                    c = l->bind[0].second.get();
+                    continue;
+                }
+                case E_RECUR: {
+                    Recur *r = static_cast<Recur *>(c);
+                    if (r->rands.empty()) {
+                        c = r->loop->body.get();
+                        e = Assoc(enclosing(r->depth, e));
+                        continue;
+                    }
+                    push(c, e, nullptr);
+                    c = r->rands[0].get();
+                    continue;
+                }
+                case E_CALLEC:
+                case E_CALLCC: {
+                    push(c, e, nullptr);
+                    c = static_cast<CallEC *>(c)->rand.get();
+                    continue;
+                }
+                case E_LETREC: {
+                    Letrec *l = static_cast<Letrec *>(c);
+                    e = l->open(e);
+                    if (!l->bind.empty()) {
+                        push(c, e, nullptr);
+                        c = l->bind[0].second.get();
+                    } else c = l->body.get();
+                    continue;
+                }
+                default: {
+                    const Builtin *op = builtinOf(c->e_type);
+                    if (op == nullptr) {
+                        try {
+                            v = c->eval(e);
+                        } catch (const Unwind &u) {
+                            // resumed by a node evaluated as a whole
+                            if (u.k->saved == nullptr && u.k->owner != &escapes) throw;
+                            resume(u.k, u.v);
+                        }
+                        break;
+                    }
+                    kids.clear();
+                    c->subexprs(kids);
+                    if (kids.empty()) {
+                        args.clear();
+                        v = op->fn(args);
+                        break;
+                    }
+                    push(c, e, op);
+                    c = kids[0]->get();
+                    continue;
+                }
+            }
+            eval = false;
+        }
+
+        // Return v to the innermost waiting expression
+        if (ks.empty()) return v;
+        Kont &k = ks.back();
+        eval = true;
+        switch (k.node->e_type) {
+            case E_IF: {
+                If *i = static_cast<If *>(k.node);
+                c = isTrue(v) ? i->conseq.get() : i->alter.get();
+                e = k.env;
+                ks.pop_back();
+                break;
+            }
+            case E_COND: {
+                std::vector<std::vector<Expr> > &clauses = static_cast<Cond *>(k.node)->clauses;
+                if (k.step == 0 && !isTrue(v)) {
+                    // next clause
+                    if (++k.clause == clauses.size()) throw RuntimeError("Wrong in Cond");
+                    if (clauses[k.clause].empty()) throw RuntimeError("No predict?");
+                    c = clauses[k.clause][0].get();
+                    e = k.env;
+                    break;
+                }
+                std::vector<Expr> &clause = clauses[k.clause];
+                if (++k.step == clause.size()) {
+                    // a clause without body has the value of its test
+                    ks.pop_back();
+                    eval = false;
+                    break;
+                }
+                c = clause[k.step].get();
+                e = k.env;
+                if (k.step + 1 == clause.size()) ks.pop_back();
+                break;
+            }
+            case E_AND:
+            case E_OR: {
+                std::vector<Expr> &rands = k.node->e_type == E_AND ? static_cast<AndVar *>(k.node)->rands
+                                                                    : static_cast<OrVar *>(k.node)->rands;
+                if (isTrue(v) == (k.node->e_type == E_OR)) {
+                    ks.pop_back();
+                    eval = false;
+                    break;
+                }
+                c = rands[++k.step].get();
+                e = k.env;
+                if (k.step + 1 == rands.size()) ks.pop_back();
+                break;
+            }
+            case E_BEGIN: {
+                std::vector<Expr> &es = static_cast<Begin *>(k.node)->es;
+                c = es[++k.step].get();
+                e = k.env;
+                if (k.step + 1 == es.size()) ks.pop_back();
+                break;
+            }
+            case E_APPLY: {
+                Apply *a = static_cast<Apply *>(k.node);
+                if (k.step == 0 && !applicable(v)) throw RuntimeError("Attempt to apply a non-procedure");
+                vals.push_back(v);
+                if (k.step < a->rand.size()) {
+                    c = a->rand[k.step++].get();
+                    e = k.env;
+                    break;
+                }
+                size_t base = k.base;
+                ks.pop_back();
+                apply(base, a->rand.size());
+                break;
+            }
+            case E_CALLEC: {
+                if (k.step == 0) {
+                    // the procedure, applied to a continuation returning
+                    // here, where this Kont stays to mark the extent
+                    if (!applicable(v)) throw RuntimeError("Attempt to apply a non-procedure");
+                    k.step = 1;
+                    size_t base = k.base;
+                    Value cont = escapes.capture(ks.size(), base + 1);
+                    vals.push_back(cont);
+                    vals.push_back(v);
+                    vals.push_back(cont);
+                    apply(base + 1, 1);
+                    break;
+                }
+                Continuation *cont = static_cast<Continuation *>(vals[k.base].get());
+                if (cont->owner == &escapes) {
+                    escapes.cut(cont);
+                    escapes.release();
+                }
+                vals.erase(vals.begin() + k.base, vals.end());
+                ks.pop_back();
+                eval = false;
+                break;
+            }
+            case E_CALLCC: {
+                // the procedure runs in place of call/cc, with a copy of
+                // the rest of the computation
+                if (!applicable(v)) throw RuntimeError("Attempt to apply a non-procedure");
+                size_t base = k.base;
+                ks.pop_back();
+                Continuation *saved = new Continuation(nullptr, 0, 0);
+                Value cont(saved);
+                saved->saved = std::make_shared<SavedKont>(SavedKont{Expr(root->shared_from_this()), ks, vals});
+                vals.push_back(v);
+                vals.push_back(cont);
+                apply(base, 1);
+                break;
+            }
+            case E_DEFINE: {
+                v = static_cast<Define *>(k.node)->store(k.env, v);
+                ks.pop_back();
+                eval = false;
+                break;
+            }
+            case E_SET: {
+                v = static_cast<Set *>(k.node)->store(k.env, v);
+                ks.pop_back();
+                eval = false;
+                break;
+            }
+            case E_LET:
+            case E_LOOP: {
+                Let *l = static_cast<Let *>(k.node);
+                vals.push_back(v);
+                if (++k.step < l->bind.size()) {
+                    c = l->bind[k.step].second.get();
+                    e = k.env;
+                    break;
+                }
+                size_t base = k.base;
+                e = frame(l->bind.size(), k.env);
+                ks.pop_back();
+                for (int i = 0; i < l->bind.size(); i++)
+                    e->slots()[i] = l->boxed[i] ? BoxV(vals[base + i]) : vals[base + i];
+                vals.erase(vals.begin() + base, vals.end());
+                c = l->body.get();
+                break;
+            }
+            case E_RECUR: {
+                Recur *r = static_cast<Recur *>(k.node);
+                vals.push_back(v);
+                if (++k.step < r->rands.size()) {
+                    c = r->rands[k.step].get();
+                    e = k.env;
+                    break;
+                }
+                // the next iteration gets a frame of its own rather than
+                // the loop's, which continuations may still hold
+                size_t base = k.base;
+                int n = r->rands.size();
+                e = frame(n, enclosing(r->depth, k.env)->next);
+                ks.pop_back();
+                for (int i = 0; i < n; i++)
+                    e->slots()[i] = r->loop->boxed[i] ? BoxV(vals[base + i]) : vals[base + i];
+                vals.erase(vals.begin() + base, vals.end());
+                c = r->loop->body.get();
+                break;
+            }
+            case E_LETREC: {
+                Letrec *l = static_cast<Letrec *>(k.node);
+                l->init(k.env, k.step, v);
+                e = k.env;
+                if (++k.step < l->bind.size()) {
+                    c = l->bind[k.step].second.get();
+                    break;
+                }
+                ks.pop_back();
+                c = l->body.get();
+                break;
+            }
+            default: {
+                // a primitive applied to its operands
+                vals.push_back(v);
+                kids.clear();
+                k.node->subexprs(kids);
+                if (++k.step < kids.size()) {
+                    c = kids[k.step]->get();
+                    e = k.env;
+                    break;
+                }
+                const Builtin *op = k.op;
+                args.assign(vals.begin() + k.base, vals.end());
+                vals.erase(vals.begin() + k.base, vals.end());
+                ks.pop_back();
+                v = op->fn(args);
+                eval = false;
+                break;
+            }
+        }
+    }
+}
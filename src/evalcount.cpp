@@ -0,0 +1,113 @@
+/**
+ * @file evalcount.cpp
+ * @brief Debug instrumentation counting how often each expression is evaluated
+ *
+ * Built with -DCOUNT_EVALS (cmake -DCOUNT_EVALS=ON), resolveProgram wraps
+ * every subexpression in a Counted node. Each evaluation of a Counted node
+ * is a dynamic entry with a serial number of its own; a node evaluated
+ * twice within the same entry of its parent is reported on stderr, since
+ * no expression of the language evaluates an operand more than once.
+ *
+ * Counted nodes are not compiled by the VM and evaluated as a whole by the
+ * CEK engine, so the check is meant for the tree-walking evaluator.
+ */
+
+#ifdef COUNT_EVALS
+
+#include "Def.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include <iostream>
+#include <vector>
+
+static std::vector<unsigned long> entries;  ///< Entries of the Counted nodes being evaluated
+static unsigned long serial = 0;
+static unsigned long top = 0;                ///< Entry of the top-level form
+
+// A name for the report: the variable, the primitive, or the node type
+static std::string describe(ExprBase *ex) {
+    switch (ex->e_type) {
+        case E_LOCALVAR: return *static_cast<LocalVar *>(ex)->x;
+        case E_CLOSUREVAR: return *static_cast<ClosureVar *>(ex)->x;
+        case E_GLOBALVAR: return *static_cast<GlobalVar *>(ex)->x;
+        case E_PRIMVAR: return *static_cast<PrimitiveVar *>(ex)->x;
+        case E_BEGIN: return "(begin ...)";
+        case E_QUOTE: return "(quote ...)";
+        case E_IF: return "(if ...)";
+        case E_COND: return "(cond ...)";
+        case E_AND: return "(and ...)";
+        case E_OR: return "(or ...)";
+        case E_APPLY: return "procedure call";
+        case E_INLINE: return "inlined call";
+        case E_LAMBDA: return "(lambda ...)";
+        case E_DEFINE: return "(define ...)";
+        case E_LET: return "(let ...)";
+        case E_LETREC: return "(letrec ...)";
+        case E_LOOP: return "loop";
+        case E_RECUR: return "loop iteration";
+        case E_SET: return "(set! ...)";
+        default: break;
+    }
+    const Builtin *op = builtinOf(ex->e_type);
+    if (op != nullptr) return std::string("(") + op->name + " ...)";
+    return "expression of type " + std::to_string(ex->e_type);
+}
+
+// Records one evaluation of c and opens its entry
+static void enter(Counted *c) {
+    unsigned long parent = entries.empty() ? top : entries.back();
+    c->evals++;
+    if (c->entry == parent && !c->reported) {
+        std::cerr << "eval-count: " << describe(c->e.get()) << " evaluated more than once in one entry of its parent ("
+                  << c->evals << " evaluations so far)" << std::endl;
+        c->reported = true;
+    }
+    c->entry = parent;
+    entries.push_back(++serial);
+}
+
+EvalEntry::EvalEntry() {
+    entries.push_back(++serial);
+}
+
+EvalEntry::~EvalEntry() {
+    entries.pop_back();
+}
+
+Counted::Counted(const Expr &e) : ExprBase(E_COUNTED), e(e), evals(0), entry(0), reported(false) {}
+
+Value Counted::eval(Assoc &env) {
+    enter(this);
+    struct Leave {
+        ~Leave() { entries.pop_back(); }
+    } leave;
+    return e->eval(env);
+}
+
+Value Counted::evalTail(Assoc &env, TailCall &tc) {
+    enter(this);
+    struct Leave {
+        ~Leave() { entries.pop_back(); }
+    } leave;
+    return e->evalTail(env, tc);
+}
+
+void Counted::subexprs(std::vector<Expr *> &out) {
+    out.push_back(&e);
+}
+
+static void wrap(Expr &ex) {
+    std::vector<Expr *> sub;
+    ex->subexprs(sub);
+    for (Expr *i : sub) {
+        wrap(*i);
+        *i = Expr(new Counted(*i));
+    }
+}
+
+void countEvals(Expr &ex) {
+    top = ++serial;
+    wrap(ex);
+}
+
+#endif
@@ -1,966 +1,1208 @@
-/**
- * @file evaluation.cpp
- * @brief Expression evaluation implementation for the Scheme interpreter
- * @author luke36
- * 
- * This file implements evaluation methods for all expression types in the Scheme
- * interpreter. Functions are organized according to ExprType enumeration order
- * from Def.hpp for consistency and maintainability.
- */
-
-#include "value.hpp"
-#include "expr.hpp"
-#include "RE.hpp"
-#include "syntax.hpp"
-#include <cstring>
-#include <vector>
-#include <map>
-#include <climits>
-#include <list>
-#include <bits/stl_algo.h>
-
-extern std::map<std::string, ExprType> primitives;
-extern std::map<std::string, ExprType> reserved_words;
-
-Value Fixnum::eval(Assoc &e) {
-    // evaluation of a fixnum
-    return IntegerV(n);
-}
-
-Value RationalNum::eval(Assoc &e) {
-    // evaluation of a rational number
-    return RationalV(numerator, denominator);
-}
-
-Value StringExpr::eval(Assoc &e) {
-    // evaluation of a string
-    return StringV(s);
-}
-
-Value True::eval(Assoc &e) {
-    // evaluation of #t
-    return BooleanV(true);
-}
-
-Value False::eval(Assoc &e) {
-    // evaluation of #f
-    return BooleanV(false);
-}
-
-Value MakeVoid::eval(Assoc &e) {
-    // (void)
-    return VoidV();
-}
-
-Value Exit::eval(Assoc &e) {
-    // (exit)
-    return TerminateV();
-}
-
-Value Unary::eval(Assoc &e) {
-    // evaluation of single-operator primitive
-    return evalRator(rand->eval(e));
-}
-
-Value Binary::eval(Assoc &e) {
-    // evaluation of two-operators primitive
-    return evalRator(rand1->eval(e), rand2->eval(e));
-}
-
-Value Variadic::eval(Assoc &e) {
-    // evaluation of multi-operator primitive
-    // TODO: TO COMPLETE THE VARIADIC CLASS
-    std::vector<Value> temp;
-    temp.clear();
-    for (Expr i: rands)temp.push_back(i->eval(e));
-    return evalRator(temp);
-}
-
-bool try_parse_as_number(const std::string &st) {
-    if ((st[0] == '+' || st[0] == '-') && st.size() == 1)return false;
-    for (int i = 0; i < st.size(); i++) {
-        if (i == 0 && st[i] == '+' || st[i] == '-')continue;
-        if (isdigit(st[i]))continue;
-        return false;
-    }
-    return true;
-}
-
-Value Var::eval(Assoc &e) {
-    // evaluation of variable
-    // TODO: TO identify the invalid variable
-    // We request all valid variable just need to be a symbol,you should promise:
-    //The first character of a variable name cannot be a digit or any character from the set: {.@}
-    //If a string can be recognized as a number, it will be prioritized as a number. For example: 1, -1, +123, .123, +124., 1e-3
-    //Variable names can overlap with primitives and reserve_words
-    //Variable names can contain any non-whitespace characters except #, ', ", `, but the first character cannot be a digit
-    //When a variable is not defined in the current scope, your interpreter should output RuntimeError
-    if (x.empty()) throw(RuntimeError("Invalid variable name"));
-    if (x[0] == '.' || x[0] == '@') throw(RuntimeError("Invalid variable name"));
-    if (isdigit(static_cast<unsigned char>(x[0]))) throw(RuntimeError("Invalid variable name"));
-    if (try_parse_as_number(x)) {
-        bool neg = false;
-        int n = 0;
-        int i = 0;
-        if (x[0] == '-') {
-            i += 1;
-            neg = true;
-        } else if (x[0] == '+') {
-            i += 1;
-        }
-        for (; i < (int) x.size(); i++) {
-            if (isdigit(x[i])) n = n * 10 + x[i] - '0';
-        }
-        return IntegerV(neg ? -n : n);
-    }
-    if (x.find('#') != std::string::npos || x.find('\'') != std::string::npos || x.find('"') != std::string::npos || x.
-        find('`') != std::string::npos) {
-        throw(RuntimeError("Invalid variable name"));
-    }
-    Value matched_value = find(x, e);
-    if (matched_value.get() == nullptr) {
-        if (primitives.count(x)) {
-            static std::map<ExprType, std::pair<Expr, std::vector<std::string> > > primitive_map = {
-                {E_VOID, {new MakeVoid(), {}}},
-                {E_EXIT, {new Exit(), {}}},
-                {E_BOOLQ, {new IsBoolean(new Var("parm")), {"parm"}}},
-                {E_INTQ, {new IsFixnum(new Var("parm")), {"parm"}}},
-                {E_NULLQ, {new IsNull(new Var("parm")), {"parm"}}},
-                {E_PAIRQ, {new IsPair(new Var("parm")), {"parm"}}},
-                {E_PROCQ, {new IsProcedure(new Var("parm")), {"parm"}}},
-                {E_SYMBOLQ, {new IsSymbol(new Var("parm")), {"parm"}}},
-                {E_STRINGQ, {new IsString(new Var("parm")), {"parm"}}},
-                {E_DISPLAY, {new Display(new Var("parm")), {"parm"}}},
-                {E_PLUS, {new PlusVar({}), {}}},
-                {E_MINUS, {new MinusVar({}), {}}},
-                {E_MUL, {new MultVar({}), {}}},
-                {E_DIV, {new DivVar({}), {}}},
-                {E_MODULO, {new Modulo(new Var("parm1"), new Var("parm2")), {"parm1", "parm2"}}},
-                {E_EXPT, {new Expt(new Var("parm1"), new Var("parm2")), {"parm1", "parm2"}}},
-                {E_EQQ, {new EqualVar({}), {}}},
-                {E_GE, {new GreaterEqVar({}), {}}},
-                {E_GT, {new GreaterVar({}), {}}},
-                {E_EQ, {new EqualVar({}), {}}},
-                {E_LE, {new LessEqVar({}), {}}},
-                {E_LT, {new LessVar({}), {}}},
-                {E_CAR, {new Car(new Var("parm")), {"parm"}}},
-                {E_CDR, {new Cdr(new Var("parm")), {"parm"}}},
-                {E_NOT, {new Not(new Var("parm")), {"parm"}}},
-                {E_CONS, {new Cons(new Var("parm1"), new Var("parm2")), {"parm1", "parm2"}}},
-            };
-
-            auto it = primitive_map.find(primitives[x]);
-            if (it != primitive_map.end()) {
-                //TODO
-                return ProcedureV(it->second.second, it->second.first, e);
-            }
-        }
-        if (reserved_words.count(x)) {
-            static std::map<ExprType, std::pair<Expr, std::vector<std::string> > > reserved_map = {
-                {E_BEGIN, {new Begin({}), {}}},
-                {E_QUOTE, {new Quote(new List), {}}},
-                {E_IF, {new If(new Var("parm1"), new Var("parm2"), new Var("parm3")), {"parm1", "parm2", "parm3"}}},
-                {E_COND, {new Cond({}), {}}},
-                {E_LAMBDA, {new Lambda({}, new Var("parm")), {{}, "parm"}}},
-                {E_DEFINE, {new Define({}, new Var("parm")), {{}, "parm"}}},
-                {E_LET, {new Let({}, new Var("parm")), {{}, "parm"}}},
-                {E_LETREC, {new Letrec({}, new Var("parm")), {{}, "parm"}}},
-                {E_SET, {new Set({}, new Var("parm")), {{}, "parm"}}},
-            };
-            auto it = reserved_map.find(primitives[x]);
-            if (it != reserved_map.end()) {
-                //TODO
-                return ProcedureV(it->second.second, it->second.first, e);
-            }
-        }
-        throw(RuntimeError("Undefined Var" + x));
-    }
-    return matched_value;
-}
-
-Value distribute(Rational &ans) {
-    int temp = std::__gcd(ans.denominator, ans.numerator);
-    ans.denominator /= temp;
-    ans.numerator /= temp;
-    if (ans.denominator < 0) {
-        ans.denominator = -ans.denominator;
-        ans.numerator = -ans.numerator;
-    }
-    if (ans.denominator == 0)throw(RuntimeError("Unknown Error"));
-    if (ans.denominator == 1)return IntegerV(ans.numerator);
-    else return RationalV(ans.numerator, ans.denominator);
-}
-
-bool IS_DIGIT(const Value &rand1) {
-    return (rand1->v_type == V_INT || rand1->v_type == V_RATIONAL);
-}
-
-Value Plus::evalRator(const Value &rand1, const Value &rand2) {
-    // +
-    //TODO: To complete the addition logic
-    if (IS_DIGIT(rand1) && IS_DIGIT(rand2)) {
-        Rational sum(1, 1);
-        if (rand1->v_type == V_INT)sum.numerator = dynamic_cast<Integer *>(rand1.get())->n;
-        else if (rand1->v_type == V_RATIONAL) {
-            sum.numerator = dynamic_cast<Rational *>(rand1.get())->numerator;
-            sum.denominator = dynamic_cast<Rational *>(rand1.get())->denominator;
-        }
-        if (rand2->v_type == V_INT)sum.numerator += dynamic_cast<Integer *>(rand2.get())->n * sum.denominator;
-        else if (rand2->v_type == V_RATIONAL) {
-            Rational temp_RA(dynamic_cast<Rational *>(rand2.get())->numerator,
-                             dynamic_cast<Rational *>(rand2.get())->denominator);
-            sum.numerator = temp_RA.numerator * sum.denominator + temp_RA.denominator * sum.numerator;
-            sum.denominator = temp_RA.denominator * sum.denominator;
-        }
-        return distribute(sum);
-    }
-    throw(RuntimeError("Wrong typename in Pl"));
-}
-
-Value Minus::evalRator(const Value &rand1, const Value &rand2) {
-    // -
-    //TODO: To complete the substraction logic
-    if (IS_DIGIT(rand1) && IS_DIGIT(rand2)) {
-        Rational difference(1, 1);
-        if (rand1->v_type == V_INT)difference.numerator = dynamic_cast<Integer *>(rand1.get())->n;
-        else if (rand1->v_type == V_RATIONAL) {
-            difference.numerator = dynamic_cast<Rational *>(rand1.get())->numerator;
-            difference.denominator = dynamic_cast<Rational *>(rand1.get())->denominator;
-        }
-        if (rand2->v_type == V_INT)
-            difference.numerator -= dynamic_cast<Integer *>(rand2.get())->n * difference.
-                    denominator;
-        else if (rand2->v_type == V_RATIONAL) {
-            Rational temp_RA(dynamic_cast<Rational *>(rand2.get())->numerator,
-                             dynamic_cast<Rational *>(rand2.get())->denominator);
-            difference.numerator = temp_RA.denominator * difference.numerator - temp_RA.numerator * difference.
-                                   denominator;
-            difference.denominator = temp_RA.denominator * difference.denominator;
-        }
-        return distribute(difference);
-    }
-    throw(RuntimeError("Wrong typename in Mi"));
-}
-
-Value Mult::evalRator(const Value &rand1, const Value &rand2) {
-    // *
-    //TODO: To complete the Multiplication logic
-    if (IS_DIGIT(rand1) && IS_DIGIT(rand2)) {
-        Rational multi(1, 1);
-        if (rand1->v_type == V_INT)multi.numerator = dynamic_cast<Integer *>(rand1.get())->n;
-        else if (rand1->v_type == V_RATIONAL) {
-            multi.numerator = dynamic_cast<Rational *>(rand1.get())->numerator;
-            multi.denominator = dynamic_cast<Rational *>(rand1.get())->denominator;
-        }
-        if (rand2->v_type == V_INT)multi.numerator *= dynamic_cast<Integer *>(rand2.get())->n;
-        else if (rand2->v_type == V_RATIONAL) {
-            Rational temp_RA(dynamic_cast<Rational *>(rand2.get())->numerator,
-                             dynamic_cast<Rational *>(rand2.get())->denominator);
-            multi.numerator *= temp_RA.numerator;
-            multi.denominator *= temp_RA.denominator;
-        }
-        return distribute(multi);
-    }
-    throw(RuntimeError("Wrong typename in Mul"));
-}
-
-Value Div::evalRator(const Value &rand1, const Value &rand2) {
-    // /
-    //TODO: To complete the dicision logic
-    if (IS_DIGIT(rand1) && IS_DIGIT(rand2)) {
-        Rational div(1, 1);
-        if (rand1->v_type == V_INT)div.numerator = dynamic_cast<Integer *>(rand1.get())->n;
-        else if (rand1->v_type == V_RATIONAL) {
-            div.numerator = dynamic_cast<Rational *>(rand1.get())->numerator;
-            div.denominator = dynamic_cast<Rational *>(rand1.get())->denominator;
-        }
-        if (rand2->v_type == V_INT) {
-            if (dynamic_cast<Integer *>(rand2.get())->n != 0)div.denominator *= dynamic_cast<Integer *>(rand2.get())->n;
-            else throw(RuntimeError("Division by zero"));
-        } else if (rand2->v_type == V_RATIONAL) {
-            Rational temp_RA(dynamic_cast<Rational *>(rand2.get())->numerator,
-                             dynamic_cast<Rational *>(rand2.get())->denominator);
-            if (temp_RA.numerator == 0)throw(RuntimeError("Division by zero"));
-            div.denominator *= temp_RA.numerator;
-            div.numerator *= temp_RA.denominator;
-        }
-        return distribute(div);
-    }
-    throw(RuntimeError("Wrong typename in Div"));
-}
-
-Value Modulo::evalRator(const Value &rand1, const Value &rand2) {
-    // modulo
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        int dividend = dynamic_cast<Integer *>(rand1.get())->n;
-        int divisor = dynamic_cast<Integer *>(rand2.get())->n;
-        if (divisor == 0) {
-            throw(RuntimeError("Division by zero"));
-        }
-        return IntegerV(dividend % divisor);
-    }
-    throw(RuntimeError("modulo is only defined for integers"));
-}
-
-Value PlusVar::evalRator(const std::vector<Value> &args) {
-    // + with multiple args
-    if (args.empty())throw(RuntimeError("No parameter"));
-    for (int i = 0; i < args.size(); i++)if (!IS_DIGIT(args[i]))throw(RuntimeError("Wrong typename"));
-    Rational sum(0, 1);
-    if (args[0]->v_type == V_INT)sum.numerator = dynamic_cast<Integer *>(args[0].get())->n;
-    else if (args[0]->v_type == V_RATIONAL) {
-        sum.numerator = dynamic_cast<Rational *>(args[0].get())->numerator;
-        sum.denominator = dynamic_cast<Rational *>(args[0].get())->denominator;
-    }
-    for (int i = 1; i < args.size(); i++) {
-        if (IS_DIGIT(args[i])) {
-            if (args[i]->v_type == V_INT)sum.numerator += dynamic_cast<Integer *>(args[i].get())->n * sum.denominator;
-            else if (args[i]->v_type == V_RATIONAL) {
-                Rational temp_RA(dynamic_cast<Rational *>(args[i].get())->numerator,
-                                 dynamic_cast<Rational *>(args[i].get())->denominator);
-                sum.numerator = temp_RA.numerator * sum.denominator + temp_RA.denominator * sum.numerator;
-                sum.denominator = temp_RA.denominator * sum.denominator;
-            }
-            int temp = std::__gcd(sum.denominator, sum.numerator);
-            sum.denominator /= temp;
-            sum.numerator /= temp;
-            if (sum.denominator < 0) {
-                sum.denominator = -sum.denominator;
-                sum.numerator = -sum.numerator;
-            }
-        } else throw(RuntimeError("Wrong typename"));
-    }
-    return distribute(sum);
-}
-
-Value MinusVar::evalRator(const std::vector<Value> &args) {
-    // - with multiple args
-    if (args.empty())throw(RuntimeError("No parameter"));
-    for (int i = 0; i < args.size(); i++)if (!IS_DIGIT(args[i]))throw(RuntimeError("Wrong typename"));
-    Rational difference(0, 1);
-    if (args[0]->v_type == V_INT)difference.numerator = dynamic_cast<Integer *>(args[0].get())->n;
-    else if (args[0]->v_type == V_RATIONAL) {
-        difference.numerator = dynamic_cast<Rational *>(args[0].get())->numerator;
-        difference.denominator = dynamic_cast<Rational *>(args[0].get())->denominator;
-    }
-    for (int i = 1; i < args.size(); i++) {
-        if (IS_DIGIT(args[i])) {
-            if (args[i]->v_type == V_INT)
-                difference.numerator -= dynamic_cast<Integer *>(args[i].get())->n * difference.
-                        denominator;
-            else if (args[i]->v_type == V_RATIONAL) {
-                Rational temp_RA(dynamic_cast<Rational *>(args[i].get())->numerator,
-                                 dynamic_cast<Rational *>(args[i].get())->denominator);
-                difference.numerator = temp_RA.denominator * difference.numerator - temp_RA.numerator * difference.
-                                       denominator;
-                difference.denominator = temp_RA.denominator * difference.denominator;
-            }
-            int temp = std::__gcd(difference.denominator, difference.numerator);
-            difference.denominator /= temp;
-            difference.numerator /= temp;
-            if (difference.denominator < 0) {
-                difference.denominator = -difference.denominator;
-                difference.numerator = -difference.numerator;
-            }
-        } else throw(RuntimeError("Wrong typename"));
-    }
-    return distribute(difference);
-    //TODO: To complete the substraction logic
-}
-
-Value MultVar::evalRator(const std::vector<Value> &args) {
-    // * with multiple args
-    if (args.empty())throw(RuntimeError("No parameter"));
-    for (int i = 0; i < args.size(); i++)if (!IS_DIGIT(args[i]))throw(RuntimeError("Wrong typename"));
-    Rational mul(0, 1);
-    if (args[0]->v_type == V_INT)mul.numerator = dynamic_cast<Integer *>(args[0].get())->n;
-    else if (args[0]->v_type == V_RATIONAL) {
-        mul.numerator = dynamic_cast<Rational *>(args[0].get())->numerator;
-        mul.denominator = dynamic_cast<Rational *>(args[0].get())->denominator;
-    }
-    for (int i = 1; i < args.size(); i++) {
-        if (args[i]->v_type == V_INT)mul.numerator *= dynamic_cast<Integer *>(args[i].get())->n;
-        else if (args[i]->v_type == V_RATIONAL) {
-            Rational temp_RA(dynamic_cast<Rational *>(args[i].get())->numerator,
-                             dynamic_cast<Rational *>(args[i].get())->denominator);
-            mul.numerator *= temp_RA.numerator;
-            mul.denominator *= temp_RA.denominator;
-        }
-        int temp = std::__gcd(mul.denominator, mul.numerator);
-        mul.denominator /= temp;
-        mul.numerator /= temp;
-        if (mul.denominator < 0) {
-            mul.denominator = -mul.denominator;
-            mul.numerator = -mul.numerator;
-        }
-    }
-    return distribute(mul);
-}
-
-Value DivVar::evalRator(const std::vector<Value> &args) {
-    // / with multiple args
-    //TODO: To complete the divisor logic
-    if (args.empty())throw(RuntimeError("No parameter"));
-    for (int i = 0; i < args.size(); i++)if (!IS_DIGIT(args[i]))throw(RuntimeError("Wrong typename"));
-    Rational div(0, 1);
-    if (args[0]->v_type == V_INT)div.numerator = dynamic_cast<Integer *>(args[0].get())->n;
-    else if (args[0]->v_type == V_RATIONAL) {
-        div.numerator = dynamic_cast<Rational *>(args[0].get())->numerator;
-        div.denominator = dynamic_cast<Rational *>(args[0].get())->denominator;
-    }
-    for (int i = 1; i < args.size(); i++) {
-        if (args[i]->v_type == V_INT)div.denominator *= dynamic_cast<Integer *>(args[i].get())->n;
-        else if (args[i]->v_type == V_RATIONAL) {
-            Rational temp_RA(dynamic_cast<Rational *>(args[i].get())->numerator,
-                             dynamic_cast<Rational *>(args[i].get())->denominator);
-            div.numerator *= temp_RA.denominator;
-            div.denominator *= temp_RA.numerator;
-        }
-        int temp = std::__gcd(div.denominator, div.numerator);
-        div.denominator /= temp;
-        div.numerator /= temp;
-        if (div.denominator < 0) {
-            div.denominator = -div.denominator;
-            div.numerator = -div.numerator;
-        }
-    }
-    return distribute(div);
-}
-
-Value Expt::evalRator(const Value &rand1, const Value &rand2) {
-    // expt
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        int base = dynamic_cast<Integer *>(rand1.get())->n;
-        int exponent = dynamic_cast<Integer *>(rand2.get())->n;
-
-        if (exponent < 0) {
-            throw(RuntimeError("Negative exponent not supported for integers"));
-        }
-        if (base == 0 && exponent == 0) {
-            throw(RuntimeError("0^0 is undefined"));
-        }
-
-        int result = 1;
-        int b = base;
-        int exp = exponent;
-
-        while (exp > 0) {
-            if (exp % 2 == 1) {
-                result *= b;
-                if (result > INT_MAX || result < INT_MIN) {
-                    throw(RuntimeError("Integer overflow in expt"));
-                }
-            }
-            b *= b;
-            if (b > INT_MAX || b < INT_MIN) {
-                if (exp > 1) {
-                    throw(RuntimeError("Integer overflow in expt"));
-                }
-            }
-            exp /= 2;
-        }
-
-        return IntegerV(result);
-    }
-    throw(RuntimeError("Wrong typename"));
-}
-
-//A FUNCTION TO SIMPLIFY THE COMPARISON WITH INTEGER AND RATIONAL NUMBER
-int compareNumericValues(const Value &v1, const Value &v2) {
-    if (v1->v_type == V_INT && v2->v_type == V_INT) {
-        int n1 = dynamic_cast<Integer *>(v1.get())->n;
-        int n2 = dynamic_cast<Integer *>(v2.get())->n;
-        return (n1 < n2) ? -1 : (n1 > n2) ? 1 : 0;
-    } else if (v1->v_type == V_RATIONAL && v2->v_type == V_INT) {
-        Rational *r1 = dynamic_cast<Rational *>(v1.get());
-        int n2 = dynamic_cast<Integer *>(v2.get())->n;
-        int left = r1->numerator;
-        int right = n2 * r1->denominator;
-        return (left < right) ? -1 : (left > right) ? 1 : 0;
-    } else if (v1->v_type == V_INT && v2->v_type == V_RATIONAL) {
-        int n1 = dynamic_cast<Integer *>(v1.get())->n;
-        Rational *r2 = dynamic_cast<Rational *>(v2.get());
-        int left = n1 * r2->denominator;
-        int right = r2->numerator;
-        return (left < right) ? -1 : (left > right) ? 1 : 0;
-    } else if (v1->v_type == V_RATIONAL && v2->v_type == V_RATIONAL) {
-        Rational *r1 = dynamic_cast<Rational *>(v1.get());
-        Rational *r2 = dynamic_cast<Rational *>(v2.get());
-        int left = r1->numerator * r2->denominator;
-        int right = r2->numerator * r1->denominator;
-        return (left < right) ? -1 : (left > right) ? 1 : 0;
-    }
-    throw RuntimeError("Wrong typename in numeric comparison");
-}
-
-Value Less::evalRator(const Value &rand1, const Value &rand2) {
-    // <
-    //TODO: To complete the less logic
-    if ((rand1->v_type == V_INT || rand1->v_type == V_RATIONAL) && (
-            rand2->v_type == V_INT || rand2->v_type == V_RATIONAL)) {
-        return BooleanV(compareNumericValues(rand1, rand2) == -1);
-    }
-    throw(RuntimeError("Wrong typename in less"));
-}
-
-Value LessEq::evalRator(const Value &rand1, const Value &rand2) {
-    // <=
-    //TODO: To complete the lesseq logic
-    if ((rand1->v_type == V_INT || rand1->v_type == V_RATIONAL) && (
-            rand2->v_type == V_INT || rand2->v_type == V_RATIONAL)) {
-        return BooleanV(compareNumericValues(rand1, rand2) != 1);
-    }
-    throw(RuntimeError("Wrong typename in lessEq"));
-}
-
-Value Equal::evalRator(const Value &rand1, const Value &rand2) {
-    // =
-    //TODO: To complete the equal logic
-    if ((rand1->v_type == V_INT || rand1->v_type == V_RATIONAL) && (
-            rand2->v_type == V_INT || rand2->v_type == V_RATIONAL)) {
-        return BooleanV(compareNumericValues(rand1, rand2) == 0);
-    }
-    throw(RuntimeError("Wrong typename in Eq"));
-}
-
-Value GreaterEq::evalRator(const Value &rand1, const Value &rand2) {
-    // >=
-    //TODO: To complete the greatereq logic
-    if ((rand1->v_type == V_INT || rand1->v_type == V_RATIONAL) && (
-            rand2->v_type == V_INT || rand2->v_type == V_RATIONAL)) {
-        return BooleanV(compareNumericValues(rand1, rand2) != -1);
-    }
-    throw(RuntimeError("Wrong typename in Ge"));
-}
-
-Value Greater::evalRator(const Value &rand1, const Value &rand2) {
-    // >
-    //TODO: To complete the greater logic
-    if ((rand1->v_type == V_INT || rand1->v_type == V_RATIONAL) && (
-            rand2->v_type == V_INT || rand2->v_type == V_RATIONAL)) {
-        return BooleanV(compareNumericValues(rand1, rand2) == 1);
-    }
-    throw(RuntimeError("Wrong typename in Gr"));
-}
-
-Value LessVar::evalRator(const std::vector<Value> &args) {
-    // < with multiple args
-    //TODO: To complete the less logic
-    if (args.empty())throw(RuntimeError("No parameter"));
-    for (int i = 0; i < args.size(); i++)
-        if (args[i]->v_type != V_INT && args[i]->v_type != V_RATIONAL)
-            throw(
-                RuntimeError("Wrong typename in LsV"));
-    for (int i = 1; i < args.size(); i++)if (compareNumericValues(args[i - 1], args[i]) != -1)return BooleanV(false);
-    return BooleanV(true);
-}
-
-Value LessEqVar::evalRator(const std::vector<Value> &args) {
-    // <= with multiple args
-    //TODO: To complete the lesseq logic
-    if (args.empty())throw(RuntimeError("No parameter"));
-    for (int i = 0; i < args.size(); i++)
-        if (args[i]->v_type != V_INT && args[i]->v_type != V_RATIONAL)
-            throw(
-                RuntimeError("Wrong typename in LeV"));
-    for (int i = 1; i < args.size(); i++)if (compareNumericValues(args[i - 1], args[i]) == 1)return BooleanV(false);
-    return BooleanV(true);
-}
-
-Value EqualVar::evalRator(const std::vector<Value> &args) {
-    // = with multiple args
-    //TODO: To complete the equal logic
-    if (args.empty())throw(RuntimeError("No parameter"));
-    for (int i = 0; i < args.size(); i++)
-        if (args[i]->v_type != V_INT && args[i]->v_type != V_RATIONAL)
-            throw(
-                RuntimeError("Wrong typename in EqV"));
-    for (int i = 1; i < args.size(); i++)if (compareNumericValues(args[i - 1], args[i]) != 0)return BooleanV(false);
-    return BooleanV(true);
-}
-
-Value GreaterEqVar::evalRator(const std::vector<Value> &args) {
-    // >= with multiple args
-    //TODO: To complete the greatereq logic
-    if (args.empty())throw(RuntimeError("No parameter"));
-    for (int i = 0; i < args.size(); i++)
-        if (args[i]->v_type != V_INT && args[i]->v_type != V_RATIONAL)
-            throw(
-                RuntimeError("Wrong typename in GeV"));
-    for (int i = 1; i < args.size(); i++)if (compareNumericValues(args[i - 1], args[i]) == -1)return BooleanV(false);
-    return BooleanV(true);
-}
-
-Value GreaterVar::evalRator(const std::vector<Value> &args) {
-    // > with multiple args
-    //TODO: To complete the greater logic
-    if (args.empty())throw(RuntimeError("No parameter"));
-    for (int i = 0; i < args.size(); i++)
-        if (args[i]->v_type != V_INT && args[i]->v_type != V_RATIONAL)
-            throw(
-                RuntimeError("Wrong typename in GrV"));
-    for (int i = 1; i < args.size(); i++)if (compareNumericValues(args[i - 1], args[i]) != 1)return BooleanV(false);
-    return BooleanV(true);
-}
-
-Value Cons::evalRator(const Value &rand1, const Value &rand2) {
-    // cons
-    //TODO: To complete the cons logic
-    return PairV(rand1, rand2);
-}
-
-Value ListFunc::evalRator(const std::vector<Value> &args) {
-    // list function
-    //TODO: To complete the list logic
-    if (args.empty())return NullV();
-    Value temp = PairV(args[args.size() - 1], NullV());
-    for (int i = args.size() - 1; i >= 1; i--)temp = PairV(args[i - 1], temp);
-    return temp;
-    throw(RuntimeError("Unable to build a list"));
-}
-
-Value IsList::evalRator(const Value &rand) {
-    // list?
-    //TODO: To complete the list? logic
-    if (rand->v_type == V_PAIR) {
-        if (dynamic_cast<Pair *>(rand.get())->car->v_type == V_PAIR || dynamic_cast<Pair *>(rand.get())->cdr->v_type ==
-            V_PAIR)
-            return BooleanV(true);
-    }
-    return BooleanV(false);
-}
-
-Value Car::evalRator(const Value &rand) {
-    // car
-    //TODO: To complete the car logic
-    if (rand->v_type == V_PAIR)return dynamic_cast<Pair *>(rand.get())->car;
-    throw(RuntimeError("Not a pair for Car"));
-}
-
-Value Cdr::evalRator(const Value &rand) {
-    // cdr
-    //TODO: To complete the cdr logic
-    if (rand->v_type == V_PAIR)return dynamic_cast<Pair *>(rand.get())->cdr;
-    throw(RuntimeError("Not a pair for Cdr"));
-}
-
-Value SetCar::evalRator(const Value &rand1, const Value &rand2) {
-    // set-car!
-    //TODO: To complete the set-car! logic
-    if (rand1->v_type == V_PAIR) {
-        dynamic_cast<Pair *>(rand1.get())->car = rand2;
-        return VoidV();
-    }
-    throw(RuntimeError("Not a Pair"));
-}
-
-Value SetCdr::evalRator(const Value &rand1, const Value &rand2) {
-    // set-cdr!
-    //TODO: To complete the set-cdr! logic
-    if (rand1->v_type == V_PAIR) {
-        dynamic_cast<Pair *>(rand1.get())->cdr = rand2;
-        return VoidV();
-    }
-    throw(RuntimeError("Not a Pair"));
-}
-
-Value IsEq::evalRator(const Value &rand1, const Value &rand2) {
-    // eq?
-    // 检查类型是否为 Integer
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        return BooleanV((dynamic_cast<Integer *>(rand1.get())->n) == (dynamic_cast<Integer *>(rand2.get())->n));
-    }
-    // 检查类型是否为 Boolean
-    else if (rand1->v_type == V_BOOL && rand2->v_type == V_BOOL) {
-        return BooleanV((dynamic_cast<Boolean *>(rand1.get())->b) == (dynamic_cast<Boolean *>(rand2.get())->b));
-    }
-    // 检查类型是否为 Symbol
-    else if (rand1->v_type == V_SYM && rand2->v_type == V_SYM) {
-        return BooleanV((dynamic_cast<Symbol *>(rand1.get())->s) == (dynamic_cast<Symbol *>(rand2.get())->s));
-    }
-    // 检查类型是否为 Null 或 Void
-    else if ((rand1->v_type == V_NULL && rand2->v_type == V_NULL) ||
-             (rand1->v_type == V_VOID && rand2->v_type == V_VOID)) {
-        return BooleanV(true);
-    } else {
-        return BooleanV(rand1.get() == rand2.get());
-    }
-}
-
-Value IsBoolean::evalRator(const Value &rand) {
-    // boolean?
-    return BooleanV(rand->v_type == V_BOOL);
-}
-
-Value IsFixnum::evalRator(const Value &rand) {
-    // number?
-    return BooleanV(rand->v_type == V_INT);
-}
-
-Value IsNull::evalRator(const Value &rand) {
-    // null?
-    return BooleanV(rand->v_type == V_NULL);
-}
-
-Value IsPair::evalRator(const Value &rand) {
-    // pair?
-    return BooleanV(rand->v_type == V_PAIR);
-}
-
-Value IsProcedure::evalRator(const Value &rand) {
-    // procedure?
-    return BooleanV(rand->v_type == V_PROC);
-}
-
-Value IsSymbol::evalRator(const Value &rand) {
-    // symbol?
-    return BooleanV(rand->v_type == V_SYM);
-}
-
-Value IsString::evalRator(const Value &rand) {
-    // string?
-    return BooleanV(rand->v_type == V_STRING);
-}
-
-Value Begin::eval(Assoc &e) {
-    Value temp = VoidV();
-    bool flag = false;
-    for (Expr i: es) {
-        if (dynamic_cast<Define *>(i.get())) {
-            flag = true;
-            break;
-        }
-    }
-    if (!flag) {
-        for (Expr i: es) temp = i->eval(e);
-        return temp;
-    }
-    Assoc temp_e = e;
-    for (Expr i: es) {
-        if (dynamic_cast<Define *>(i.get())) {
-            Define *temp_def = dynamic_cast<Define *>(i.get());
-            if (find(temp_def->var, temp_e).get() == nullptr)temp_e = extend(temp_def->var, NullV(), temp_e);
-        }
-    }
-    for (Expr i: es)temp = i->eval(temp_e);
-    return temp;
-    //TODO: To complete the begin logic
-}
-
-Value Syntaxtransit(const Syntax s, Assoc &e) {
-    if (dynamic_cast<List *>(s.get())) {
-        List *temp_sy = dynamic_cast<List *>(s.get());
-        if (temp_sy->stxs.empty()) return NullV();
-        int len = temp_sy->stxs.size();
-        if (len == 3 && dynamic_cast<SymbolSyntax *>(temp_sy->stxs[1].get())) {
-            if (dynamic_cast<SymbolSyntax *>(temp_sy->stxs[1].get())->s.size() == 1 && dynamic_cast<SymbolSyntax *>(
-                    temp_sy->stxs[1].get())->s[0] == '.') {
-                Value car = Syntaxtransit(temp_sy->stxs[0], e);
-                Value cdr = Syntaxtransit(temp_sy->stxs[2], e);
-                return PairV(car, cdr);
-            }
-        }
-        for (int i = 0; i < len; i++) {
-            SymbolSyntax *dot = dynamic_cast<SymbolSyntax *>(temp_sy->stxs[i].get());
-            if (dot && dot->s == ".") {
-                if (i == 0 || i == temp_sy->stxs.size() - 1)throw RuntimeError("RuntimeError");
-                Value car = NullV();
-                for (int j = i - 1; j >= 0; j--) {
-                    Value elem = Syntaxtransit(temp_sy->stxs[j], e);
-                    car = PairV(elem, car);
-                }
-                Value cdr = Syntaxtransit(temp_sy->stxs[i + 1], e);
-                Value cu = car;
-                while (Pair *temp_pair = dynamic_cast<Pair *>(cu.get())) {
-                    if (dynamic_cast<Null *>(temp_pair->cdr.get())) {
-                        temp_pair->cdr = cdr;
-                        return car;
-                    }
-                    cu = temp_pair->cdr;
-                }
-                return car;
-            }
-        }
-        Value result = NullV();
-        for (int i = temp_sy->stxs.size() - 1; i >= 0; i--) {
-            Value element = Syntaxtransit(temp_sy->stxs[i], e);
-            result = PairV(element, result);
-        }
-        return result;
-    }
-    if (dynamic_cast<StringSyntax *>(s.get())) {
-        return StringV(dynamic_cast<StringSyntax *>(s.get())->s);
-    }
-    if (dynamic_cast<RationalSyntax *>(s.get())) {
-        return RationalV(dynamic_cast<RationalSyntax *>(s.get())->numerator,
-                         dynamic_cast<RationalSyntax *>(s.get())->denominator);
-    }
-    if (dynamic_cast<Number *>(s.get())) {
-        return IntegerV(dynamic_cast<Number *>(s.get())->n);
-    }
-    if (dynamic_cast<FalseSyntax *>(s.get())) {
-        return BooleanV(false);
-    }
-    if (dynamic_cast<TrueSyntax *>(s.get())) {
-        return BooleanV(true);
-    }
-    if (dynamic_cast<SymbolSyntax *>(s.get())) {
-        return SymbolV(dynamic_cast<SymbolSyntax *>(s.get())->s);
-    }
-    throw(RuntimeError("Wrong in Quote"));
-}
-
-Value Quote::eval(Assoc &e) {
-    return Syntaxtransit(s, e);
-    //TODO: To complete the quote logic
-}
-
-Value AndVar::eval(Assoc &e) {
-    // and with short-circuit evaluation
-    //TODO: To complete the and logic
-    Value temp = BooleanV(true);
-    for (Expr ex: rands) {
-        temp = ex->eval(e);
-        if (temp->v_type != V_BOOL)continue;
-        if (dynamic_cast<Boolean *>(temp.get())->b == false)return BooleanV(false);
-    }
-    return temp;
-}
-
-Value OrVar::eval(Assoc &e) {
-    // or with short-circuit evaluation
-    //TODO: To complete the or logic
-    Value temp = BooleanV(false);
-    for (Expr ex: rands) {
-        temp = ex->eval(e);
-        if (temp->v_type != V_BOOL)return temp;
-        if (dynamic_cast<Boolean *>(temp.get())->b != false)return BooleanV(true);
-    }
-    return temp;
-}
-
-Value Not::evalRator(const Value &rand) {
-    // not
-    if (rand->v_type == V_BOOL)return BooleanV(!dynamic_cast<Boolean *>(rand.get())->b);
-    if (rand->v_type != V_BOOL)return BooleanV(false);
-    throw(RuntimeError("Wrong in Not"));
-    //TODO: To complete the not logic
-}
-
-Value If::eval(Assoc &e) {
-    if (cond->eval(e)->v_type != V_BOOL)return conseq->eval(e);
-    else if (dynamic_cast<Boolean *>(cond->eval(e).get())->b == true)return conseq->eval(e);
-    else return alter->eval(e);
-    //TODO: To complete the if logic
-}
-
-Value Cond::eval(Assoc &env) {
-    for (int i = 0; i < clauses.size(); i++) {
-        if (clauses[i].empty())throw(RuntimeError("No predict?"));
-        if (clauses[i][0]->eval(env)->v_type != V_BOOL ||
-            clauses[i][0]->eval(env)->v_type == V_BOOL && dynamic_cast<Boolean *>(clauses[i][0]->eval(env).get())->b ==
-            true) {
-            for (int j = 1; j < clauses[i].size() - 1; j++) {
-                clauses[i][0]->eval(env);
-            }
-            return clauses[i][clauses[i].size() - 1]->eval(env);
-        }
-    }
-    throw(RuntimeError("Wrong in Cond"));
-    //TODO: To complete the cond logic
-}
-
-Value Lambda::eval(Assoc &env) {
-    return ProcedureV(x, e, env);
-    //TODO: To complete the lambda logic
-}
-
-Value Apply::eval(Assoc &e) {
-    Value proc = rator->eval(e);
-    if (proc.get() == nullptr || proc->v_type != V_PROC) {
-        throw RuntimeError("Attempt to apply a non-procedure");
-    }
-
-    Procedure *clos_ptr = dynamic_cast<Procedure *>(proc.get());
-    // Argument evaluation
-    std::vector<Value> args;
-    for (Expr i: rand) args.push_back(i->eval(e));
-    if (args.size() != clos_ptr->parameters.size()) {
-        if (auto varNode = dynamic_cast<Variadic *>(clos_ptr->e.get())) {
-            return varNode->evalRator(args);
-        }
-        if (auto binNode = dynamic_cast<Binary *>(clos_ptr->e.get())) {
-            if (args.size() == 2) return binNode->evalRator(args[0], args[1]);
-        }
-        if (auto unNode = dynamic_cast<Unary *>(clos_ptr->e.get())) {
-            if (args.size() == 1) return unNode->evalRator(args[0]);
-        }
-        throw RuntimeError("Wrong number of arguments");
-    }
-    Assoc param_env = clos_ptr->env;
-    for (int i = 0; i < clos_ptr->parameters.size(); i++) {
-        param_env = extend(clos_ptr->parameters[i], args[i], param_env);
-    }
-    return clos_ptr->e->eval(param_env);
-}
-
-Value Define::eval(Assoc &env) {
-    if (primitives.count(var) != 0 || reserved_words.count(var) != 0)throw(RuntimeError("Wrong defined name"));
-    if (var.empty() || var[0] == '@' || var[0] == '.')throw(RuntimeError("Wrong defined name"));
-    if (find(var,env).get()!=nullptr) {
-        Value v = e->eval(  env);
-        modify(var, v,  env);
-        return NonereturnV();
-    }
-    else {
-        env = extend(var, NullV(), env);
-        Value v = e->eval(  env);
-        modify(var, v,  env);
-        return NonereturnV();
-    }
-}
-
-Value Let::eval(Assoc &env) {
-    Assoc param_env = env;
-    for (int i = 0; i < bind.size(); i++) {
-        try {
-            Value temp = bind[i].second->eval(env);
-            param_env = extend(bind[i].first, temp, param_env);
-        } catch (const RuntimeError &e) {
-            throw(RuntimeError(e));
-        }
-    }
-    return body->eval(param_env);
-    //TODO: To complete the let logic
-}
-
-Value Letrec::eval(Assoc &env) {
-    Assoc e = env;
-    for (int i = 0; i < bind.size(); i++)e = extend(bind[i].first, NullV(), e);
-    Value s = nullptr;
-    for (int i = 0; i < bind.size(); i++) {
-        s = bind[i].second->eval(e);
-        modify(bind[i].first, s, e);
-    }
-    return body->eval(e);
-    //TODO: To complete the letrec logic
-}
-
-Value Set::eval(Assoc &env) {
-    Value temp = e->eval(env);
-    modify(var, temp, env);
-    return VoidV();
-    //TODO: To complete the set logic
-}
-
-Value Display::evalRator(const Value &rand) {
-    // display function
-    if (rand->v_type == V_STRING) {
-        String *str_ptr = dynamic_cast<String *>(rand.get());
-        std::cout << str_ptr->s;
-    } else {
-        rand->show(std::cout);
-    }
-
-    return VoidV();
-}
+/**
+ * @file evaluation.cpp
+ * @brief Expression evaluation implementation for the Scheme interpreter
+ * @author luke36
+ * 
+ * This file implements evaluation methods for all expression types in the Scheme
+ * interpreter. Functions are organized according to ExprType enumeration order
+ * from Def.hpp for consistency and maintainability.
+ */
+
+#include "value.hpp"
+#include "expr.hpp"
+#include "RE.hpp"
+#include "syntax.hpp"
+#include <cstring>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <climits>
+#include <list>
+#include <bits/stl_algo.h>
+
+
+Value ExprBase::evalTail(Assoc &e, TailCall &tc) {
+    return eval(e);
+}
+
+// Runs a procedure body, and every call it makes in tail position, in
+// constant C++ stack
+static Value run(ExprBase *body, Assoc env) {
+    TailCall tc{nullptr, empty()};
+    while (true) {
+#ifdef COUNT_EVALS
+        EvalEntry entry;
+#endif
+        Value v = body->evalTail(env, tc);
+        if (tc.body == nullptr) return v;
+        body = tc.body;
+        tc.body = nullptr;
+        env = tc.env;
+    }
+}
+
+// Evaluates through evalTail, for nodes whose tail may be a call
+static Value evalFull(ExprBase *ex, Assoc &e) {
+    TailCall tc{nullptr, empty()};
+    Value v = ex->evalTail(e, tc);
+    if (tc.body == nullptr) return v;
+    return run(tc.body, tc.env);
+}
+
+Value Fixnum::eval(Assoc &e) {
+    // evaluation of a fixnum
+    return IntegerV(n);
+}
+
+Value RationalNum::eval(Assoc &e) {
+    // evaluation of a rational number
+    return RationalV(numerator, denominator);
+}
+
+Value StringExpr::eval(Assoc &e) {
+    // evaluation of a string
+    return StringV(s);
+}
+
+Value True::eval(Assoc &e) {
+    // evaluation of #t
+    return BooleanV(true);
+}
+
+Value False::eval(Assoc &e) {
+    // evaluation of #f
+    return BooleanV(false);
+}
+
+Value MakeVoid::eval(Assoc &e) {
+    // (void)
+    return VoidV();
+}
+
+Value Exit::eval(Assoc &e) {
+    // (exit)
+    return TerminateV();
+}
+
+Value ExprBase::applyRator(const Value *args, int n) {
+    throw RuntimeError("Not a primitive operation");
+}
+
+bool ExprBase::test(Assoc &e) {
+    Value v = eval(e);
+    return !v.isFalse();
+}
+
+Value Unary::applyRator(const Value *args, int n) {
+    return evalRator(args[0]);
+}
+
+Value Binary::applyRator(const Value *args, int n) {
+    return specialized(args[0], args[1]);
+}
+
+Value Variadic::applyRator(const Value *args, int n) {
+    return evalRator(std::vector<Value>(args, args + n));
+}
+
+Value Unary::eval(Assoc &e) {
+    // evaluation of single-operator primitive
+    return evalRator(rand->eval(e));
+}
+
+Value Binary::eval(Assoc &e) {
+    // evaluation of two-operators primitive, right operand first
+    Value v2 = rand2->eval(e);
+    Value v1 = rand1->eval(e);
+    return specialized(v1, v2);
+}
+
+bool Binary::test(Assoc &e) {
+    if (compare == nullptr) return ExprBase::test(e);
+    // a comparison of fixnums branches on compare, without a Boolean
+    Value v2 = rand2->eval(e);
+    Value v1 = rand1->eval(e);
+    if (feedback != FB_GENERIC && v1.type() == V_INT && v2.type() == V_INT) {
+        feedback = FB_FIXNUM;
+        return compare(v1.fixnum(), v2.fixnum());
+    }
+    Value v = specialized(v1, v2);
+    return !v.isFalse();
+}
+
+Value Binary::specialized(const Value &rand1, const Value &rand2) {
+    if (fixnum != nullptr && feedback != FB_GENERIC) {
+        if (rand1.type() == V_INT && rand2.type() == V_INT) {
+            feedback = FB_FIXNUM;
+            return fixnum(rand1.fixnum(), rand2.fixnum());
+        }
+        // deoptimize
+        feedback = FB_GENERIC;
+    }
+    return evalRator(rand1, rand2);
+}
+
+Value Variadic::eval(Assoc &e) {
+    // evaluation of multi-operator primitive
+    // TODO: TO COMPLETE THE VARIADIC CLASS
+    std::vector<Value> temp;
+    temp.clear();
+    for (Expr i: rands)temp.push_back(i->eval(e));
+    return evalRator(temp);
+}
+
+bool try_parse_as_number(const std::string &st) {
+    if ((st[0] == '+' || st[0] == '-') && st.size() == 1)return false;
+    for (int i = 0; i < st.size(); i++) {
+        if (i == 0 && st[i] == '+' || st[i] == '-')continue;
+        if (isdigit(st[i]))continue;
+        return false;
+    }
+    return true;
+}
+
+// Value of an unbound identifier: a primitive used as a procedure, or an error
+static Value primitiveVar(Sym x) {
+    const Value *proc = primitiveProc(x);
+    if (proc == nullptr) throw(RuntimeError("Undefined Var" + *x));
+    return *proc;
+}
+
+Value Var::eval(Assoc &e) {
+    // evaluation of variable
+    // SymbolSyntax::parse has already turned numbers and invalid names into
+    // other nodes, so x is a plain identifier here
+    Value matched_value = find(x, e);
+    if (matched_value.get() == nullptr) matched_value = global_env.find(x);
+    if (matched_value.get() == nullptr) return primitiveVar(x);
+    return matched_value;
+}
+
+Value LocalVar::eval(Assoc &e) {
+    // indexed load of a lexically addressed binding
+    Value &v = enclosing(depth, e)->slots()[slot];
+    if (boxed) return static_cast<Box *>(v.get())->v;
+    return v;
+}
+
+Value ClosureVar::eval(Assoc &e) {
+    // free variable copied into the running procedure
+    Value &v = static_cast<Procedure *>(enclosing(depth, e)->slots()[slot].get())->captured[captured];
+    if (boxed) return static_cast<Box *>(v.get())->v;
+    return v;
+}
+
+Value GlobalVar::eval(Assoc &e) {
+    if (slot->get() == nullptr) return primitiveVar(x);
+    return *slot;
+}
+
+Value PrimitiveVar::eval(Assoc &e) {
+    if (slot->get() != nullptr) return *slot;
+    if (proc == nullptr) throw(RuntimeError("Undefined Var" + *x));
+    return *proc;
+}
+
+Value InvalidVar::eval(Assoc &e) {
+    throw(RuntimeError("Invalid variable name"));
+}
+
+Value distribute(Rational &ans) {
+    int temp = std::__gcd(ans.denominator, ans.numerator);
+    ans.denominator /= temp;
+    ans.numerator /= temp;
+    if (ans.denominator < 0) {
+        ans.denominator = -ans.denominator;
+        ans.numerator = -ans.numerator;
+    }
+    if (ans.denominator == 0)throw(RuntimeError("Unknown Error"));
+    if (ans.denominator == 1)return IntegerV(ans.numerator);
+    else return RationalV(ans.numerator, ans.denominator);
+}
+
+bool IS_DIGIT(const Value &rand1) {
+    return (rand1.type() == V_INT || rand1.type() == V_RATIONAL);
+}
+
+Value Plus::evalRator(const Value &rand1, const Value &rand2) {
+    // +
+    //TODO: To complete the addition logic
+    if (IS_DIGIT(rand1) && IS_DIGIT(rand2)) {
+        Rational sum(1, 1);
+        if (rand1.type() == V_INT)sum.numerator = rand1.fixnum();
+        else if (rand1.type() == V_RATIONAL) {
+            sum.numerator = static_cast<Rational *>(rand1.get())->numerator;
+            sum.denominator = static_cast<Rational *>(rand1.get())->denominator;
+        }
+        if (rand2.type() == V_INT)sum.numerator += rand2.fixnum() * sum.denominator;
+        else if (rand2.type() == V_RATIONAL) {
+            Rational temp_RA(static_cast<Rational *>(rand2.get())->numerator,
+                             static_cast<Rational *>(rand2.get())->denominator);
+            sum.numerator = temp_RA.numerator * sum.denominator + temp_RA.denominator * sum.numerator;
+            sum.denominator = temp_RA.denominator * sum.denominator;
+        }
+        return distribute(sum);
+    }
+    throw(RuntimeError("Wrong typename in Pl"));
+}
+
+Value Plus::fixnumRator(int a, int b) {
+    return IntegerV(a + b);
+}
+
+Value AddImm::add(const Value &x) {
+    if (x.type() == V_INT) return IntegerV(x.fixnum() + k);
+    return evalRator(x, IntegerV(k));
+}
+
+Value AddImm::eval(Assoc &e) {
+    return add(rand1->eval(e));
+}
+
+Value Minus::evalRator(const Value &rand1, const Value &rand2) {
+    // -
+    //TODO: To complete the substraction logic
+    if (IS_DIGIT(rand1) && IS_DIGIT(rand2)) {
+        Rational difference(1, 1);
+        if (rand1.type() == V_INT)difference.numerator = rand1.fixnum();
+        else if (rand1.type() == V_RATIONAL) {
+            difference.numerator = static_cast<Rational *>(rand1.get())->numerator;
+            difference.denominator = static_cast<Rational *>(rand1.get())->denominator;
+        }
+        if (rand2.type() == V_INT)
+            difference.numerator -= rand2.fixnum() * difference.
+                    denominator;
+        else if (rand2.type() == V_RATIONAL) {
+            Rational temp_RA(static_cast<Rational *>(rand2.get())->numerator,
+                             static_cast<Rational *>(rand2.get())->denominator);
+            difference.numerator = temp_RA.denominator * difference.numerator - temp_RA.numerator * difference.
+                                   denominator;
+            difference.denominator = temp_RA.denominator * difference.denominator;
+        }
+        return distribute(difference);
+    }
+    throw(RuntimeError("Wrong typename in Mi"));
+}
+
+Value Minus::fixnumRator(int a, int b) {
+    return IntegerV(a - b);
+}
+
+Value Mult::evalRator(const Value &rand1, const Value &rand2) {
+    // *
+    //TODO: To complete the Multiplication logic
+    if (IS_DIGIT(rand1) && IS_DIGIT(rand2)) {
+        Rational multi(1, 1);
+        if (rand1.type() == V_INT)multi.numerator = rand1.fixnum();
+        else if (rand1.type() == V_RATIONAL) {
+            multi.numerator = static_cast<Rational *>(rand1.get())->numerator;
+            multi.denominator = static_cast<Rational *>(rand1.get())->denominator;
+        }
+        if (rand2.type() == V_INT)multi.numerator *= rand2.fixnum();
+        else if (rand2.type() == V_RATIONAL) {
+            Rational temp_RA(static_cast<Rational *>(rand2.get())->numerator,
+                             static_cast<Rational *>(rand2.get())->denominator);
+            multi.numerator *= temp_RA.numerator;
+            multi.denominator *= temp_RA.denominator;
+        }
+        return distribute(multi);
+    }
+    throw(RuntimeError("Wrong typename in Mul"));
+}
+
+Value Mult::fixnumRator(int a, int b) {
+    return IntegerV(a * b);
+}
+
+Value Div::evalRator(const Value &rand1, const Value &rand2) {
+    // /
+    //TODO: To complete the dicision logic
+    if (IS_DIGIT(rand1) && IS_DIGIT(rand2)) {
+        Rational div(1, 1);
+        if (rand1.type() == V_INT)div.numerator = rand1.fixnum();
+        else if (rand1.type() == V_RATIONAL) {
+            div.numerator = static_cast<Rational *>(rand1.get())->numerator;
+            div.denominator = static_cast<Rational *>(rand1.get())->denominator;
+        }
+        if (rand2.type() == V_INT) {
+            if (rand2.fixnum() != 0)div.denominator *= rand2.fixnum();
+            else throw(RuntimeError("Division by zero"));
+        } else if (rand2.type() == V_RATIONAL) {
+            Rational temp_RA(static_cast<Rational *>(rand2.get())->numerator,
+                             static_cast<Rational *>(rand2.get())->denominator);
+            if (temp_RA.numerator == 0)throw(RuntimeError("Division by zero"));
+            div.denominator *= temp_RA.numerator;
+            div.numerator *= temp_RA.denominator;
+        }
+        return distribute(div);
+    }
+    throw(RuntimeError("Wrong typename in Div"));
+}
+
+Value Modulo::evalRator(const Value &rand1, const Value &rand2) {
+    // modulo
+    if (rand1.type() == V_INT && rand2.type() == V_INT) {
+        int dividend = rand1.fixnum();
+        int divisor = rand2.fixnum();
+        if (divisor == 0) {
+            throw(RuntimeError("Division by zero"));
+        }
+        return IntegerV(dividend % divisor);
+    }
+    throw(RuntimeError("modulo is only defined for integers"));
+}
+
+Value PlusVar::evalRator(const std::vector<Value> &args) {
+    // + with multiple args
+    if (args.empty())throw(RuntimeError("No parameter"));
+    for (int i = 0; i < args.size(); i++)if (!IS_DIGIT(args[i]))throw(RuntimeError("Wrong typename"));
+    Rational sum(0, 1);
+    if (args[0].type() == V_INT)sum.numerator = args[0].fixnum();
+    else if (args[0].type() == V_RATIONAL) {
+        sum.numerator = static_cast<Rational *>(args[0].get())->numerator;
+        sum.denominator = static_cast<Rational *>(args[0].get())->denominator;
+    }
+    for (int i = 1; i < args.size(); i++) {
+        if (IS_DIGIT(args[i])) {
+            if (args[i].type() == V_INT)sum.numerator += args[i].fixnum() * sum.denominator;
+            else if (args[i].type() == V_RATIONAL) {
+                Rational temp_RA(static_cast<Rational *>(args[i].get())->numerator,
+                                 static_cast<Rational *>(args[i].get())->denominator);
+                sum.numerator = temp_RA.numerator * sum.denominator + temp_RA.denominator * sum.numerator;
+                sum.denominator = temp_RA.denominator * sum.denominator;
+            }
+            int temp = std::__gcd(sum.denominator, sum.numerator);
+            sum.denominator /= temp;
+            sum.numerator /= temp;
+            if (sum.denominator < 0) {
+                sum.denominator = -sum.denominator;
+                sum.numerator = -sum.numerator;
+            }
+        } else throw(RuntimeError("Wrong typename"));
+    }
+    return distribute(sum);
+}
+
+Value MinusVar::evalRator(const std::vector<Value> &args) {
+    // - with multiple args
+    if (args.empty())throw(RuntimeError("No parameter"));
+    for (int i = 0; i < args.size(); i++)if (!IS_DIGIT(args[i]))throw(RuntimeError("Wrong typename"));
+    Rational difference(0, 1);
+    if (args[0].type() == V_INT)difference.numerator = args[0].fixnum();
+    else if (args[0].type() == V_RATIONAL) {
+        difference.numerator = static_cast<Rational *>(args[0].get())->numerator;
+        difference.denominator = static_cast<Rational *>(args[0].get())->denominator;
+    }
+    for (int i = 1; i < args.size(); i++) {
+        if (IS_DIGIT(args[i])) {
+            if (args[i].type() == V_INT)
+                difference.numerator -= args[i].fixnum() * difference.
+                        denominator;
+            else if (args[i].type() == V_RATIONAL) {
+                Rational temp_RA(static_cast<Rational *>(args[i].get())->numerator,
+                                 static_cast<Rational *>(args[i].get())->denominator);
+                difference.numerator = temp_RA.denominator * difference.numerator - temp_RA.numerator * difference.
+                                       denominator;
+                difference.denominator = temp_RA.denominator * difference.denominator;
+            }
+            int temp = std::__gcd(difference.denominator, difference.numerator);
+            difference.denominator /= temp;
+            difference.numerator /= temp;
+            if (difference.denominator < 0) {
+                difference.denominator = -difference.denominator;
+                difference.numerator = -difference.numerator;
+            }
+        } else throw(RuntimeError("Wrong typename"));
+    }
+    return distribute(difference);
+    //TODO: To complete the substraction logic
+}
+
+Value MultVar::evalRator(const std::vector<Value> &args) {
+    // * with multiple args
+    if (args.empty())throw(RuntimeError("No parameter"));
+    for (int i = 0; i < args.size(); i++)if (!IS_DIGIT(args[i]))throw(RuntimeError("Wrong typename"));
+    Rational mul(0, 1);
+    if (args[0].type() == V_INT)mul.numerator = args[0].fixnum();
+    else if (args[0].type() == V_RATIONAL) {
+        mul.numerator = static_cast<Rational *>(args[0].get())->numerator;
+        mul.denominator = static_cast<Rational *>(args[0].get())->denominator;
+    }
+    for (int i = 1; i < args.size(); i++) {
+        if (args[i].type() == V_INT)mul.numerator *= args[i].fixnum();
+        else if (args[i].type() == V_RATIONAL) {
+            Rational temp_RA(static_cast<Rational *>(args[i].get())->numerator,
+                             static_cast<Rational *>(args[i].get())->denominator);
+            mul.numerator *= temp_RA.numerator;
+            mul.denominator *= temp_RA.denominator;
+        }
+        int temp = std::__gcd(mul.denominator, mul.numerator);
+        mul.denominator /= temp;
+        mul.numerator /= temp;
+        if (mul.denominator < 0) {
+            mul.denominator = -mul.denominator;
+            mul.numerator = -mul.numerator;
+        }
+    }
+    return distribute(mul);
+}
+
+Value DivVar::evalRator(const std::vector<Value> &args) {
+    // / with multiple args
+    //TODO: To complete the divisor logic
+    if (args.empty())throw(RuntimeError("No parameter"));
+    for (int i = 0; i < args.size(); i++)if (!IS_DIGIT(args[i]))throw(RuntimeError("Wrong typename"));
+    Rational div(0, 1);
+    if (args[0].type() == V_INT)div.numerator = args[0].fixnum();
+    else if (args[0].type() == V_RATIONAL) {
+        div.numerator = static_cast<Rational *>(args[0].get())->numerator;
+        div.denominator = static_cast<Rational *>(args[0].get())->denominator;
+    }
+    for (int i = 1; i < args.size(); i++) {
+        if (args[i].type() == V_INT)div.denominator *= args[i].fixnum();
+        else if (args[i].type() == V_RATIONAL) {
+            Rational temp_RA(static_cast<Rational *>(args[i].get())->numerator,
+                             static_cast<Rational *>(args[i].get())->denominator);
+            div.numerator *= temp_RA.denominator;
+            div.denominator *= temp_RA.numerator;
+        }
+        int temp = std::__gcd(div.denominator, div.numerator);
+        div.denominator /= temp;
+        div.numerator /= temp;
+        if (div.denominator < 0) {
+            div.denominator = -div.denominator;
+            div.numerator = -div.numerator;
+        }
+    }
+    return distribute(div);
+}
+
+Value Expt::evalRator(const Value &rand1, const Value &rand2) {
+    // expt
+    if (rand1.type() == V_INT && rand2.type() == V_INT) {
+        int base = rand1.fixnum();
+        int exponent = rand2.fixnum();
+
+        if (exponent < 0) {
+            throw(RuntimeError("Negative exponent not supported for integers"));
+        }
+        if (base == 0 && exponent == 0) {
+            throw(RuntimeError("0^0 is undefined"));
+        }
+
+        int result = 1;
+        int b = base;
+        int exp = exponent;
+
+        while (exp > 0) {
+            if (exp % 2 == 1) {
+                result *= b;
+                if (result > INT_MAX || result < INT_MIN) {
+                    throw(RuntimeError("Integer overflow in expt"));
+                }
+            }
+            b *= b;
+            if (b > INT_MAX || b < INT_MIN) {
+                if (exp > 1) {
+                    throw(RuntimeError("Integer overflow in expt"));
+                }
+            }
+            exp /= 2;
+        }
+
+        return IntegerV(result);
+    }
+    throw(RuntimeError("Wrong typename"));
+}
+
+//A FUNCTION TO SIMPLIFY THE COMPARISON WITH INTEGER AND RATIONAL NUMBER
+int compareNumericValues(const Value &v1, const Value &v2) {
+    if (v1.type() == V_INT && v2.type() == V_INT) {
+        int n1 = v1.fixnum();
+        int n2 = v2.fixnum();
+        return (n1 < n2) ? -1 : (n1 > n2) ? 1 : 0;
+    } else if (v1.type() == V_RATIONAL && v2.type() == V_INT) {
+        Rational *r1 = static_cast<Rational *>(v1.get());
+        int n2 = v2.fixnum();
+        int left = r1->numerator;
+        int right = n2 * r1->denominator;
+        return (left < right) ? -1 : (left > right) ? 1 : 0;
+    } else if (v1.type() == V_INT && v2.type() == V_RATIONAL) {
+        int n1 = v1.fixnum();
+        Rational *r2 = static_cast<Rational *>(v2.get());
+        int left = n1 * r2->denominator;
+        int right = r2->numerator;
+        return (left < right) ? -1 : (left > right) ? 1 : 0;
+    } else if (v1.type() == V_RATIONAL && v2.type() == V_RATIONAL) {
+        Rational *r1 = static_cast<Rational *>(v1.get());
+        Rational *r2 = static_cast<Rational *>(v2.get());
+        int left = r1->numerator * r2->denominator;
+        int right = r2->numerator * r1->denominator;
+        return (left < right) ? -1 : (left > right) ? 1 : 0;
+    }
+    throw RuntimeError("Wrong typename in numeric comparison");
+}
+
+Value Less::evalRator(const Value &rand1, const Value &rand2) {
+    // <
+    //TODO: To complete the less logic
+    if ((rand1.type() == V_INT || rand1.type() == V_RATIONAL) && (
+            rand2.type() == V_INT || rand2.type() == V_RATIONAL)) {
+        return BooleanV(compareNumericValues(rand1, rand2) == -1);
+    }
+    throw(RuntimeError("Wrong typename in less"));
+}
+
+Value Less::fixnumRator(int a, int b) {
+    return BooleanV(a < b);
+}
+
+bool Less::fixnumTest(int a, int b) {
+    return a < b;
+}
+
+Value LessEq::evalRator(const Value &rand1, const Value &rand2) {
+    // <=
+    //TODO: To complete the lesseq logic
+    if ((rand1.type() == V_INT || rand1.type() == V_RATIONAL) && (
+            rand2.type() == V_INT || rand2.type() == V_RATIONAL)) {
+        return BooleanV(compareNumericValues(rand1, rand2) != 1);
+    }
+    throw(RuntimeError("Wrong typename in lessEq"));
+}
+
+Value LessEq::fixnumRator(int a, int b) {
+    return BooleanV(a <= b);
+}
+
+bool LessEq::fixnumTest(int a, int b) {
+    return a <= b;
+}
+
+Value Equal::evalRator(const Value &rand1, const Value &rand2) {
+    // =
+    //TODO: To complete the equal logic
+    if ((rand1.type() == V_INT || rand1.type() == V_RATIONAL) && (
+            rand2.type() == V_INT || rand2.type() == V_RATIONAL)) {
+        return BooleanV(compareNumericValues(rand1, rand2) == 0);
+    }
+    throw(RuntimeError("Wrong typename in Eq"));
+}
+
+Value Equal::fixnumRator(int a, int b) {
+    return BooleanV(a == b);
+}
+
+bool Equal::fixnumTest(int a, int b) {
+    return a == b;
+}
+
+Value GreaterEq::evalRator(const Value &rand1, const Value &rand2) {
+    // >=
+    //TODO: To complete the greatereq logic
+    if ((rand1.type() == V_INT || rand1.type() == V_RATIONAL) && (
+            rand2.type() == V_INT || rand2.type() == V_RATIONAL)) {
+        return BooleanV(compareNumericValues(rand1, rand2) != -1);
+    }
+    throw(RuntimeError("Wrong typename in Ge"));
+}
+
+Value GreaterEq::fixnumRator(int a, int b) {
+    return BooleanV(a >= b);
+}
+
+bool GreaterEq::fixnumTest(int a, int b) {
+    return a >= b;
+}
+
+Value Greater::evalRator(const Value &rand1, const Value &rand2) {
+    // >
+    //TODO: To complete the greater logic
+    if ((rand1.type() == V_INT || rand1.type() == V_RATIONAL) && (
+            rand2.type() == V_INT || rand2.type() == V_RATIONAL)) {
+        return BooleanV(compareNumericValues(rand1, rand2) == 1);
+    }
+    throw(RuntimeError("Wrong typename in Gr"));
+}
+
+Value Greater::fixnumRator(int a, int b) {
+    return BooleanV(a > b);
+}
+
+bool Greater::fixnumTest(int a, int b) {
+    return a > b;
+}
+
+Value LessVar::evalRator(const std::vector<Value> &args) {
+    // < with multiple args
+    //TODO: To complete the less logic
+    if (args.empty())throw(RuntimeError("No parameter"));
+    for (int i = 0; i < args.size(); i++)
+        if (args[i].type() != V_INT && args[i].type() != V_RATIONAL)
+            throw(
+                RuntimeError("Wrong typename in LsV"));
+    for (int i = 1; i < args.size(); i++)if (compareNumericValues(args[i - 1], args[i]) != -1)return BooleanV(false);
+    return BooleanV(true);
+}
+
+Value LessEqVar::evalRator(const std::vector<Value> &args) {
+    // <= with multiple args
+    //TODO: To complete the lesseq logic
+    if (args.empty())throw(RuntimeError("No parameter"));
+    for (int i = 0; i < args.size(); i++)
+        if (args[i].type() != V_INT && args[i].type() != V_RATIONAL)
+            throw(
+                RuntimeError("Wrong typename in LeV"));
+    for (int i = 1; i < args.size(); i++)if (compareNumericValues(args[i - 1], args[i]) == 1)return BooleanV(false);
+    return BooleanV(true);
+}
+
+Value EqualVar::evalRator(const std::vector<Value> &args) {
+    // = with multiple args
+    //TODO: To complete the equal logic
+    if (args.empty())throw(RuntimeError("No parameter"));
+    for (int i = 0; i < args.size(); i++)
+        if (args[i].type() != V_INT && args[i].type() != V_RATIONAL)
+            throw(
+                RuntimeError("Wrong typename in EqV"));
+    for (int i = 1; i < args.size(); i++)if (compareNumericValues(args[i - 1], args[i]) != 0)return BooleanV(false);
+    return BooleanV(true);
+}
+
+Value GreaterEqVar::evalRator(const std::vector<Value> &args) {
+    // >= with multiple args
+    //TODO: To complete the greatereq logic
+    if (args.empty())throw(RuntimeError("No parameter"));
+    for (int i = 0; i < args.size(); i++)
+        if (args[i].type() != V_INT && args[i].type() != V_RATIONAL)
+            throw(
+                RuntimeError("Wrong typename in GeV"));
+    for (int i = 1; i < args.size(); i++)if (compareNumericValues(args[i - 1], args[i]) == -1)return BooleanV(false);
+    return BooleanV(true);
+}
+
+Value GreaterVar::evalRator(const std::vector<Value> &args) {
+    // > with multiple args
+    //TODO: To complete the greater logic
+    if (args.empty())throw(RuntimeError("No parameter"));
+    for (int i = 0; i < args.size(); i++)
+        if (args[i].type() != V_INT && args[i].type() != V_RATIONAL)
+            throw(
+                RuntimeError("Wrong typename in GrV"));
+    for (int i = 1; i < args.size(); i++)if (compareNumericValues(args[i - 1], args[i]) != 1)return BooleanV(false);
+    return BooleanV(true);
+}
+
+Value Cons::evalRator(const Value &rand1, const Value &rand2) {
+    // cons
+    //TODO: To complete the cons logic
+    return PairV(rand1, rand2);
+}
+
+Value ListFunc::evalRator(const std::vector<Value> &args) {
+    // list function
+    //TODO: To complete the list logic
+    if (args.empty())return NullV();
+    Value temp = PairV(args[args.size() - 1], NullV());
+    for (int i = args.size() - 1; i >= 1; i--)temp = PairV(args[i - 1], temp);
+    return temp;
+    throw(RuntimeError("Unable to build a list"));
+}
+
+Value IsList::evalRator(const Value &rand) {
+    // list?
+    //TODO: To complete the list? logic
+    if (rand.type() == V_PAIR) {
+        if (static_cast<Pair *>(rand.get())->car.type() == V_PAIR || static_cast<Pair *>(rand.get())->cdr.type() ==
+            V_PAIR)
+            return BooleanV(true);
+    }
+    return BooleanV(false);
+}
+
+Value Car::evalRator(const Value &rand) {
+    // car
+    //TODO: To complete the car logic
+    if (rand.type() == V_PAIR)return static_cast<Pair *>(rand.get())->car;
+    throw(RuntimeError("Not a pair for Car"));
+}
+
+Value Cdr::evalRator(const Value &rand) {
+    // cdr
+    //TODO: To complete the cdr logic
+    if (rand.type() == V_PAIR)return static_cast<Pair *>(rand.get())->cdr;
+    throw(RuntimeError("Not a pair for Cdr"));
+}
+
+Value Cadr::evalRator(const Value &rand) {
+    // car of cdr
+    if (rand.type() != V_PAIR) throw(RuntimeError("Not a pair for Cdr"));
+    const Value &rest = static_cast<Pair *>(rand.get())->cdr;
+    if (rest.type() != V_PAIR) throw(RuntimeError("Not a pair for Car"));
+    return static_cast<Pair *>(rest.get())->car;
+}
+
+Value SetCar::evalRator(const Value &rand1, const Value &rand2) {
+    // set-car!
+    //TODO: To complete the set-car! logic
+    if (rand1.type() == V_PAIR) {
+        static_cast<Pair *>(rand1.get())->car = rand2;
+        return VoidV();
+    }
+    throw(RuntimeError("Not a Pair"));
+}
+
+Value SetCdr::evalRator(const Value &rand1, const Value &rand2) {
+    // set-cdr!
+    //TODO: To complete the set-cdr! logic
+    if (rand1.type() == V_PAIR) {
+        static_cast<Pair *>(rand1.get())->cdr = rand2;
+        return VoidV();
+    }
+    throw(RuntimeError("Not a Pair"));
+}
+
+Value IsEq::evalRator(const Value &rand1, const Value &rand2) {
+    // eq?
+    // 检查类型是否为 Integer
+    if (rand1.type() == V_INT && rand2.type() == V_INT) {
+        return BooleanV((rand1.fixnum()) == (rand2.fixnum()));
+    }
+    // 检查类型是否为 Boolean
+    else if (rand1.type() == V_BOOL && rand2.type() == V_BOOL) {
+        return BooleanV(rand1 == rand2);
+    }
+    // 检查类型是否为 Symbol
+    else if (rand1.type() == V_SYM && rand2.type() == V_SYM) {
+        return BooleanV((static_cast<Symbol *>(rand1.get())->s) == (static_cast<Symbol *>(rand2.get())->s));
+    }
+    // 检查类型是否为 Null 或 Void
+    else if ((rand1.type() == V_NULL && rand2.type() == V_NULL) ||
+             (rand1.type() == V_VOID && rand2.type() == V_VOID)) {
+        return BooleanV(true);
+    } else {
+        return BooleanV(rand1.get() == rand2.get());
+    }
+}
+
+Value IsBoolean::evalRator(const Value &rand) {
+    // boolean?
+    return BooleanV(rand.type() == V_BOOL);
+}
+
+Value IsFixnum::evalRator(const Value &rand) {
+    // number?
+    return BooleanV(rand.type() == V_INT);
+}
+
+Value IsNull::evalRator(const Value &rand) {
+    // null?
+    return BooleanV(rand.type() == V_NULL);
+}
+
+bool IsNull::test(Assoc &e) {
+    return rand->eval(e).type() == V_NULL;
+}
+
+Value IsPair::evalRator(const Value &rand) {
+    // pair?
+    return BooleanV(rand.type() == V_PAIR);
+}
+
+Value IsProcedure::evalRator(const Value &rand) {
+    // procedure?
+    return BooleanV(rand.type() == V_PROC || rand.type() == V_PRIM || rand.type() == V_CONT);
+}
+
+Value IsSymbol::evalRator(const Value &rand) {
+    // symbol?
+    return BooleanV(rand.type() == V_SYM);
+}
+
+Value IsString::evalRator(const Value &rand) {
+    // string?
+    return BooleanV(rand.type() == V_STRING);
+}
+
+Value Begin::eval(Assoc &e) {
+    return evalFull(this, e);
+}
+
+Assoc Begin::open(Assoc &e) {
+    if (defs.empty()) return e;
+    // internal defines get fresh bindings, filled in by Define::eval
+    Assoc temp_e = frame(defs.size(), e);
+    for (int i = 0; i < defs.size(); i++) temp_e->slots()[i] = boxed[i] ? BoxV(NullV()) : NullV();
+    return temp_e;
+}
+
+Value Begin::evalTail(Assoc &e, TailCall &tc) {
+    if (es.empty()) return VoidV();
+    Assoc temp_e = open(e);
+    for (int i = 0; i + 1 < es.size(); i++) es[i]->eval(temp_e);
+    return es.back()->evalTail(temp_e, tc);
+}
+
+Value Syntaxtransit(const Syntax s, Assoc &e) {
+    static const Sym dot_sym = intern(".");
+    switch (s->s_type) {
+        case S_LIST: {
+            List *temp_sy = static_cast<List *>(s.get());
+            if (temp_sy->stxs.empty()) return NullV();
+            int len = temp_sy->stxs.size();
+            if (len == 3 && asSymbol(temp_sy->stxs[1]) && asSymbol(temp_sy->stxs[1])->s == dot_sym) {
+                Value car = Syntaxtransit(temp_sy->stxs[0], e);
+                Value cdr = Syntaxtransit(temp_sy->stxs[2], e);
+                return PairV(car, cdr);
+            }
+            for (int i = 0; i < len; i++) {
+                SymbolSyntax *dot = asSymbol(temp_sy->stxs[i]);
+                if (dot && dot->s == dot_sym) {
+                    if (i == 0 || i == temp_sy->stxs.size() - 1)throw RuntimeError("RuntimeError");
+                    Value car = NullV();
+                    for (int j = i - 1; j >= 0; j--) {
+                        Value elem = Syntaxtransit(temp_sy->stxs[j], e);
+                        car = PairV(elem, car);
+                    }
+                    Value cdr = Syntaxtransit(temp_sy->stxs[i + 1], e);
+                    Value cu = car;
+                    while (cu.type() == V_PAIR) {
+                        Pair *temp_pair = static_cast<Pair *>(cu.get());
+                        if (temp_pair->cdr.type() == V_NULL) {
+                            temp_pair->cdr = cdr;
+                            return car;
+                        }
+                        cu = temp_pair->cdr;
+                    }
+                    return car;
+                }
+            }
+            Value result = NullV();
+            for (int i = temp_sy->stxs.size() - 1; i >= 0; i--) {
+                Value element = Syntaxtransit(temp_sy->stxs[i], e);
+                result = PairV(element, result);
+            }
+            return result;
+        }
+        case S_STRING:
+            return StringV(static_cast<StringSyntax *>(s.get())->s);
+        case S_RATIONAL:
+            return RationalV(static_cast<RationalSyntax *>(s.get())->numerator,
+                             static_cast<RationalSyntax *>(s.get())->denominator);
+        case S_NUMBER:
+            return IntegerV(static_cast<Number *>(s.get())->n);
+        case S_FALSE:
+            return BooleanV(false);
+        case S_TRUE:
+            return BooleanV(true);
+        case S_SYMBOL:
+            return SymbolV(static_cast<SymbolSyntax *>(s.get())->s);
+    }
+    throw(RuntimeError("Wrong in Quote"));
+}
+
+Value Quote::eval(Assoc &e) {
+    return Syntaxtransit(s, e);
+    //TODO: To complete the quote logic
+}
+
+Value AndVar::eval(Assoc &e) {
+    return evalFull(this, e);
+}
+
+// and with short-circuit evaluation; the value of the last operand is the
+// result whatever it is, so that operand is in tail position
+Value AndVar::evalTail(Assoc &e, TailCall &tc) {
+    if (rands.empty()) return BooleanV(true);
+    for (int i = 0; i + 1 < rands.size(); i++) {
+        Value temp = rands[i]->eval(e);
+        if (temp.type() != V_BOOL)continue;
+        if (temp.isFalse())return BooleanV(false);
+    }
+    return rands.back()->evalTail(e, tc);
+}
+
+Value OrVar::eval(Assoc &e) {
+    return evalFull(this, e);
+}
+
+// or with short-circuit evaluation, last operand in tail position as for and
+Value OrVar::evalTail(Assoc &e, TailCall &tc) {
+    if (rands.empty()) return BooleanV(false);
+    for (int i = 0; i + 1 < rands.size(); i++) {
+        Value temp = rands[i]->eval(e);
+        if (temp.type() != V_BOOL)return temp;
+        if (!temp.isFalse())return BooleanV(true);
+    }
+    return rands.back()->evalTail(e, tc);
+}
+
+Value Not::evalRator(const Value &rand) {
+    // not
+    if (rand.type() == V_BOOL)return BooleanV(rand.isFalse());
+    if (rand.type() != V_BOOL)return BooleanV(false);
+    throw(RuntimeError("Wrong in Not"));
+    //TODO: To complete the not logic
+}
+
+bool Not::test(Assoc &e) {
+    return !rand->test(e);
+}
+
+ExprBase *If::select(Assoc &e) {
+    return cond->test(e) ? conseq.get() : alter.get();
+}
+
+Value If::eval(Assoc &e) {
+    return select(e)->eval(e);
+}
+
+Value If::evalTail(Assoc &e, TailCall &tc) {
+    return select(e)->evalTail(e, tc);
+}
+
+ExprBase *Cond::select(Assoc &env, Value &test) {
+    for (int i = 0; i < clauses.size(); i++) {
+        if (clauses[i].empty())throw(RuntimeError("No predict?"));
+        if (clauses[i].size() == 1) {
+            // a clause without body has the value of its test
+            test = clauses[i][0]->eval(env);
+            if (!test.isFalse())return nullptr;
+            continue;
+        }
+        if (clauses[i][0]->test(env)) {
+            for (int j = 1; j < clauses[i].size() - 1; j++) {
+                clauses[i][j]->eval(env);
+            }
+            return clauses[i][clauses[i].size() - 1].get();
+        }
+    }
+    throw(RuntimeError("Wrong in Cond"));
+}
+
+Value Cond::eval(Assoc &env) {
+    Value test(nullptr);
+    ExprBase *last = select(env, test);
+    return last == nullptr ? test : last->eval(env);
+}
+
+Value Cond::evalTail(Assoc &env, TailCall &tc) {
+    Value test(nullptr);
+    ExprBase *last = select(env, test);
+    return last == nullptr ? test : last->evalTail(env, tc);
+}
+
+Value Lambda::eval(Assoc &env) {
+    std::vector<Value> values;
+    values.reserve(captures.size());
+    for (const Address &a : captures) values.push_back(locate(a, env));
+    return ProcedureV(Expr(shared_from_this()), std::move(values));
+    //TODO: To complete the lambda logic
+}
+
+// Builds the frame of a call to a procedure whose arity is known to match rand
+static Assoc callFrame(Lambda *lam, const Value &proc, const std::vector<Expr> &rand, Assoc &e) {
+    // arguments go straight into the callee's frame, followed by the
+    // procedure itself for ClosureVar
+    int n = lam->x.size();
+    Assoc param_env = frame(n + 1, empty());
+    Value *slots = param_env->slots();
+    for (int i = 0; i < n; i++) {
+        slots[i] = rand[i]->eval(e);
+        if (lam->boxed[i]) slots[i] = BoxV(slots[i]);
+    }
+    slots[n] = proc;
+    return param_env;
+}
+
+/**
+ * @brief Counts a call of lam for ENGINE_TIERED, and tells whether its
+ * body now runs on the VM
+ *
+ * Tail calls count as loop iterations, loops being written as tail
+ * recursion. Once called often enough in either way, a procedure is
+ * promoted for good; the VM then compiles it to bytecode, and to native
+ * code if the JIT is on and it keeps being called.
+ */
+static bool promoted(Lambda *lam, bool tail) {
+    if (lam->promoted) return true;
+    if (tail) lam->loops++;
+    else lam->calls++;
+    if (lam->calls + lam->loops < options.tier_threshold) return false;
+    lam->promoted = true;
+    if (options.tier_log)
+        std::cerr << "tier: " << lam->label() << " moved to the vm after " << lam->calls << " calls and "
+                  << lam->loops << " loop iterations" << std::endl;
+    return true;
+}
+
+ExprBase *Apply::enter(Assoc &e, Assoc &frame, Value &result, bool tail) {
+    // inline cache: the global callee has not been replaced since it was
+    // last checked here
+    if (cached != nullptr && cache_version == global_env.version) {
+        Value proc = *static_cast<GlobalVar *>(rator.get())->slot;
+        frame = callFrame(cached, proc, rand, e);
+        if (options.engine == ENGINE_TIERED && promoted(cached, tail)) {
+            result = callVM(cached, frame);
+            return nullptr;
+        }
+        return cached->e.get();
+    }
+    Value proc = rator->eval(e);
+    if (proc.get() == nullptr || (proc.type() != V_PROC && proc.type() != V_PRIM && proc.type() != V_CONT)) {
+        throw RuntimeError("Attempt to apply a non-procedure");
+    }
+
+    if (proc.type() == V_PROC) {
+        Lambda *lam = static_cast<Procedure *>(proc.get())->lambda();
+        if (rand.size() == lam->x.size()) {
+            if (rator->e_type == E_GLOBALVAR) {
+                cached = lam;
+                cache_version = global_env.version;
+            }
+            frame = callFrame(lam, proc, rand, e);
+            if (options.engine == ENGINE_TIERED && promoted(lam, tail)) {
+                result = callVM(lam, frame);
+                return nullptr;
+            }
+            return lam->e.get();
+        }
+    }
+    // Argument evaluation
+    std::vector<Value> args;
+    for (Expr i: rand) args.push_back(i->eval(e));
+    if (proc.type() == V_CONT && args.size() == 1) static_cast<Continuation *>(proc.get())->unwind(args[0]);
+    if (proc.type() != V_PRIM) throw RuntimeError("Wrong number of arguments");
+    result = static_cast<Primitive *>(proc.get())->call(args);
+    return nullptr;
+}
+
+Value Apply::eval(Assoc &e) {
+    Assoc frame = empty();
+    Value result(nullptr);
+    ExprBase *body = enter(e, frame, result, false);
+    if (body == nullptr) return result;
+    return run(body, frame);
+}
+
+Value Apply::evalTail(Assoc &e, TailCall &tc) {
+    Value result(nullptr);
+    tc.body = enter(e, tc.env, result, true);
+    return result;
+}
+
+bool Inline::current() const {
+    const Value &f = *slot;
+    return f.get() != nullptr && f.type() == V_PROC && static_cast<Procedure *>(f.get())->code.get() == lambda.get();
+}
+
+Value Inline::eval(Assoc &e) {
+    return (current() ? body : call)->eval(e);
+}
+
+Value Inline::evalTail(Assoc &e, TailCall &tc) {
+    return (current() ? body : call)->evalTail(e, tc);
+}
+
+void Define::prepare() {
+    if (findBuiltin(*var) != nullptr)throw(RuntimeError("Wrong defined name"));
+    if (var->empty() || (*var)[0] == '@' || (*var)[0] == '.')throw(RuntimeError("Wrong defined name"));
+    if (addr.depth < 0 && slot->get() == nullptr) *slot = NullV();
+}
+
+Value Define::store(Assoc &env, const Value &v) {
+    if (addr.depth < 0) global_env.assign(slot, v);
+    else if (boxed) static_cast<Box *>(locate(addr, env).get())->v = v;
+    else locate(addr, env) = v;
+    return NonereturnV();
+}
+
+Value Define::eval(Assoc &env) {
+    prepare();
+    return store(env, e->eval(env));
+}
+
+Value Let::eval(Assoc &env) {
+    return evalFull(this, env);
+}
+
+Value Let::evalTail(Assoc &env, TailCall &tc) {
+    Assoc param_env = frame(bind.size(), env);
+    for (int i = 0; i < bind.size(); i++) {
+        try {
+            Value temp = bind[i].second->eval(env);
+            param_env->slots()[i] = boxed[i] ? BoxV(temp) : temp;
+        } catch (const RuntimeError &e) {
+            throw(RuntimeError(e));
+        }
+    }
+    return body->evalTail(param_env, tc);
+}
+
+Value Letrec::eval(Assoc &env) {
+    return evalFull(this, env);
+}
+
+Assoc Letrec::open(Assoc &env) {
+    Assoc e = frame(bind.size(), env);
+    for (int i = 0; i < bind.size(); i++)e->slots()[i] = boxed[i] ? BoxV(NullV()) : NullV();
+    return e;
+}
+
+void Letrec::init(Assoc &e, int i, const Value &s) {
+    Value &v = e->slots()[i];
+    if (boxed[i]) static_cast<Box *>(v.get())->v = s;
+    else v = s;
+}
+
+Value Letrec::evalTail(Assoc &env, TailCall &tc) {
+    Assoc e = open(env);
+    for (int i = 0; i < bind.size(); i++) init(e, i, bind[i].second->eval(e));
+    return body->evalTail(e, tc);
+}
+
+Value Recur::eval(Assoc &env) {
+    return evalFull(this, env);
+}
+
+void Recur::rebind(Assoc &env, Value *slots, int i) {
+    // every operand is evaluated before any variable changes
+    Value v = rands[i]->eval(env);
+    if (i + 1 < rands.size()) rebind(env, slots, i + 1);
+    slots[i] = loop->boxed[i] ? BoxV(v) : std::move(v);
+}
+
+Value Recur::evalTail(Assoc &env, TailCall &tc) {
+    AssocList *f = enclosing(depth, env);
+    if (!rands.empty()) rebind(env, f->slots(), 0);
+    tc.body = loop->body.get();
+    tc.env = Assoc(f);
+    return Value(nullptr);
+}
+
+Value Set::store(Assoc &env, const Value &v) {
+    if (addr.depth < 0) global_env.assign(slot, v);
+    else if (boxed) static_cast<Box *>(locate(addr, env).get())->v = v;
+    else locate(addr, env) = v;
+    return VoidV();
+}
+
+Value Set::eval(Assoc &env) {
+    return store(env, e->eval(env));
+}
+
+Value Display::evalRator(const Value &rand) {
+    // display function
+    if (rand.type() == V_STRING) {
+        String *str_ptr = static_cast<String *>(rand.get());
+        std::cout << str_ptr->s;
+    } else {
+        rand.show(std::cout);
+    }
+
+    return VoidV();
+}
+
+Value CallEC::evalRator(const Value &rand) {
+    return callEC(rand);
+}
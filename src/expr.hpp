@@ -1,536 +1,1040 @@
-#ifndef EXPRESSION
-#define EXPRESSION
-
-/**
- * @file eclass RationalNum : public ExprBase {
-public:
-    int numerator;
-    int denominator;
-    RationalNum(int num, int den);
-    virtual Value eval(Assoc &) override;
-};p
- * @brief Expression structures for the Scheme interpreter
- * @author luke36
- * 
- * This file defines all expression types used in the Scheme interpreter.
- * Structures are organized according to ExprType enumeration order from
- * Def.hpp for consistency and maintainability.
- */
-
-#include "Def.hpp"
-#include "syntax.hpp"
-#include <memory>
-#include <cstring>
-#include <vector>
-
-struct ExprBase {
-    ExprType e_type;
-
-    ExprBase(ExprType);
-
-    virtual Value eval(Assoc &) = 0;
-
-    virtual ~ExprBase() = default;
-};
-
-class Expr {
-    std::shared_ptr<ExprBase> ptr;
-
-public:
-    Expr(ExprBase *);
-
-    ExprBase *operator->() const;
-
-    ExprBase &operator*();
-
-    ExprBase *get() const;
-};
-
-// ================================================================================
-//                             BASIC TYPES AND LITERALS
-// ================================================================================
-
-/**
- * @brief Integer literal expression
- * Represents fixed-point numbers (integers)
- */
-struct Fixnum : ExprBase {
-    int n;
-
-    Fixnum(int);
-
-    virtual Value eval(Assoc &) override;
-};
-
-/**
- * @brief Rational number literal expression
- * Represents rational numbers as numerator/denominator
- */
-struct RationalNum : ExprBase {
-    int numerator;
-    int denominator;
-
-    RationalNum(int num, int den);
-    RationalNum &operator=(const RationalNum &other){
-        this->numerator=other.numerator;
-        this->denominator=other.denominator;
-        return *this;
-    }
-    virtual Value eval(Assoc &) override;
-};
-
-/**
- * @brief String literal expression
- * Represents string values
- */
-struct StringExpr : ExprBase {
-    std::string s;
-
-    StringExpr(const std::string &);
-
-    virtual Value eval(Assoc &) override;
-};
-
-/**
- * @brief Boolean true literal
- */
-struct True : ExprBase {
-    True();
-
-    virtual Value eval(Assoc &) override;
-};
-
-/**
- * @brief Boolean false literal
- */
-struct False : ExprBase {
-    False();
-
-    virtual Value eval(Assoc &) override;
-};
-
-struct MakeVoid : ExprBase {
-    MakeVoid();
-
-    virtual Value eval(Assoc &) override;
-};
-
-struct Exit : ExprBase {
-    Exit();
-
-    virtual Value eval(Assoc &) override;
-};
-
-// ================================================================================
-//                             BASIC ABSTRACT TYPES FOR PARAMETERS
-// ================================================================================
-
-struct Unary : ExprBase {
-    Expr rand;
-
-    Unary(ExprType, const Expr &);
-
-    virtual Value evalRator(const Value &) = 0;
-
-    virtual Value eval(Assoc &) override;
-};
-
-struct Binary : ExprBase {
-    Expr rand1;
-    Expr rand2;
-
-    Binary(ExprType, const Expr &, const Expr &);
-
-    virtual Value evalRator(const Value &, const Value &) = 0;
-
-    virtual Value eval(Assoc &) override;
-};
-
-struct Variadic : ExprBase {
-    std::vector<Expr> rands;
-
-    Variadic(ExprType, const std::vector<Expr> &);
-
-    virtual Value evalRator(const std::vector<Value> &) = 0;
-
-    virtual Value eval(Assoc &) override;
-};
-
-// ================================================================================
-//                             ARITHMETIC OPERATIONS
-// ================================================================================
-
-struct Plus : Binary {
-    Plus(const Expr &, const Expr &);
-
-    virtual Value evalRator(const Value &, const Value &) override;
-};
-
-struct Minus : Binary {
-    Minus(const Expr &, const Expr &);
-
-    virtual Value evalRator(const Value &, const Value &) override;
-};
-
-struct Mult : Binary {
-    Mult(const Expr &, const Expr &);
-
-    virtual Value evalRator(const Value &, const Value &) override;
-};
-
-struct Div : Binary {
-    Div(const Expr &, const Expr &);
-
-    virtual Value evalRator(const Value &, const Value &) override;
-};
-
-struct Modulo : Binary {
-    Modulo(const Expr &, const Expr &);
-
-    virtual Value evalRator(const Value &, const Value &) override;
-};
-
-struct Expt : Binary {
-    Expt(const Expr &, const Expr &);
-
-    virtual Value evalRator(const Value &, const Value &) override;
-};
-
-struct PlusVar : Variadic {
-    PlusVar(const std::vector<Expr> &);
-
-    virtual Value evalRator(const std::vector<Value> &) override;
-};
-
-struct MinusVar : Variadic {
-    MinusVar(const std::vector<Expr> &);
-
-    virtual Value evalRator(const std::vector<Value> &) override;
-};
-
-struct MultVar : Variadic {
-    MultVar(const std::vector<Expr> &);
-
-    virtual Value evalRator(const std::vector<Value> &) override;
-};
-
-struct DivVar : Variadic {
-    DivVar(const std::vector<Expr> &);
-
-    virtual Value evalRator(const std::vector<Value> &) override;
-};
-
-// ================================================================================
-//                             COMPARISON OPERATIONS
-// ================================================================================
-
-struct Less : Binary {
-    Less(const Expr &, const Expr &);
-
-    virtual Value evalRator(const Value &, const Value &) override;
-};
-
-struct LessEq : Binary {
-    LessEq(const Expr &, const Expr &);
-
-    virtual Value evalRator(const Value &, const Value &) override;
-};
-
-struct Equal : Binary {
-    Equal(const Expr &, const Expr &);
-
-    virtual Value evalRator(const Value &, const Value &) override;
-};
-
-struct GreaterEq : Binary {
-    GreaterEq(const Expr &, const Expr &);
-
-    virtual Value evalRator(const Value &, const Value &) override;
-};
-
-struct Greater : Binary {
-    Greater(const Expr &, const Expr &);
-
-    virtual Value evalRator(const Value &, const Value &) override;
-};
-
-struct LessVar : Variadic {
-    LessVar(const std::vector<Expr> &);
-
-    virtual Value evalRator(const std::vector<Value> &) override;
-};
-
-struct LessEqVar : Variadic {
-    LessEqVar(const std::vector<Expr> &);
-
-    virtual Value evalRator(const std::vector<Value> &) override;
-};
-
-struct EqualVar : Variadic {
-    EqualVar(const std::vector<Expr> &);
-
-    virtual Value evalRator(const std::vector<Value> &) override;
-};
-
-struct GreaterEqVar : Variadic {
-    GreaterEqVar(const std::vector<Expr> &);
-
-    virtual Value evalRator(const std::vector<Value> &) override;
-};
-
-struct GreaterVar : Variadic {
-    GreaterVar(const std::vector<Expr> &);
-
-    virtual Value evalRator(const std::vector<Value> &) override;
-};
-
-// ================================================================================
-//                             LIST OPERATIONS
-// ================================================================================
-
-struct Cons : Binary {
-    Cons(const Expr &, const Expr &);
-
-    virtual Value evalRator(const Value &, const Value &) override;
-};
-
-struct Car : Unary {
-    Car(const Expr &);
-
-    virtual Value evalRator(const Value &) override;
-};
-
-struct Cdr : Unary {
-    Cdr(const Expr &);
-
-    virtual Value evalRator(const Value &) override;
-};
-
-struct ListFunc : Variadic {
-    ListFunc(const std::vector<Expr> &);
-
-    virtual Value evalRator(const std::vector<Value> &) override;
-};
-
-struct SetCar : Binary {
-    SetCar(const Expr &, const Expr &);
-
-    virtual Value evalRator(const Value &, const Value &) override;
-};
-
-struct SetCdr : Binary {
-    SetCdr(const Expr &, const Expr &);
-
-    virtual Value evalRator(const Value &, const Value &) override;
-};
-
-// ================================================================================
-//                             LOGIC OPERATIONS
-// ================================================================================
-
-struct Not : Unary {
-    Not(const Expr &);
-
-    virtual Value evalRator(const Value &) override;
-};
-
-struct AndVar : ExprBase {
-    std::vector<Expr> rands;
-
-    AndVar(const std::vector<Expr> &);
-
-    virtual Value eval(Assoc &) override;
-};
-
-struct OrVar : ExprBase {
-    std::vector<Expr> rands;
-
-    OrVar(const std::vector<Expr> &);
-
-    virtual Value eval(Assoc &) override;
-};
-
-// ================================================================================
-//                             TYPE PREDICATES
-// ================================================================================
-
-struct IsEq : Binary {
-    IsEq(const Expr &, const Expr &);
-
-    virtual Value evalRator(const Value &, const Value &) override;
-};
-
-struct IsBoolean : Unary {
-    IsBoolean(const Expr &);
-
-    virtual Value evalRator(const Value &) override;
-};
-
-struct IsFixnum : Unary {
-    IsFixnum(const Expr &);
-
-    virtual Value evalRator(const Value &) override;
-};
-
-struct IsNull : Unary {
-    IsNull(const Expr &);
-
-    virtual Value evalRator(const Value &) override;
-};
-
-struct IsPair : Unary {
-    IsPair(const Expr &);
-
-    virtual Value evalRator(const Value &) override;
-};
-
-struct IsProcedure : Unary {
-    IsProcedure(const Expr &);
-
-    virtual Value evalRator(const Value &) override;
-};
-
-struct IsSymbol : Unary {
-    IsSymbol(const Expr &);
-
-    virtual Value evalRator(const Value &) override;
-};
-
-struct IsList : Unary {
-    IsList(const Expr &);
-
-    virtual Value evalRator(const Value &) override;
-};
-
-struct IsString : Unary {
-    IsString(const Expr &);
-
-    virtual Value evalRator(const Value &) override;
-};
-
-// ================================================================================
-//                             CONTROL FLOW CONSTRUCTS
-// ================================================================================
-
-struct Begin : ExprBase {
-    std::vector<Expr> es;
-
-    Begin(const std::vector<Expr> &);
-
-    virtual Value eval(Assoc &) override;
-};
-
-struct Quote : ExprBase {
-    Syntax s;
-
-    Quote(const Syntax &);
-
-    virtual Value eval(Assoc &) override;
-};
-
-// ================================================================================
-//                             CONDITIONALS
-// ================================================================================
-
-struct If : ExprBase {
-    Expr cond;
-    Expr conseq;
-    Expr alter;
-
-    If(const Expr &, const Expr &, const Expr &);
-
-    virtual Value eval(Assoc &) override;
-};
-
-struct Cond : ExprBase {
-    std::vector<std::vector<Expr> > clauses;
-
-    Cond(const std::vector<std::vector<Expr> > &);
-
-    virtual Value eval(Assoc &) override;
-};
-
-// ================================================================================
-//                             VARIABLE AND FUNCITION DEFINITION
-// ================================================================================
-
-struct Var : ExprBase {
-    std::string x;
-
-    Var(const std::string &);
-
-    virtual Value eval(Assoc &) override;
-};
-
-struct Apply : ExprBase {
-    Expr rator;
-    std::vector<Expr> rand;
-
-    Apply(const Expr &, const std::vector<Expr> &);
-
-    virtual Value eval(Assoc &) override;
-};
-
-struct Lambda : ExprBase {
-    std::vector<std::string> x;
-    Expr e;
-
-    Lambda(const std::vector<std::string> &, const Expr &);
-
-    virtual Value eval(Assoc &) override;
-};
-
-struct Define : ExprBase {
-    std::string var;
-    Expr e;
-
-    Define(const std::string &, const Expr &);
-
-    virtual Value eval(Assoc &) override;
-};
-
-// ================================================================================
-//                             BINDING CONSTRUCTS
-// ================================================================================
-
-struct Let : ExprBase {
-    std::vector<std::pair<std::string, Expr> > bind;
-    Expr body;
-
-    Let(const std::vector<std::pair<std::string, Expr> > &, const Expr &);
-
-    virtual Value eval(Assoc &) override;
-};
-struct Letrec : ExprBase {
-    std::vector<std::pair<std::string, Expr> > bind;
-    Expr body;
-
-    Letrec(const std::vector<std::pair<std::string, Expr> > &, const Expr &);
-
-    virtual Value eval(Assoc &) override;
-};
-
-// ================================================================================
-//                             ASSIGNMENT
-// ================================================================================
-
-struct Set : ExprBase {
-    std::string var;
-    Expr e;
-
-    Set(const std::string &, const Expr &);
-
-    virtual Value eval(Assoc &) override;
-};
-
-// ================================================================================
-//                              I/O OPERATIONS
-// ================================================================================
-
-struct Display : Unary {
-    Display(const Expr &);
-
-    virtual Value evalRator(const Value &) override;
-};
-
-#endif
+#ifndef EXPRESSION
+#define EXPRESSION
+
+/**
+ * @file eclass RationalNum : public ExprBase {
+public:
+    int numerator;
+    int denominator;
+    RationalNum(int num, int den);
+    virtual Value eval(Assoc &) override;
+};p
+ * @brief Expression structures for the Scheme interpreter
+ * @author luke36
+ * 
+ * This file defines all expression types used in the Scheme interpreter.
+ * Structures are organized according to ExprType enumeration order from
+ * Def.hpp for consistency and maintainability.
+ */
+
+#include "Def.hpp"
+#include "syntax.hpp"
+#include <memory>
+#include <cstring>
+#include <vector>
+
+struct ExprBase : std::enable_shared_from_this<ExprBase> {
+    ExprType e_type;
+
+    ExprBase(ExprType);
+
+    virtual Value eval(Assoc &) = 0;
+
+    /**
+     * @brief Evaluates the expression in tail position
+     *
+     * A procedure call is not made but stored in the TailCall, for the
+     * caller to run in place of its own frame; the result is then
+     * meaningless. Other expressions just evaluate.
+     */
+    virtual Value evalTail(Assoc &, TailCall &);
+
+    /**
+     * @brief Applies the operator of a primitive node to the values of its
+     * n operands, for engines that evaluate the operands themselves
+     */
+    virtual Value applyRator(const Value *, int n);
+
+    /**
+     * @brief Evaluates the expression as the test of a conditional: true
+     * unless its value is #f. Tests that can decide without building the
+     * Boolean override it.
+     */
+    virtual bool test(Assoc &);
+
+    // Lexical addressing pass, see resolve.cpp
+    virtual void resolve(Scope *);
+
+    // Appends the direct subexpressions, for passes that walk the whole tree
+    virtual void subexprs(std::vector<Expr *> &);
+
+    virtual ~ExprBase() = default;
+};
+
+class Expr {
+    std::shared_ptr<ExprBase> ptr;
+
+public:
+    Expr(ExprBase *);
+
+    Expr(const std::shared_ptr<ExprBase> &);
+
+    ExprBase *operator->() const;
+
+    ExprBase &operator*();
+
+    ExprBase *get() const;
+};
+
+/**
+ * @brief Rewrites every variable reference of a freshly parsed expression
+ * into a lexical address. A null scope means the top level.
+ */
+void resolveExpr(Expr &, Scope *);
+
+/**
+ * @brief Folds constants and simplifies a freshly parsed top-level form,
+ * see fold.cpp
+ */
+void foldProgram(Expr &);
+
+/**
+ * @brief Inlines small global helpers and immediately applied lambdas in a
+ * folded top-level form, see inline.cpp
+ */
+void inlineProgram(Expr &);
+
+/**
+ * @brief Runs foldProgram, inlineProgram, assignment analysis and then
+ * resolveExpr on a top-level form
+ */
+void resolveProgram(Expr &);
+
+/**
+ * @brief Evaluates a resolved expression with its continuation kept on the
+ * heap, see cek.cpp
+ */
+Value evalCEK(ExprBase *, Assoc &);
+
+/**
+ * @brief Compiles a resolved expression to bytecode and runs it, see vm.cpp
+ */
+Value evalVM(ExprBase *, Assoc &);
+
+/**
+ * @brief Compiles a resolved expression to register bytecode and runs it,
+ * see regvm.cpp
+ */
+Value evalReg(ExprBase *, Assoc &);
+
+/**
+ * @brief Runs the body of a procedure on the VM, in its filled frame
+ */
+Value callVM(Lambda *, const Assoc &);
+
+/**
+ * @brief Applies a procedure to an escape continuation on the VM
+ */
+Value callEC(const Value &);
+
+/**
+ * @brief Runtime location of a local binding
+ *
+ * The binding is slot of the frame depth levels up. With captured >= 0 that
+ * slot holds the running procedure and the binding is its captured-th free
+ * variable. A depth of -1 marks a global.
+ */
+struct Address {
+    int depth;
+    int slot;
+    int captured;
+};
+
+// ================================================================================
+//                             BASIC TYPES AND LITERALS
+// ================================================================================
+
+/**
+ * @brief Integer literal expression
+ * Represents fixed-point numbers (integers)
+ */
+struct Fixnum : ExprBase {
+    int n;
+
+    Fixnum(int);
+
+    virtual Value eval(Assoc &) override;
+};
+
+/**
+ * @brief Rational number literal expression
+ * Represents rational numbers as numerator/denominator
+ */
+struct RationalNum : ExprBase {
+    int numerator;
+    int denominator;
+
+    RationalNum(int num, int den);
+    RationalNum &operator=(const RationalNum &other){
+        this->numerator=other.numerator;
+        this->denominator=other.denominator;
+        return *this;
+    }
+    virtual Value eval(Assoc &) override;
+};
+
+/**
+ * @brief String literal expression
+ * Represents string values
+ */
+struct StringExpr : ExprBase {
+    std::string s;
+
+    StringExpr(const std::string &);
+
+    virtual Value eval(Assoc &) override;
+};
+
+/**
+ * @brief Boolean true literal
+ */
+struct True : ExprBase {
+    True();
+
+    virtual Value eval(Assoc &) override;
+};
+
+/**
+ * @brief Boolean false literal
+ */
+struct False : ExprBase {
+    False();
+
+    virtual Value eval(Assoc &) override;
+};
+
+struct MakeVoid : ExprBase {
+    MakeVoid();
+
+    virtual Value eval(Assoc &) override;
+};
+
+struct Exit : ExprBase {
+    Exit();
+
+    virtual Value eval(Assoc &) override;
+};
+
+// ================================================================================
+//                             BASIC ABSTRACT TYPES FOR PARAMETERS
+// ================================================================================
+
+struct Unary : ExprBase {
+    Expr rand;
+
+    Unary(ExprType, const Expr &);
+
+    virtual Value evalRator(const Value &) = 0;
+
+    virtual Value applyRator(const Value *, int) override;
+
+    virtual Value eval(Assoc &) override;
+
+    virtual void resolve(Scope *) override;
+
+    virtual void subexprs(std::vector<Expr *> &) override;
+};
+
+/**
+ * @brief Operand types a self-specializing node has seen
+ *
+ * The node starts out FB_UNINIT and specializes to FB_FIXNUM when its first
+ * operands are fixnums. When its guard fails it falls back to FB_GENERIC
+ * for good.
+ */
+enum Feedback { FB_UNINIT, FB_FIXNUM, FB_GENERIC };
+
+struct Binary : ExprBase {
+    Expr rand1;
+    Expr rand2;
+    Value (*fixnum)(int, int); ///< Fast path for two fixnums, if the operator has one
+    bool (*compare)(int, int); ///< Same as a test, for comparisons
+    Feedback feedback;
+
+    Binary(ExprType, const Expr &, const Expr &);
+
+    virtual Value evalRator(const Value &, const Value &) = 0;
+
+    // evalRator, or fixnum as long as the operands have all been fixnums
+    Value specialized(const Value &, const Value &);
+
+    virtual Value applyRator(const Value *, int) override;
+
+    virtual Value eval(Assoc &) override;
+
+    virtual bool test(Assoc &) override;
+
+    virtual void resolve(Scope *) override;
+
+    virtual void subexprs(std::vector<Expr *> &) override;
+};
+
+struct Variadic : ExprBase {
+    std::vector<Expr> rands;
+
+    Variadic(ExprType, const std::vector<Expr> &);
+
+    virtual Value evalRator(const std::vector<Value> &) = 0;
+
+    virtual Value applyRator(const Value *, int) override;
+
+    virtual Value eval(Assoc &) override;
+
+    virtual void resolve(Scope *) override;
+
+    virtual void subexprs(std::vector<Expr *> &) override;
+};
+
+// ================================================================================
+//                             ARITHMETIC OPERATIONS
+// ================================================================================
+
+struct Plus : Binary {
+    Plus(const Expr &, const Expr &);
+
+    virtual Value evalRator(const Value &, const Value &) override;
+
+    static Value fixnumRator(int, int);
+};
+
+struct Minus : Binary {
+    Minus(const Expr &, const Expr &);
+
+    virtual Value evalRator(const Value &, const Value &) override;
+
+    static Value fixnumRator(int, int);
+};
+
+struct Mult : Binary {
+    Mult(const Expr &, const Expr &);
+
+    virtual Value evalRator(const Value &, const Value &) override;
+
+    static Value fixnumRator(int, int);
+};
+
+struct Div : Binary {
+    Div(const Expr &, const Expr &);
+
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct Modulo : Binary {
+    Modulo(const Expr &, const Expr &);
+
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct Expt : Binary {
+    Expt(const Expr &, const Expr &);
+
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct PlusVar : Variadic {
+    PlusVar(const std::vector<Expr> &);
+
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct MinusVar : Variadic {
+    MinusVar(const std::vector<Expr> &);
+
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct MultVar : Variadic {
+    MultVar(const std::vector<Expr> &);
+
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct DivVar : Variadic {
+    DivVar(const std::vector<Expr> &);
+
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+/**
+ * @brief (+ x k), (+ k x) or (- x k) with a literal fixnum k, chosen by the
+ * parser: adds k to a fixnum without evaluating the literal
+ *
+ * rand2 is the literal, negated for -, so that the node rebuilds from its
+ * operands like any Binary node.
+ */
+struct AddImm : Plus {
+    int k;
+
+    AddImm(const Expr &, const Expr &);
+
+    // x + k
+    Value add(const Value &);
+
+    virtual Value eval(Assoc &) override;
+};
+
+// ================================================================================
+//                             COMPARISON OPERATIONS
+// ================================================================================
+
+struct Less : Binary {
+    Less(const Expr &, const Expr &);
+
+    virtual Value evalRator(const Value &, const Value &) override;
+
+    static Value fixnumRator(int, int);
+    static bool fixnumTest(int, int);
+};
+
+struct LessEq : Binary {
+    LessEq(const Expr &, const Expr &);
+
+    virtual Value evalRator(const Value &, const Value &) override;
+
+    static Value fixnumRator(int, int);
+    static bool fixnumTest(int, int);
+};
+
+struct Equal : Binary {
+    Equal(const Expr &, const Expr &);
+
+    virtual Value evalRator(const Value &, const Value &) override;
+
+    static Value fixnumRator(int, int);
+    static bool fixnumTest(int, int);
+};
+
+struct GreaterEq : Binary {
+    GreaterEq(const Expr &, const Expr &);
+
+    virtual Value evalRator(const Value &, const Value &) override;
+
+    static Value fixnumRator(int, int);
+    static bool fixnumTest(int, int);
+};
+
+struct Greater : Binary {
+    Greater(const Expr &, const Expr &);
+
+    virtual Value evalRator(const Value &, const Value &) override;
+
+    static Value fixnumRator(int, int);
+    static bool fixnumTest(int, int);
+};
+
+struct LessVar : Variadic {
+    LessVar(const std::vector<Expr> &);
+
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct LessEqVar : Variadic {
+    LessEqVar(const std::vector<Expr> &);
+
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct EqualVar : Variadic {
+    EqualVar(const std::vector<Expr> &);
+
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct GreaterEqVar : Variadic {
+    GreaterEqVar(const std::vector<Expr> &);
+
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct GreaterVar : Variadic {
+    GreaterVar(const std::vector<Expr> &);
+
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+// ================================================================================
+//                             LIST OPERATIONS
+// ================================================================================
+
+struct Cons : Binary {
+    Cons(const Expr &, const Expr &);
+
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct Car : Unary {
+    Car(const Expr &);
+
+    virtual Value evalRator(const Value &) override;
+};
+
+struct Cdr : Unary {
+    Cdr(const Expr &);
+
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief (car (cdr x)), fused by the parser so that the cdr is not kept
+ * as a value of its own
+ */
+struct Cadr : Unary {
+    Cadr(const Expr &);
+
+    virtual Value evalRator(const Value &) override;
+};
+
+struct ListFunc : Variadic {
+    ListFunc(const std::vector<Expr> &);
+
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct SetCar : Binary {
+    SetCar(const Expr &, const Expr &);
+
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct SetCdr : Binary {
+    SetCdr(const Expr &, const Expr &);
+
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+// ================================================================================
+//                             LOGIC OPERATIONS
+// ================================================================================
+
+struct Not : Unary {
+    Not(const Expr &);
+
+    virtual Value evalRator(const Value &) override;
+
+    virtual bool test(Assoc &) override;
+};
+
+struct AndVar : ExprBase {
+    std::vector<Expr> rands;
+
+    AndVar(const std::vector<Expr> &);
+
+    virtual Value eval(Assoc &) override;
+
+    virtual Value evalTail(Assoc &, TailCall &) override;
+
+    virtual void resolve(Scope *) override;
+
+    virtual void subexprs(std::vector<Expr *> &) override;
+};
+
+struct OrVar : ExprBase {
+    std::vector<Expr> rands;
+
+    OrVar(const std::vector<Expr> &);
+
+    virtual Value eval(Assoc &) override;
+
+    virtual Value evalTail(Assoc &, TailCall &) override;
+
+    virtual void resolve(Scope *) override;
+
+    virtual void subexprs(std::vector<Expr *> &) override;
+};
+
+// ================================================================================
+//                             TYPE PREDICATES
+// ================================================================================
+
+struct IsEq : Binary {
+    IsEq(const Expr &, const Expr &);
+
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct IsBoolean : Unary {
+    IsBoolean(const Expr &);
+
+    virtual Value evalRator(const Value &) override;
+};
+
+struct IsFixnum : Unary {
+    IsFixnum(const Expr &);
+
+    virtual Value evalRator(const Value &) override;
+};
+
+struct IsNull : Unary {
+    IsNull(const Expr &);
+
+    virtual Value evalRator(const Value &) override;
+
+    virtual bool test(Assoc &) override;
+};
+
+struct IsPair : Unary {
+    IsPair(const Expr &);
+
+    virtual Value evalRator(const Value &) override;
+};
+
+struct IsProcedure : Unary {
+    IsProcedure(const Expr &);
+
+    virtual Value evalRator(const Value &) override;
+};
+
+struct IsSymbol : Unary {
+    IsSymbol(const Expr &);
+
+    virtual Value evalRator(const Value &) override;
+};
+
+struct IsList : Unary {
+    IsList(const Expr &);
+
+    virtual Value evalRator(const Value &) override;
+};
+
+struct IsString : Unary {
+    IsString(const Expr &);
+
+    virtual Value evalRator(const Value &) override;
+};
+
+// ================================================================================
+//                             CONTROL FLOW CONSTRUCTS
+// ================================================================================
+
+struct Begin : ExprBase {
+    std::vector<Expr> es;
+    std::vector<Sym> defs; ///< Names bound by internal defines
+    std::vector<bool> boxed; ///< Which of them live in a Box
+
+    Begin(const std::vector<Expr> &);
+
+    virtual Value eval(Assoc &) override;
+
+    virtual Value evalTail(Assoc &, TailCall &) override;
+
+    // The frame of the internal defines, or e itself when there are none
+    Assoc open(Assoc &e);
+
+    virtual void resolve(Scope *) override;
+
+    virtual void subexprs(std::vector<Expr *> &) override;
+};
+
+struct Quote : ExprBase {
+    Syntax s;
+
+    Quote(const Syntax &);
+
+    virtual Value eval(Assoc &) override;
+};
+
+// ================================================================================
+//                             CONDITIONALS
+// ================================================================================
+
+struct If : ExprBase {
+    Expr cond;
+    Expr conseq;
+    Expr alter;
+
+    If(const Expr &, const Expr &, const Expr &);
+
+    virtual Value eval(Assoc &) override;
+
+    virtual Value evalTail(Assoc &, TailCall &) override;
+
+    // The branch selected by cond
+    ExprBase *select(Assoc &);
+
+    virtual void resolve(Scope *) override;
+
+    virtual void subexprs(std::vector<Expr *> &) override;
+};
+
+struct Cond : ExprBase {
+    std::vector<std::vector<Expr> > clauses;
+
+    Cond(const std::vector<std::vector<Expr> > &);
+
+    virtual Value eval(Assoc &) override;
+
+    virtual Value evalTail(Assoc &, TailCall &) override;
+
+    // Runs the clauses up to the selected one and returns its last
+    // expression, or null with the value of its test when it has no body
+    ExprBase *select(Assoc &, Value &);
+
+    virtual void resolve(Scope *) override;
+
+    virtual void subexprs(std::vector<Expr *> &) override;
+};
+
+// ================================================================================
+//                             VARIABLE AND FUNCITION DEFINITION
+// ================================================================================
+
+struct Var : ExprBase {
+    Sym x;
+
+    Var(Sym);
+
+    virtual Value eval(Assoc &) override;
+};
+
+/**
+ * @brief Reference to a lambda/let/letrec/define binding
+ * depth counts enclosing frames, slot is the binding's position in its frame.
+ */
+struct LocalVar : ExprBase {
+    Sym x;
+    int depth;
+    int slot;
+    bool boxed;
+
+    LocalVar(Sym, int, int);
+
+    virtual Value eval(Assoc &) override;
+};
+
+/**
+ * @brief Reference to a free variable of the running procedure
+ */
+struct ClosureVar : ExprBase {
+    Sym x;
+    int depth;    ///< Frame of the running procedure
+    int slot;     ///< Slot of the procedure in that frame
+    int captured; ///< Position in the procedure's captured values
+    bool boxed;
+
+    ClosureVar(Sym, int, int, int);
+
+    virtual Value eval(Assoc &) override;
+};
+
+/**
+ * @brief Reference to a top-level binding or a primitive
+ */
+struct GlobalVar : ExprBase {
+    Sym x;
+    Value *slot; ///< Cached slot in global_env
+
+    GlobalVar(Sym);
+
+    virtual Value eval(Assoc &) override;
+};
+
+/**
+ * @brief Reference to a primitive or reserved word used as a value
+ *
+ * A top-level binding of the same name still takes precedence.
+ */
+struct PrimitiveVar : ExprBase {
+    Sym x;
+    Value *slot; ///< Cached slot in global_env
+    const Value *proc; ///< The primitive's procedure, nullptr for a reserved word
+
+    PrimitiveVar(Sym);
+
+    virtual Value eval(Assoc &) override;
+};
+
+/**
+ * @brief Identifier that is not a valid variable name
+ */
+struct InvalidVar : ExprBase {
+    Sym x;
+
+    InvalidVar(Sym);
+
+    virtual Value eval(Assoc &) override;
+};
+
+struct Apply : ExprBase {
+    Expr rator;
+    std::vector<Expr> rand;
+    Lambda *cached;         ///< Code of the global procedure last called here
+    unsigned cache_version; ///< global_env.version cached was seen at
+
+    Apply(const Expr &, const std::vector<Expr> &);
+
+    virtual Value eval(Assoc &) override;
+
+    virtual Value evalTail(Assoc &, TailCall &) override;
+
+    /**
+     * @brief Evaluates the operator and the operands
+     *
+     * Calling a procedure is left to the caller: its body is returned and
+     * frame set to its filled frame. A primitive is applied right away, with
+     * nullptr returned and its value stored in result, as is the value of
+     * a procedure ENGINE_TIERED runs on the VM. tail tells whether the call
+     * is a tail call.
+     */
+    ExprBase *enter(Assoc &e, Assoc &frame, Value &result, bool tail);
+
+    virtual void resolve(Scope *) override;
+
+    virtual void subexprs(std::vector<Expr *> &) override;
+};
+
+/**
+ * @brief Call of a global helper whose body was copied in place, see inline.cpp
+ *
+ * body is a Let binding the parameters to the operands around a copy of
+ * the helper's body. It runs only while the global still holds a closure
+ * of lambda; otherwise call makes the call, with the same operand nodes.
+ */
+struct Inline : ExprBase {
+    Sym name;
+    Expr lambda;
+    Expr body;
+    Expr call;   ///< Built by resolve
+    Value *slot; ///< Slot of name in global_env
+
+    Inline(Sym, const Expr &, const Expr &);
+
+    virtual Value eval(Assoc &) override;
+
+    virtual Value evalTail(Assoc &, TailCall &) override;
+
+    // Whether the global is still the procedure inlined
+    bool current() const;
+
+    virtual void resolve(Scope *) override;
+
+    virtual void subexprs(std::vector<Expr *> &) override;
+};
+
+struct Lambda : ExprBase {
+    std::vector<Sym> x;
+    Expr e;
+    std::vector<bool> boxed;        ///< Parameters that live in a Box
+    std::vector<Address> captures;  ///< Where the free variables come from
+    std::shared_ptr<Chunk> bytecode; ///< Body compiled by the VM engine, once called there
+    std::shared_ptr<RegChunk> registers; ///< Body compiled by the register machine, once called there
+    Sym name;                       ///< Variable of the define binding it, nullptr if none
+    unsigned calls, loops;          ///< Calls and tail calls from the tree walker, for ENGINE_TIERED
+    bool promoted;                  ///< ENGINE_TIERED runs the body on the VM
+
+    Lambda(const std::vector<Sym> &, const Expr &);
+
+    // Name of the procedure in diagnostics
+    std::string label() const;
+
+    virtual Value eval(Assoc &) override;
+
+    virtual void resolve(Scope *) override;
+
+    virtual void subexprs(std::vector<Expr *> &) override;
+};
+
+struct Define : ExprBase {
+    Sym var;
+    Expr e;
+    Address addr; ///< Local binding written, depth -1 for a global
+    bool boxed;
+    Value *slot;  ///< Slot in global_env when addr.depth is -1
+
+    Define(Sym, const Expr &);
+
+    virtual Value eval(Assoc &) override;
+
+    // Rejects builtin names; a new global is bound before e is evaluated
+    void prepare();
+
+    // Binds var to the value of e
+    Value store(Assoc &, const Value &);
+
+    virtual void resolve(Scope *) override;
+
+    virtual void subexprs(std::vector<Expr *> &) override;
+};
+
+// ================================================================================
+//                             BINDING CONSTRUCTS
+// ================================================================================
+
+struct Let : ExprBase {
+    std::vector<std::pair<Sym, Expr> > bind;
+    Expr body;
+    std::vector<bool> boxed;
+
+    Let(const std::vector<std::pair<Sym, Expr> > &, const Expr &);
+
+    virtual Value eval(Assoc &) override;
+
+    virtual Value evalTail(Assoc &, TailCall &) override;
+
+    virtual void resolve(Scope *) override;
+
+    virtual void subexprs(std::vector<Expr *> &) override;
+};
+struct Letrec : ExprBase {
+    std::vector<std::pair<Sym, Expr> > bind;
+    Expr body;
+    std::vector<bool> boxed;
+
+    Letrec(const std::vector<std::pair<Sym, Expr> > &, const Expr &);
+
+    virtual Value eval(Assoc &) override;
+
+    virtual Value evalTail(Assoc &, TailCall &) override;
+
+    // The frame of the bindings, before any is initialized
+    Assoc open(Assoc &);
+
+    // Gives binding i of the frame its value
+    void init(Assoc &, int i, const Value &);
+
+    virtual void resolve(Scope *) override;
+
+    virtual void subexprs(std::vector<Expr *> &) override;
+};
+
+/**
+ * @brief A named let or do whose name is only called from the tail of its
+ * body, built by the parser in place of a letrec
+ *
+ * It runs as a let. Its bindings keep one frame for the whole loop: each
+ * Recur stores the next values there and runs the body again in that frame.
+ */
+struct Loop : Let {
+    Scope *scope; ///< Scope of the bindings, while the body is resolved
+
+    Loop(const std::vector<std::pair<Sym, Expr> > &, const Expr &);
+
+    virtual void resolve(Scope *) override;
+};
+
+/**
+ * @brief A call of a Loop's name, made in tail position of its body
+ *
+ * Like a tail call it leaves the body to run next in its TailCall.
+ */
+struct Recur : ExprBase {
+    Loop *loop;
+    std::vector<Expr> rands;
+    int depth; ///< Frames between the Recur and the one of the loop
+
+    Recur(Loop *, const std::vector<Expr> &);
+
+    virtual Value eval(Assoc &) override;
+
+    virtual Value evalTail(Assoc &, TailCall &) override;
+
+    // Evaluates the operands from i on, then rebinds the loop's variables
+    void rebind(Assoc &, Value *slots, int i);
+
+    virtual void resolve(Scope *) override;
+
+    virtual void subexprs(std::vector<Expr *> &) override;
+};
+
+// ================================================================================
+//                             ASSIGNMENT
+// ================================================================================
+
+struct Set : ExprBase {
+    Sym var;
+    Expr e;
+    Address addr; ///< Local binding written, depth -1 for a global
+    bool boxed;
+    Value *slot;  ///< Slot in global_env when addr.depth is -1
+
+    Set(Sym, const Expr &);
+
+    virtual Value eval(Assoc &) override;
+
+    // Assigns the value of e
+    Value store(Assoc &, const Value &);
+
+    virtual void resolve(Scope *) override;
+
+    virtual void subexprs(std::vector<Expr *> &) override;
+};
+
+// ================================================================================
+//                              I/O OPERATIONS
+// ================================================================================
+
+struct Display : Unary {
+    Display(const Expr &);
+
+    virtual Value evalRator(const Value &) override;
+};
+
+// ================================================================================
+//                              CONTINUATIONS
+// ================================================================================
+
+/**
+ * @brief call/ec: applies a procedure to an escape continuation
+ *
+ * The tree walker keeps its continuation on the C++ stack, which it could
+ * only leave by throwing, so it runs the call on the VM instead; the
+ * other engines capture the continuation themselves.
+ */
+struct CallEC : Unary {
+    CallEC(const Expr &);
+
+    virtual Value evalRator(const Value &) override;
+
+protected:
+    CallEC(ExprType, const Expr &);
+};
+
+/**
+ * @brief call/cc: call/ec, except under ENGINE_CEK, which saves the whole
+ * continuation
+ */
+struct CallCC : CallEC {
+    CallCC(const Expr &);
+};
+
+#ifdef COUNT_EVALS
+// ================================================================================
+//                              INSTRUMENTATION
+// ================================================================================
+
+/**
+ * @brief Counts the evaluations of the expression it wraps, see evalcount.cpp
+ */
+struct Counted : ExprBase {
+    Expr e;
+    unsigned long evals;  ///< Evaluations so far
+    unsigned long entry;  ///< Entry of the parent the last evaluation was made in
+    bool reported;
+
+    Counted(const Expr &);
+
+    virtual Value eval(Assoc &) override;
+
+    virtual Value evalTail(Assoc &, TailCall &) override;
+
+    virtual void subexprs(std::vector<Expr *> &) override;
+};
+
+/**
+ * @brief Wraps every subexpression of a resolved top-level form in a Counted
+ */
+void countEvals(Expr &);
+
+/**
+ * @brief A new dynamic entry of the expression being evaluated, for as long
+ * as it lives
+ *
+ * Needed where one evaluation runs the same subexpression several times on
+ * purpose, like the bodies of successive tail calls.
+ */
+struct EvalEntry {
+    EvalEntry();
+    ~EvalEntry();
+};
+#endif
+
+#endif
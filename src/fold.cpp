@@ -0,0 +1,206 @@
+/**
+ * @file fold.cpp
+ * @brief Constant folding and algebraic simplification, run before resolution
+ *
+ * The parser only builds primitive nodes for names that no binding
+ * shadows, and a call through a shadowing binding is an Apply, which this
+ * pass never touches. So a primitive node always means the built-in
+ * operation and can be evaluated ahead of time when its operands are
+ * literals. Folding is abandoned whenever that evaluation fails, leaving
+ * the error to be raised at run time as before.
+ *
+ * The top-level form itself is never replaced: the REPL decides what to
+ * print from its type.
+ */
+
+#include "Def.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include <vector>
+
+using std::vector;
+
+// Operations without side effects that always give the same value for the
+// same operands
+static bool pure(ExprType t) {
+    switch (t) {
+        case E_PLUS: case E_MINUS: case E_MUL: case E_DIV: case E_MODULO: case E_EXPT: case E_ADDI:
+        case E_LT: case E_LE: case E_EQ: case E_GE: case E_GT:
+        case E_NOT:
+        case E_BOOLQ: case E_INTQ: case E_NULLQ: case E_PAIRQ: case E_PROCQ:
+        case E_SYMBOLQ: case E_LISTQ: case E_STRINGQ:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool literal(const Expr &ex) {
+    switch (ex->e_type) {
+        case E_FIXNUM: case E_RATIONAL: case E_STRING: case E_TRUE: case E_FALSE: case E_QUOTE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool number(const Expr &ex) {
+    return ex->e_type == E_FIXNUM || ex->e_type == E_RATIONAL;
+}
+
+// Nodes whose value, if they have one, is always a number
+static bool numeric(const Expr &ex) {
+    switch (ex->e_type) {
+        case E_FIXNUM: case E_RATIONAL:
+        case E_PLUS: case E_MINUS: case E_MUL: case E_DIV: case E_MODULO: case E_EXPT: case E_ADDI:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// The literal node for a value, or a null Expr if there is none
+static Expr literalOf(const Value &v) {
+    switch (v.type()) {
+        case V_INT: return Expr(new Fixnum(v.fixnum()));
+        case V_RATIONAL: {
+            Rational *r = static_cast<Rational *>(v.get());
+            return Expr(new RationalNum(r->numerator, r->denominator));
+        }
+        case V_BOOL:
+            if (!v.isFalse()) return Expr(new True());
+            return Expr(new False());
+        default: return Expr(nullptr);
+    }
+}
+
+static bool isFixnum(const Expr &ex, int n) {
+    return ex->e_type == E_FIXNUM && static_cast<Fixnum *>(ex.get())->n == n;
+}
+
+// Evaluates a node with literal operands, null if it fails
+static Expr evalLiteral(const Expr &ex) {
+    try {
+        Assoc env = empty();
+        return literalOf(ex->eval(env));
+    } catch (...) {
+        return Expr(nullptr);
+    }
+}
+
+/**
+ * @brief Folds the leading literal operands of a +, * with more than two
+ * operands into one, and rebuilds the node if two or fewer remain
+ */
+static void foldPrefix(Expr &ex) {
+    vector<Expr> &rands = static_cast<Variadic *>(ex.get())->rands;
+    size_t k = 0;
+    while (k < rands.size() && number(rands[k])) k++;
+    if (k < 2) return;
+    const Builtin *op = builtinOf(ex->e_type);
+    vector<Value> args;
+    Assoc env = empty();
+    for (size_t i = 0; i < k; i++) args.push_back(rands[i]->eval(env));
+    Expr folded(nullptr);
+    try {
+        folded = literalOf(op->fn(args));
+    } catch (...) {
+        return;
+    }
+    if (folded.get() == nullptr) return;
+    vector<Expr> rest{folded};
+    rest.insert(rest.end(), rands.begin() + k, rands.end());
+    if (rest.size() <= 2) ex = op->make(rest);
+    else rands = rest;
+}
+
+/**
+ * @brief Drops an operand that leaves the other unchanged: 0 in + and on
+ * the right of -, 1 in *
+ *
+ * Only done when the other operand is sure to be a number, so that a
+ * wrongly typed operand still fails.
+ */
+static void dropIdentity(Expr &ex) {
+    vector<Expr *> sub;
+    ex->subexprs(sub);
+    if (sub.size() != 2) return;
+    Expr a = *sub[0], b = *sub[1];
+    int unit = ex->e_type == E_MUL ? 1 : 0;
+    if (ex->e_type != E_MINUS && isFixnum(a, unit) && numeric(b)) ex = b;
+    else if (isFixnum(b, unit) && numeric(a)) ex = a;
+}
+
+/**
+ * @brief Rebuilds a + or - of two operands one of which folded to a
+ * fixnum, so that its factory can choose the fused AddImm node
+ */
+static void reselect(Expr &ex) {
+    if (ex->e_type != E_PLUS && ex->e_type != E_MINUS) return;
+    vector<Expr *> sub;
+    ex->subexprs(sub);
+    if (sub.size() != 2) return;
+    if (sub[0]->get()->e_type == E_FIXNUM || sub[1]->get()->e_type == E_FIXNUM)
+        ex = builtinOf(ex->e_type)->make({*sub[0], *sub[1]});
+}
+
+static bool truthy(const Expr &ex) {
+    return literal(ex) && ex->e_type != E_FALSE;
+}
+
+// Removes clauses whose test is #f and those after one that always holds
+static void pruneCond(Cond *c) {
+    vector<vector<Expr> > kept;
+    for (vector<Expr> &clause : c->clauses) {
+        if (clause.empty()) return;
+        if (clause[0]->e_type == E_FALSE) continue;
+        kept.push_back(clause);
+        if (truthy(clause[0])) break;
+    }
+    // keep a cond that would fail, so that it still does
+    if (!kept.empty()) c->clauses = kept;
+}
+
+// A define taking the place of its if or cond would become a statement of
+// the enclosing body
+static void replace(Expr &ex, const Expr &by) {
+    if (by->e_type != E_DEFINE) ex = by;
+}
+
+static void fold(Expr &ex, bool top) {
+    vector<Expr *> sub;
+    ex->subexprs(sub);
+    for (Expr *i : sub) fold(*i, false);
+    if (ex->e_type == E_COND) pruneCond(static_cast<Cond *>(ex.get()));
+    if (top) return;
+    ExprType t = ex->e_type;
+    if (t == E_IF) {
+        If *i = static_cast<If *>(ex.get());
+        if (literal(i->cond)) replace(ex, truthy(i->cond) ? i->conseq : i->alter);
+        return;
+    }
+    if (t == E_COND) {
+        // a cond reduced to a first clause that always holds is its body
+        Cond *c = static_cast<Cond *>(ex.get());
+        if (!c->clauses.empty() && c->clauses[0].size() == 2 && truthy(c->clauses[0][0])) replace(ex, c->clauses[0][1]);
+        return;
+    }
+    if (!pure(t)) return;
+    sub.clear();
+    ex->subexprs(sub);
+    bool constant = true;
+    for (Expr *i : sub) constant = constant && literal(*i);
+    if (constant) {
+        Expr folded = evalLiteral(ex);
+        if (folded.get() != nullptr) ex = folded;
+        return;
+    }
+    if ((t == E_PLUS || t == E_MUL) && sub.size() > 2) foldPrefix(ex);
+    t = ex->e_type;
+    if (t == E_PLUS || t == E_MINUS || t == E_MUL || t == E_ADDI) dropIdentity(ex);
+    reselect(ex);
+}
+
+void foldProgram(Expr &ex) {
+    fold(ex, true);
+}
@@ -0,0 +1,261 @@
+/**
+ * @file inline.cpp
+ * @brief Inlining pass, run after folding and before resolution
+ *
+ * An immediately applied lambda, ((lambda (x ...) body) arg ...), becomes
+ * (let ((x arg) ...) body): the operands extend the current frame instead
+ * of going through a Procedure.
+ *
+ * A top-level (define (f x ...) body) whose body is small, does not
+ * mention f and has no define is remembered as a helper. Later calls
+ * (f arg ...) of the right arity become an Inline node running the same
+ * let around a copy of body, guarded at run time by a check that f still
+ * holds a closure of that lambda. Such a lambda captures nothing, so any
+ * of its closures behaves like the copy. A call site is left alone when a
+ * local binding there would capture a name the body refers to.
+ *
+ * The top-level form itself is never replaced: the REPL decides what to
+ * print from its type.
+ */
+
+#include "Def.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+using std::vector;
+using std::pair;
+
+// Nodes a helper body may have at most
+static const int kInlineBudget = 24;
+
+struct Helper {
+    Expr lambda;
+    Expr body;         ///< Copy of the body as parsed, before resolution rewrites it
+    vector<Sym> names; ///< Names the body refers to or assigns, other than the parameters
+};
+
+static std::unordered_map<Sym, Helper> helpers;
+
+/**
+ * @brief Size of a freshly parsed expression, or -1 if clone cannot copy it
+ */
+static int weigh(const Expr &ex) {
+    switch (ex->e_type) {
+        case E_DEFINE:
+        case E_INVALIDVAR:
+            return -1;
+        case E_FIXNUM: case E_RATIONAL: case E_STRING: case E_TRUE: case E_FALSE: case E_QUOTE:
+        case E_VAR: case E_PRIMVAR:
+        case E_IF: case E_COND: case E_BEGIN: case E_APPLY: case E_LAMBDA:
+        case E_LET: case E_LETREC: case E_SET: case E_INLINE:
+            break;
+        default: {
+            const Builtin *op = builtinOf(ex->e_type);
+            if (op == nullptr || op->make == nullptr) return -1;
+        }
+    }
+    vector<Expr *> sub;
+    ex->subexprs(sub);
+    int size = 1;
+    for (Expr *i : sub) {
+        int n = weigh(*i);
+        if (n < 0) return -1;
+        size += n;
+    }
+    return size;
+}
+
+static vector<Expr> cloneAll(const vector<Expr> &es);
+
+static Expr clone(const Expr &ex);
+
+static vector<pair<Sym, Expr> > cloneBind(const vector<pair<Sym, Expr> > &bind) {
+    vector<pair<Sym, Expr> > out;
+    for (const pair<Sym, Expr> &b : bind) out.push_back({b.first, clone(b.second)});
+    return out;
+}
+
+/**
+ * @brief Deep copy of an expression weigh accepts, for resolution to
+ * rewrite in a scope of its own
+ */
+static Expr clone(const Expr &ex) {
+    ExprBase *x = ex.get();
+    switch (x->e_type) {
+        case E_FIXNUM: return Expr(new Fixnum(static_cast<Fixnum *>(x)->n));
+        case E_RATIONAL: {
+            RationalNum *r = static_cast<RationalNum *>(x);
+            return Expr(new RationalNum(r->numerator, r->denominator));
+        }
+        case E_STRING: return Expr(new StringExpr(static_cast<StringExpr *>(x)->s));
+        case E_TRUE: return Expr(new True());
+        case E_FALSE: return Expr(new False());
+        case E_QUOTE: return Expr(new Quote(static_cast<Quote *>(x)->s));
+        case E_VAR: return Expr(new Var(static_cast<Var *>(x)->x));
+        case E_PRIMVAR: return Expr(new PrimitiveVar(static_cast<PrimitiveVar *>(x)->x));
+        case E_IF: {
+            If *i = static_cast<If *>(x);
+            return Expr(new If(clone(i->cond), clone(i->conseq), clone(i->alter)));
+        }
+        case E_COND: {
+            vector<vector<Expr> > clauses;
+            for (const vector<Expr> &clause : static_cast<Cond *>(x)->clauses) clauses.push_back(cloneAll(clause));
+            return Expr(new Cond(clauses));
+        }
+        case E_BEGIN: return Expr(new Begin(cloneAll(static_cast<Begin *>(x)->es)));
+        case E_APPLY: {
+            Apply *a = static_cast<Apply *>(x);
+            return Expr(new Apply(clone(a->rator), cloneAll(a->rand)));
+        }
+        case E_LAMBDA: {
+            Lambda *l = static_cast<Lambda *>(x);
+            return Expr(new Lambda(l->x, clone(l->e)));
+        }
+        case E_LET: {
+            Let *l = static_cast<Let *>(x);
+            return Expr(new Let(cloneBind(l->bind), clone(l->body)));
+        }
+        case E_LETREC: {
+            Letrec *l = static_cast<Letrec *>(x);
+            return Expr(new Letrec(cloneBind(l->bind), clone(l->body)));
+        }
+        case E_SET: {
+            Set *s = static_cast<Set *>(x);
+            return Expr(new Set(s->var, clone(s->e)));
+        }
+        case E_INLINE: {
+            Inline *in = static_cast<Inline *>(x);
+            return Expr(new Inline(in->name, in->lambda, clone(in->body)));
+        }
+        default: {
+            // a primitive node, rebuilt by the factory of the parser
+            vector<Expr *> sub;
+            x->subexprs(sub);
+            vector<Expr> rands;
+            for (Expr *i : sub) rands.push_back(clone(*i));
+            return builtinOf(x->e_type)->make(rands);
+        }
+    }
+}
+
+static vector<Expr> cloneAll(const vector<Expr> &es) {
+    vector<Expr> out;
+    for (const Expr &i : es) out.push_back(clone(i));
+    return out;
+}
+
+// Every name resolution will look up in ex
+static void collectNames(const Expr &ex, vector<Sym> &names) {
+    if (ex->e_type == E_VAR) names.push_back(static_cast<Var *>(ex.get())->x);
+    if (ex->e_type == E_PRIMVAR) names.push_back(static_cast<PrimitiveVar *>(ex.get())->x);
+    if (ex->e_type == E_SET) names.push_back(static_cast<Set *>(ex.get())->var);
+    vector<Expr *> sub;
+    ex->subexprs(sub);
+    for (Expr *i : sub) collectNames(*i, names);
+}
+
+static bool bound(Sym x, const vector<Sym> &scope) {
+    return std::find(scope.begin(), scope.end(), x) != scope.end();
+}
+
+// Remembers f if the top-level define of f makes it a helper
+static void learn(Define *d) {
+    helpers.erase(d->var);
+    if (d->e->e_type != E_LAMBDA) return;
+    Lambda *lam = static_cast<Lambda *>(d->e.get());
+    int size = weigh(lam->e);
+    if (size < 0 || size > kInlineBudget) return;
+    vector<Sym> names;
+    collectNames(lam->e, names);
+    if (bound(d->var, names)) return;
+    Helper h{d->e, clone(lam->e), {}};
+    for (Sym x : names)
+        if (!bound(x, lam->x) && !bound(x, h.names)) h.names.push_back(x);
+    helpers.insert({d->var, h});
+}
+
+// The Inline node for a call of a helper, or a null Expr if it is not one
+static Expr inlineCall(Apply *a, const vector<Sym> &scope) {
+    if (a->rator->e_type != E_VAR) return Expr(nullptr);
+    Sym f = static_cast<Var *>(a->rator.get())->x;
+    auto it = helpers.find(f);
+    if (it == helpers.end() || bound(f, scope)) return Expr(nullptr);
+    Lambda *lam = static_cast<Lambda *>(it->second.lambda.get());
+    if (lam->x.size() != a->rand.size()) return Expr(nullptr);
+    for (Sym x : it->second.names)
+        if (bound(x, scope)) return Expr(nullptr);
+    vector<pair<Sym, Expr> > bind;
+    for (size_t i = 0; i < a->rand.size(); i++) bind.push_back({lam->x[i], a->rand[i]});
+    return Expr(new Inline(f, it->second.lambda, Expr(new Let(bind, clone(it->second.body)))));
+}
+
+/**
+ * @brief Inlines the calls in ex, whose free names scope binds locally
+ *
+ * Top-level defines bind globals, and do not count as local.
+ */
+static void inlineIn(Expr &ex, vector<Sym> &scope, bool local, bool top) {
+    size_t outer = scope.size();
+    switch (ex->e_type) {
+        case E_LAMBDA: {
+            Lambda *l = static_cast<Lambda *>(ex.get());
+            scope.insert(scope.end(), l->x.begin(), l->x.end());
+            if (l->e->e_type == E_DEFINE) scope.push_back(static_cast<Define *>(l->e.get())->var);
+            inlineIn(l->e, scope, true, false);
+            break;
+        }
+        case E_LET:
+        case E_LOOP: {
+            Let *l = static_cast<Let *>(ex.get());
+            for (pair<Sym, Expr> &b : l->bind) inlineIn(b.second, scope, local, false);
+            for (pair<Sym, Expr> &b : l->bind) scope.push_back(b.first);
+            if (l->body->e_type == E_DEFINE) scope.push_back(static_cast<Define *>(l->body.get())->var);
+            inlineIn(l->body, scope, true, false);
+            break;
+        }
+        case E_LETREC: {
+            Letrec *l = static_cast<Letrec *>(ex.get());
+            for (pair<Sym, Expr> &b : l->bind) scope.push_back(b.first);
+            if (l->body->e_type == E_DEFINE) scope.push_back(static_cast<Define *>(l->body.get())->var);
+            for (pair<Sym, Expr> &b : l->bind) inlineIn(b.second, scope, true, false);
+            inlineIn(l->body, scope, true, false);
+            break;
+        }
+        case E_BEGIN: {
+            Begin *b = static_cast<Begin *>(ex.get());
+            if (local)
+                for (Expr &i : b->es)
+                    if (i->e_type == E_DEFINE) scope.push_back(static_cast<Define *>(i.get())->var);
+            for (Expr &i : b->es) inlineIn(i, scope, local, false);
+            break;
+        }
+        default: {
+            vector<Expr *> sub;
+            ex->subexprs(sub);
+            for (Expr *i : sub) inlineIn(*i, scope, local, false);
+        }
+    }
+    scope.resize(outer);
+    if (top || ex->e_type != E_APPLY) return;
+    Apply *a = static_cast<Apply *>(ex.get());
+    if (a->rator->e_type == E_LAMBDA) {
+        Lambda *l = static_cast<Lambda *>(a->rator.get());
+        if (l->x.size() != a->rand.size()) return;
+        vector<pair<Sym, Expr> > bind;
+        for (size_t i = 0; i < a->rand.size(); i++) bind.push_back({l->x[i], a->rand[i]});
+        ex = Expr(new Let(bind, l->e));
+        return;
+    }
+    Expr in = inlineCall(a, scope);
+    if (in.get() != nullptr) ex = in;
+}
+
+void inlineProgram(Expr &ex) {
+    vector<Sym> scope;
+    inlineIn(ex, scope, false, true);
+    if (ex->e_type == E_DEFINE) learn(static_cast<Define *>(ex.get()));
+    if (ex->e_type == E_SET) helpers.erase(static_cast<Set *>(ex.get())->var);
+}
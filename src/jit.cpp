@@ -0,0 +1,160 @@
+/**
+ * @file jit.cpp
+ * @brief Template JIT turning a Chunk into x86-64 machine code
+ *
+ * Every instruction of the chunk becomes a copy of one template: load the
+ * machine into rdi and the operands into esi, edx and ecx, call the
+ * instruction's precompiled Routine, and test its result. Jumps become
+ * native jumps, and conditional ones a native branch on the routine's
+ * result, so the machine no longer fetches and decodes instructions or
+ * goes through the dispatch switch.
+ *
+ * The code of a chunk is a function void(Machine *, entry) that starts at
+ * the native address of any instruction, and returns as soon as a routine
+ * reports that control left the chunk: a call entering a procedure, a
+ * return, or an error, which routines keep from unwinding through native
+ * frames. evalVM then continues wherever the machine points.
+ *
+ * Other platforms get no native code and keep interpreting.
+ */
+
+#include "vm.hpp"
+#include "RE.hpp"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+
+namespace {
+
+/**
+ * @brief Machine code being emitted, before it is moved to executable memory
+ */
+struct Assembler {
+    std::vector<unsigned char> out;
+    std::vector<std::pair<size_t, int> > fixups; ///< rel32 fields, and the instruction they jump to
+
+    void byte(unsigned char b) { out.push_back(b); }
+
+    void bytes(std::initializer_list<unsigned char> bs) { out.insert(out.end(), bs); }
+
+    void imm32(int32_t x) {
+        for (int i = 0; i < 4; i++) byte(static_cast<unsigned char>(x >> (8 * i)));
+    }
+
+    void imm64(uint64_t x) {
+        for (int i = 0; i < 8; i++) byte(static_cast<unsigned char>(x >> (8 * i)));
+    }
+
+    // rel32 operand of a jump to offset at of the code
+    void rel32(size_t at) { imm32(static_cast<int32_t>(at - (out.size() + 4))); }
+
+    void patch(size_t field, size_t at) {
+        int32_t rel = static_cast<int32_t>(at - (field + 4));
+        std::memcpy(&out[field], &rel, 4);
+    }
+};
+
+}
+
+std::unique_ptr<NativeCode> jitCompile(const Chunk &ch) {
+    Assembler a;
+    a.bytes({0x53});             // push rbx
+    a.bytes({0x48, 0x89, 0xfb}); // mov rbx, rdi
+    a.bytes({0xff, 0xe6});       // jmp rsi
+    size_t exit = a.out.size();
+    a.bytes({0x5b});             // pop rbx
+    a.bytes({0xc3});             // ret
+
+    const std::vector<int> &code = ch.code;
+    std::vector<size_t> at(code.size(), 0);
+    for (size_t pc = 0; pc < code.size();) {
+        at[pc] = a.out.size();
+        int op = code[pc];
+        if (op < 0 || op >= OP_COUNT) return nullptr;
+        const Routine &r = routines[op];
+        int arg[3] = {0, 0, 0};
+        for (int i = 0; i < r.operands; i++) arg[i] = code[pc + 1 + i];
+        size_t next = pc + 1 + r.operands;
+        if (op == OP_CALL || op == OP_CALLEC) arg[1] = next;
+        if (r.kind == R_JUMP) {
+            a.byte(0xe9); // jmp rel32
+            a.fixups.push_back({a.out.size(), arg[0]});
+            a.imm32(0);
+            pc = next;
+            continue;
+        }
+        a.bytes({0x48, 0x89, 0xdf}); // mov rdi, rbx
+        a.byte(0xbe);                // mov esi, imm32
+        a.imm32(arg[0]);
+        a.byte(0xba);                // mov edx, imm32
+        a.imm32(arg[1]);
+        a.byte(0xb9);                // mov ecx, imm32
+        a.imm32(arg[2]);
+        a.bytes({0x48, 0xb8});       // mov rax, imm64
+        a.imm64(reinterpret_cast<uint64_t>(r.fn));
+        a.bytes({0xff, 0xd0});       // call rax
+        if (r.kind == R_LEAVE) {
+            a.byte(0xe9);            // jmp exit
+            a.rel32(exit);
+        } else {
+            a.bytes({0x85, 0xc0});   // test eax, eax
+            a.bytes({0x0f, 0x85});   // jnz rel32
+            if (r.kind == R_BRANCH) {
+                a.fixups.push_back({a.out.size(), arg[r.operands - 1]});
+                a.imm32(0);
+            } else a.rel32(exit);
+        }
+        pc = next;
+    }
+    for (const std::pair<size_t, int> &f : a.fixups) {
+        if (f.second < 0 || f.second >= (int) code.size()) return nullptr;
+        a.patch(f.first, at[f.second]);
+    }
+
+    void *mem = mmap(nullptr, a.out.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return nullptr;
+    std::memcpy(mem, a.out.data(), a.out.size());
+    if (mprotect(mem, a.out.size(), PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, a.out.size());
+        return nullptr;
+    }
+    std::unique_ptr<NativeCode> native(new NativeCode(static_cast<unsigned char *>(mem), a.out.size()));
+    native->entry.assign(code.size(), nullptr);
+    for (size_t pc = 0; pc < code.size(); pc++)
+        if (at[pc] != 0) native->entry[pc] = native->mem + at[pc];
+    return native;
+}
+
+NativeCode::~NativeCode() {
+    munmap(mem, size);
+}
+
+void jitRun(Machine &m) {
+    const NativeCode *native = m.ch->native.get();
+    typedef void (*Entry)(Machine *, const unsigned char *);
+    reinterpret_cast<Entry>(native->mem)(&m, native->entry[m.pc - m.ch->code.data()]);
+    if (m.error != nullptr) {
+        std::exception_ptr error = m.error;
+        m.error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+#else
+
+std::unique_ptr<NativeCode> jitCompile(const Chunk &) {
+    return nullptr;
+}
+
+NativeCode::~NativeCode() {}
+
+void jitRun(Machine &) {
+    throw RuntimeError("No native code on this platform");
+}
+
+#endif
+
+NativeCode::NativeCode(unsigned char *mem, size_t size) : mem(mem), size(size) {}
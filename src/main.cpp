@@ -1,113 +1,158 @@
-#include "Def.hpp"
-#include "syntax.hpp"
-#include "expr.hpp"
-#include "value.hpp"
-#include "RE.hpp"
-#include <sstream>
-#include <iostream>
-#include <map>
-
-extern std::map<std::string, ExprType> primitives;
-extern std::map<std::string, ExprType> reserved_words;
-/*
-bool isExplicitVoidCall(Expr expr) {
-    MakeVoid* make_void_expr = dynamic_cast<MakeVoid*>(expr.get());
-    if (make_void_expr != nullptr) {
-        return true;
-    }
-    
-    Apply* apply_expr = dynamic_cast<Apply*>(expr.get());
-    if (apply_expr != nullptr) {
-        Var* var_expr = dynamic_cast<Var*>(apply_expr->rator.get());
-        if (var_expr != nullptr && var_expr->x == "void") {
-            return true;
-        }
-    }
-    
-    Begin* begin_expr = dynamic_cast<Begin*>(expr.get());
-    if (begin_expr != nullptr && !begin_expr->es.empty()) {
-        return isExplicitVoidCall(begin_expr->es.back());
-    }
-    
-    If* if_expr = dynamic_cast<If*>(expr.get());
-    if (if_expr != nullptr) {
-        return isExplicitVoidCall(if_expr->conseq) || isExplicitVoidCall(if_expr->alter);
-    }
-    
-    Cond* cond_expr = dynamic_cast<Cond*>(expr.get());
-    if (cond_expr != nullptr) {
-        for (const auto& clause : cond_expr->clauses) {
-            if (clause.size() > 1 && isExplicitVoidCall(clause.back())) {
-                return true;
-            }
-        }
-    }
-    return false;
-}*/
-void REPL(){
-    // read - evaluation - print loop
-    Assoc global_env = empty();
-    bool flag = true;
-     std::vector<std::pair<std::string, Expr>> defines;
-    while (1){
-        #ifndef ONLINE_JUDGE
-        if(flag)std::cout<<"scm> ";
-        #endif
-        Syntax stx = readSyntax(std :: cin); // read
-        try{
-            Expr expr = stx -> parse(global_env);
-            Define* define_expr = dynamic_cast<Define*>(expr.get());
-            if (define_expr != nullptr) {
-                defines.push_back({define_expr->var, define_expr->e});
-                flag = false;
-                continue;
-            } else if (!defines.empty()) {
-                for (const auto& def : defines) global_env = extend(def.first, NullV(), global_env);
-                for (const auto& def : defines) {
-                    Value value = def.second->eval(global_env);
-                    modify(def.first, value, global_env);
-                }
-                defines.clear();
-                Value val = expr -> eval(global_env);
-                if (val -> v_type == V_TERMINATE)break;
-                if (expr->e_type==E_DISPLAY) {
-                    flag=true;
-                    puts("");
-                    continue;
-                }
-                if(expr->e_type==E_VOID||val->v_type!=V_VOID||
-                   expr->e_type==E_BEGIN||expr->e_type==E_IF||
-                   expr->e_type==E_COND||expr->e_type==E_APPLY) {
-                    val -> show(std :: cout);
-                    flag=true;
-                   } else flag=false;
-            } else {
-                Value val = expr -> eval(global_env);
-                if (val -> v_type == V_TERMINATE)break;
-                if (expr->e_type==E_DISPLAY) {
-                    flag=true;
-                    puts("");
-                    continue;
-                }
-                if(expr->e_type==E_VOID||val->v_type!=V_VOID||
-                   expr->e_type==E_BEGIN||expr->e_type==E_IF||
-                   expr->e_type==E_COND||expr->e_type==E_APPLY) {
-                    val -> show(std :: cout);
-                    flag=true;
-                   } else flag=false;
-            }
-        }
-        catch (const RuntimeError &RE){
-             // std :: cout << RE.message();
-            std :: cout << "RuntimeError";
-            flag=true;
-        }
-        if (flag)puts("");
-    }
-}
-
-
-int main(int argc, char *argv[]) {
-    REPL();
-    return 0;
-}
+#include "Def.hpp"
+#include "syntax.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include "RE.hpp"
+#include <sstream>
+#include <iostream>
+#include <map>
+
+/*
+bool isExplicitVoidCall(Expr expr) {
+    MakeVoid* make_void_expr = dynamic_cast<MakeVoid*>(expr.get());
+    if (make_void_expr != nullptr) {
+        return true;
+    }
+    
+    Apply* apply_expr = dynamic_cast<Apply*>(expr.get());
+    if (apply_expr != nullptr) {
+        Var* var_expr = dynamic_cast<Var*>(apply_expr->rator.get());
+        if (var_expr != nullptr && var_expr->x == "void") {
+            return true;
+        }
+    }
+    
+    Begin* begin_expr = dynamic_cast<Begin*>(expr.get());
+    if (begin_expr != nullptr && !begin_expr->es.empty()) {
+        return isExplicitVoidCall(begin_expr->es.back());
+    }
+    
+    If* if_expr = dynamic_cast<If*>(expr.get());
+    if (if_expr != nullptr) {
+        return isExplicitVoidCall(if_expr->conseq) || isExplicitVoidCall(if_expr->alter);
+    }
+    
+    Cond* cond_expr = dynamic_cast<Cond*>(expr.get());
+    if (cond_expr != nullptr) {
+        for (const auto& clause : cond_expr->clauses) {
+            if (clause.size() > 1 && isExplicitVoidCall(clause.back())) {
+                return true;
+            }
+        }
+    }
+    return false;
+}*/
+Options options = {ENGINE_TREE, 10000000, false, 1000, 100, false};
+
+// Evaluates a top-level form on the engine chosen on the command line
+static Value evaluate(const Expr &expr, Assoc &env) {
+    if (options.engine == ENGINE_CEK) return evalCEK(expr.get(), env);
+    if (options.engine == ENGINE_VM) return evalVM(expr.get(), env);
+    if (options.engine == ENGINE_REG) return evalReg(expr.get(), env);
+    return expr->eval(env);
+}
+
+void REPL(){
+    // read - evaluation - print loop
+    Assoc parse_env = empty();
+    Assoc top_env = empty();
+    bool flag = true;
+     std::vector<std::pair<Sym, Expr>> defines;
+    while (1){
+        #ifndef ONLINE_JUDGE
+        if(flag)std::cout<<"scm> ";
+        #endif
+        Syntax stx = readSyntax(std :: cin); // read
+        try{
+            Expr expr = stx -> parse(parse_env);
+            resolveProgram(expr);
+            if (expr->e_type == E_DEFINE) {
+                Define* define_expr = static_cast<Define*>(expr.get());
+                defines.push_back({define_expr->var, define_expr->e});
+                flag = false;
+                continue;
+            } else if (!defines.empty()) {
+                for (const auto& def : defines) global_env.assign(global_env.slot(def.first), NullV());
+                for (const auto& def : defines) {
+                    Value value = evaluate(def.second, top_env);
+                    global_env.assign(global_env.slot(def.first), value);
+                }
+                defines.clear();
+                Value val = evaluate(expr, top_env);
+                if (val.type() == V_TERMINATE)break;
+                if (expr->e_type==E_DISPLAY) {
+                    flag=true;
+                    puts("");
+                    continue;
+                }
+                if(expr->e_type==E_VOID||val.type()!=V_VOID||
+                   expr->e_type==E_BEGIN||expr->e_type==E_IF||
+                   expr->e_type==E_COND||expr->e_type==E_APPLY) {
+                    val.show(std :: cout);
+                    flag=true;
+                   } else flag=false;
+            } else {
+                Value val = evaluate(expr, top_env);
+                if (val.type() == V_TERMINATE)break;
+                if (expr->e_type==E_DISPLAY) {
+                    flag=true;
+                    puts("");
+                    continue;
+                }
+                if(expr->e_type==E_VOID||val.type()!=V_VOID||
+                   expr->e_type==E_BEGIN||expr->e_type==E_IF||
+                   expr->e_type==E_COND||expr->e_type==E_APPLY) {
+                    val.show(std :: cout);
+                    flag=true;
+                   } else flag=false;
+            }
+        }
+        catch (const RuntimeError &RE){
+             // std :: cout << RE.message();
+            std :: cout << "RuntimeError";
+            flag=true;
+        }
+        if (flag)puts("");
+    }
+}
+
+
+/**
+ * Options:
+ *   --engine=tree|cek|vm|reg|tiered
+ *                         evaluator to run on, tree by default; reg is the
+ *                         register machine, tiered walks the tree and moves
+ *                         hot procedures to the vm
+ *   --max-depth=N         continuation frames the cek engine, or calls the
+ *                         vm and reg engines, may have pending
+ *   --jit=on|off          native code for hot procedures of the vm engine,
+ *                         off by default; only on Linux/x86-64
+ *   --jit-threshold=N     calls before a procedure is compiled, 1000 by
+ *                         default; 0 compiles every procedure on first call
+ *   --tier-threshold=N    calls and loop iterations before the tiered engine
+ *                         moves a procedure to the vm, 100 by default
+ *   --tier-log            report on stderr each procedure moved to the vm
+ *                         or compiled to native code
+ */
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--engine=tree") options.engine = ENGINE_TREE;
+        else if (arg == "--engine=cek") options.engine = ENGINE_CEK;
+        else if (arg == "--engine=vm") options.engine = ENGINE_VM;
+        else if (arg == "--engine=reg") options.engine = ENGINE_REG;
+        else if (arg == "--engine=tiered") options.engine = ENGINE_TIERED;
+        else if (arg.compare(0, 12, "--max-depth=") == 0) options.max_depth = std::stoul(arg.substr(12));
+        else if (arg == "--jit=on") options.jit = true;
+        else if (arg == "--jit=off") options.jit = false;
+        else if (arg.compare(0, 16, "--jit-threshold=") == 0) options.jit_threshold = std::stoul(arg.substr(16));
+        else if (arg.compare(0, 17, "--tier-threshold=") == 0) options.tier_threshold = std::stoul(arg.substr(17));
+        else if (arg == "--tier-log") options.tier_log = true;
+        else {
+            std::cerr << "unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+    REPL();
+    return 0;
+}
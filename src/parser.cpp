@@ -1,403 +1,467 @@
-/**
- * @file parser.cpp
- * @brief Parsing implementation for Scheme syntax tree to expression tree conversion
- * 
- * This file implements the parsing logic that converts syntax trees into
- * expression trees that can be evaluated.
- * primitive operations, and function applications.
- */
-
-#include "RE.hpp"
-#include "Def.hpp"
-#include "syntax.hpp"
-#include "value.hpp"
-#include "expr.hpp"
-#include <map>
-#include <string>
-#include <iostream>
-
-#define mp make_pair
-using std::string;
-using std::vector;
-using std::pair;
-
-extern std::map<std::string, ExprType> primitives;
-extern std::map<std::string, ExprType> reserved_words;
-
-/**
- * @brief Default parse method (should be overridden by subclasses)
- */
-Expr Syntax::parse(Assoc &env) {
-    throw RuntimeError("Unimplemented parse method");
-}
-
-Expr Number::parse(Assoc &env) {
-    return Expr(new Fixnum(n));
-}
-
-Expr RationalSyntax::parse(Assoc &env) {
-    return Expr(new RationalNum(numerator, denominator));
-}
-
-Expr SymbolSyntax::parse(Assoc &env) {
-    return Expr(new Var(s));
-}
-
-Expr StringSyntax::parse(Assoc &env) {
-    return Expr(new StringExpr(s));
-}
-
-Expr TrueSyntax::parse(Assoc &env) {
-    return Expr(new True());
-}
-
-Expr FalseSyntax::parse(Assoc &env) {
-    return Expr(new False());
-}
-
-Expr List::parse(Assoc &env) {
-    if (stxs.empty()) {
-        return Expr(new Quote(Syntax(new List())));
-    }
-    //TODO: check if the first element is a symbol
-    //If not, use Apply function to package to a closure;
-    //If so, find whether it's a variable or a keyword;
-    SymbolSyntax *id = dynamic_cast<SymbolSyntax *>(stxs[0].get());
-    if (id == nullptr) {
-        //TODO: TO COMPLETE THE LOGIC
-        vector<Expr> listed;
-        listed.clear();
-        Expr ex = stxs[0]->parse(env);
-        if (stxs.size()==1) {
-            return Expr(new Apply(ex,listed));
-        }
-        if (stxs.size() >= 2) {
-            for (int i = 1; i < stxs.size(); i++)listed.push_back(stxs[i]->parse(env));
-            return Expr(new Apply(ex, listed));
-        }
-        throw(RuntimeError("Unable to parse"));
-    } else {
-        string op = id->s;
-        if (find(op, env).get() != nullptr) {
-            Value found = find(op, env);
-            if (found.get() != nullptr) {
-                vector<Expr> parameters;
-                for (int i = 1; i < stxs.size(); ++i) {
-                    parameters.push_back(stxs[i]->parse(env));
-                }
-                Expr e = stxs[0]->parse(env);
-                return Expr(new Apply(e, parameters));
-            }
-            //TODO: TO COMPLETE THE PARAMETER PARSER LOGIC
-        }
-        if (primitives.count(op) != 0) {
-            vector<Expr> parameters;
-            //TODO: TO COMPLETE THE PARAMETER PARSER LOGIC
-            parameters.clear();
-            for (int i = 1; i < stxs.size(); i++)parameters.push_back(stxs[i]->parse(env));
-            ExprType op_type = primitives[op];
-            if (op_type == E_PLUS) {
-                if (parameters.size() == 0)return Expr(new Plus(new Fixnum(0), new Fixnum(0)));
-                if (parameters.size() == 1)return Expr(new Plus(new Fixnum(0), parameters[0]));
-                if (parameters.size() == 2) {
-                    return Expr(new Plus(parameters[0], parameters[1]));
-                } else {
-                    if (parameters.size() > 2)return Expr(new PlusVar(parameters));
-                    throw RuntimeError("RuntimeError");
-                }
-            } else if (op_type == E_MINUS) {
-                //TODO: TO COMPLETE THE LOGI
-                if (parameters.size() == 1) {
-                    return Expr(new Mult(new Fixnum(-1), parameters[0]));
-                }
-                if (parameters.size() == 2) {
-                    return Expr(new Minus(parameters[0], parameters[1]));
-                } else {
-                    if (parameters.size() > 2)return Expr(new MinusVar(parameters));
-                    throw RuntimeError("RuntimeError");
-                }
-            } else if (op_type == E_MUL) {
-                //TODO: TO COMPLETE THE LOGIC
-                if (parameters.size() == 0)return Expr(new Mult(new Fixnum(1), new Fixnum(1)));
-                if (parameters.size() == 1)return Expr(new Mult(new Fixnum(1), parameters[0]));
-                if (parameters.size() == 2) {
-                    return Expr(new Mult(parameters[0], parameters[1]));
-                } else {
-                    if (parameters.size() > 2)return Expr(new MultVar(parameters));
-                    throw RuntimeError("RuntimeError");
-                }
-            } else if (op_type == E_DIV) {
-                if (parameters.size() == 1)return Expr(new Div(new Fixnum(1), parameters[0]));
-                if (parameters.size() == 2) {
-                    return Expr(new Div(parameters[0], parameters[1]));
-                } else {
-                    if (parameters.size() > 2)return Expr(new DivVar(parameters));
-                    throw RuntimeError("RuntimeError");
-                }
-            } else if (op_type == E_MODULO) {
-                if (parameters.size() != 2) {
-                    throw RuntimeError("Wrong number of arguments for modulo");
-                }
-                return Expr(new Modulo(parameters[0], parameters[1]));
-            } else if (op_type == E_LIST) {
-                return Expr(new ListFunc(parameters));
-            } else if (op_type == E_LT) {
-                if (parameters.size() == 2)return Expr(new Less(parameters[0], parameters[1]));
-                else if (parameters.size() > 2)return Expr(new LessVar(parameters));
-            } else if (op_type == E_LE) {
-                if (parameters.size() == 2)return Expr(new LessEq(parameters[0], parameters[1]));
-                else if (parameters.size() > 2)return Expr(new LessEqVar(parameters));
-            } else if (op_type == E_EQ) {
-                if (parameters.size() == 2)return Expr(new Equal(parameters[0], parameters[1]));
-                else if (parameters.size() > 2)return Expr(new EqualVar(parameters));
-            } else if (op_type == E_GE) {
-                if (parameters.size() == 2)return Expr(new GreaterEq(parameters[0], parameters[1]));
-                else if (parameters.size() > 2)return Expr(new GreaterEqVar(parameters));
-            } else if (op_type == E_GT) {
-                if (parameters.size() == 2)return Expr(new Greater(parameters[0], parameters[1]));
-                else if (parameters.size() > 2)return Expr(new GreaterVar(parameters));
-            } else if (op_type == E_AND) {
-                return Expr(new AndVar(parameters));
-            } else if (op_type == E_OR) {
-                return Expr(new OrVar(parameters));
-            } else if (op_type == E_NOT) {
-                if (parameters.size() == 1)return Expr(new Not(parameters[0]));
-                else throw(RuntimeError("Wrong expr numbers in Not"));
-            } else if (op_type == E_CONS) {
-                if (parameters.size() == 2)return Expr(new Cons(parameters[0], parameters[1]));
-                throw(RuntimeError("Wrong parameter number"));
-            } else if (op_type == E_CAR) {
-                if (parameters.size() == 1)return Expr(new Car(parameters[0]));
-                throw(RuntimeError("Wrong parameter number"));
-            } else if (op_type == E_CDR) {
-                if (parameters.size() == 1)return Expr(new Cdr(parameters[0]));
-                throw(RuntimeError("Wrong parameter number"));
-            } else if (op_type == E_LIST) {
-                return Expr(new ListFunc(parameters));
-            } else if (op_type == E_LISTQ) {
-                if (parameters.size() == 1)return Expr(new IsList(parameters[0]));
-                throw(RuntimeError("Wrong parameter number"));
-            } else if (op_type == E_SETCAR) {
-                if (parameters.size() == 2)return Expr(new SetCar(parameters[0], parameters[1]));
-                throw(RuntimeError("Wrong parameter number"));
-            } else if (op_type == E_SETCDR) {
-                if (parameters.size() == 2)return Expr(new SetCdr(parameters[0], parameters[1]));
-                throw(RuntimeError("Wrong parameter number"));
-            } else if (op_type == E_VOID) {
-                if (!parameters.empty())throw(RuntimeError("No parameters for void"));
-                return Expr(new MakeVoid());
-            } else if (op_type == E_EXIT) {
-                if (parameters.size() > 0)throw(RuntimeError("Wrong parameter number"));
-                return Expr(new Exit());
-            } else if (op_type == E_EQQ) {
-                if (parameters.size() == 2)return Expr(new IsEq(parameters[0], parameters[1]));
-                else throw(RuntimeError("Wrong parameter number"));
-            } else if (op_type == E_BOOLQ) {
-                if (parameters.size() == 1)return Expr(new IsBoolean(parameters[0]));
-                else throw(RuntimeError("Wrong parameter number"));
-            } else if (op_type == E_INTQ) {
-                if (parameters.size() == 1)return Expr(new IsFixnum(parameters[0]));
-                else throw(RuntimeError("Wrong parameter number"));
-            } else if (op_type == E_NULLQ) {
-                if (parameters.size() == 1)return Expr(new IsNull(parameters[0]));
-                else throw(RuntimeError("Wrong parameter number"));
-            } else if (op_type == E_PAIRQ) {
-                if (parameters.size() == 1)return Expr(new IsPair(parameters[0]));
-                else throw(RuntimeError("Wrong parameter number"));
-            } else if (op_type == E_PROCQ) {
-                if (parameters.size() == 1)return Expr(new IsProcedure(parameters[0]));
-                else throw(RuntimeError("Wrong parameter number"));
-            } else if (op_type == E_SYMBOLQ) {
-                if (parameters.size() == 1)return Expr(new IsSymbol(parameters[0]));
-                else throw(RuntimeError("Wrong parameter number"));
-            } else if (op_type == E_STRINGQ) {
-                if (parameters.size() == 1)return Expr(new IsString(parameters[0]));
-                else throw(RuntimeError("Wrong parameter number"));
-            } else if (op_type == E_DISPLAY) {
-                if (parameters.size()==1)return Expr(new Display(parameters[0]));
-                else throw(RuntimeError("Wrong parameter number"));
-            }
-        }
-        if (reserved_words.count(op) != 0) {
-            switch (reserved_words[op]) {
-                case E_QUOTE: {
-                    if (stxs.size() == 2)return Expr(new Quote(stxs[1]));
-                    else throw(RuntimeError("Wrong expr numbers in Quote"));
-                }
-                case E_BEGIN: {
-                    vector<Expr> temp;
-                    temp.clear();
-                    for (int i = 1; i < stxs.size(); i++)temp.emplace_back(stxs[i]->parse(env));
-                    return Expr(new Begin(temp));
-                }
-                case E_IF: {
-                    if (stxs.size() == 4)
-                        return Expr(new If(stxs[1]->parse(env), stxs[2]->parse(env),
-                                           stxs[3]->parse(env)));
-                    throw ("Wrong in IF");
-                }
-                case E_COND: {
-                    vector<vector<Expr> > temp;
-                    temp.clear();
-                    for (int i = 1; i < stxs.size(); i++) {
-                        if (dynamic_cast<List *>(stxs[i].get())) {
-                            vector<Expr> tep;
-                            tep.clear();
-                            List *temp_ls = dynamic_cast<List *>(stxs[i].get());
-                            if (dynamic_cast<SymbolSyntax *>(temp_ls->stxs[0].get()) && dynamic_cast<SymbolSyntax *>(
-                                    temp_ls->stxs[0].get())->s == "else")
-                                tep.push_back(Expr(new True));
-                            else tep.push_back(temp_ls->stxs[0]->parse(env));
-                            for (int j = 1; j < temp_ls->stxs.size(); j++)tep.push_back(temp_ls->stxs[j]->parse(env));
-                            temp.push_back(tep);
-                        } else throw (RuntimeError("Wrong in Cond"));
-                    }
-                    return Expr(new Cond(temp));
-                }
-                case E_LAMBDA: {
-                    if (stxs.size() >= 3) {
-                        if (dynamic_cast<List *>(stxs[1].get())) {
-                            List *temp_ls = dynamic_cast<List *>(stxs[1].get());
-                            vector<string> parameters;
-                            parameters.clear();
-                            Assoc temp_as = env;
-                            for (int i = 0; i < temp_ls->stxs.size(); i++) {
-                                if (dynamic_cast<SymbolSyntax *>(temp_ls->stxs[i].get())) {
-                                    parameters.push_back(dynamic_cast<SymbolSyntax *>(temp_ls->stxs[i].get())->s);
-                                    temp_as = extend(parameters.back(), VoidV(), temp_as);
-                                } else throw(RuntimeError("Wrong in Lambda"));
-                            }
-                            Expr e = nullptr;
-                            vector<Expr> temp;
-                            temp.clear();
-                            if (stxs.size() == 3)e = stxs[2]->parse(temp_as);
-                            else {
-                                for (int i = 2; i < stxs.size(); i++)temp.push_back(stxs[i]->parse(temp_as));
-                                e = Expr(new Begin(temp));
-                            }
-                            return Expr(new Lambda(parameters, e));
-                        } else throw(RuntimeError("Wrong format in Lambada"));
-                    } else throw(RuntimeError("Wrong format in Lambada"));
-                }
-                case E_DEFINE: {
-                    if (stxs.size() < 3) throw(RuntimeError("Wrong format in Define"));
-                    if (dynamic_cast<SymbolSyntax *>(stxs[1].get())) {
-                        string name = dynamic_cast<SymbolSyntax *>(stxs[1].get())->s;
-                        env = extend(name, VoidV(), env);
-                        Expr ex=stxs[2]->parse(env);
-                        if (stxs.size() == 3)return Expr(new Define(name, ex));
-                        else throw(RuntimeError("Couldn't bind several procedures to a VAR identifier"));
-                    }
-                    if (dynamic_cast<List *>(stxs[1].get())) {
-                        List *stx1_ls = dynamic_cast<List *>(stxs[1].get());
-                        string name;
-                        if (dynamic_cast<SymbolSyntax *>(stx1_ls->stxs[0].get()))
-                            name = dynamic_cast<SymbolSyntax *>(stx1_ls->stxs[0].get())->s;
-                        else throw(RuntimeError("Wrong in Define a Procedure"));
-                        vector<string> parameters;
-                        parameters.clear();
-                        Assoc temp_as = env;
-                        temp_as= extend(name, VoidV(), temp_as);
-                        for (int i = 1; i < stx1_ls->stxs.size(); i++) {
-                            if (dynamic_cast<SymbolSyntax *>(stx1_ls->stxs[i].get())) {
-                                parameters.push_back(dynamic_cast<SymbolSyntax *>(stx1_ls->stxs[i].get())->s);
-                                temp_as = extend(parameters.back(), VoidV(), temp_as);
-                            } else throw(RuntimeError("Wrong in Define a Procedure"));
-                        }
-                        if (stxs.size() == 3)return Expr(new Define(name, new Lambda(parameters,stxs[2]->parse(temp_as))));
-                        else {
-                            vector<Expr> temp_ls;
-                            temp_ls.clear();
-                            for (int i = 2; i < stxs.size(); i++)temp_ls.emplace_back(stxs[i]->parse(temp_as));
-                            return Expr(new Define(name, new Lambda(parameters,new Begin(temp_ls))));
-                        }
-                    }
-                }
-                case E_LET: {
-                    if (stxs.size() < 3) throw(RuntimeError("Wrong format in Let"));
-                    if (dynamic_cast<List *>(stxs[1].get())) {
-                        List *temp_ls = dynamic_cast<List *>(stxs[1].get());
-                        vector<pair<string, Expr> > parameters;
-                        parameters.clear();
-                        Assoc temp_env = env;
-                        for (int i = 0; i < temp_ls->stxs.size(); i++) {
-                            List *temp_lst = dynamic_cast<List *>(temp_ls->stxs[i].get());
-                            if (temp_lst != nullptr && temp_lst->stxs.size() == 2) {
-                                if (dynamic_cast<SymbolSyntax *>(temp_lst->stxs[0].get())) {
-                                    parameters.push_back({
-                                        dynamic_cast<SymbolSyntax *>(temp_lst->stxs[0].get())->s,
-                                        temp_lst->stxs[1]->parse(env)
-                                    });
-                                    temp_env = extend(dynamic_cast<SymbolSyntax *>(temp_lst->stxs[0].get())->s, VoidV(),
-                                                      temp_env);
-                                } else throw(RuntimeError("Wrong in Let"));
-                            } else throw(RuntimeError("Wrong in Let's parameters"));
-                        }
-                        Expr e = nullptr;
-                        vector<Expr> temp;
-                        temp.clear();
-                        if (stxs.size() == 3)e = stxs[2]->parse(temp_env);
-                        else {
-                            for (int i = 2; i < stxs.size(); i++)temp.push_back(stxs[i]->parse(temp_env));
-                            e = Expr(new Begin(temp));
-                        }
-                        return Expr(new Let(parameters, e));
-                    } else throw (RuntimeError("Wrong in Let"));
-                }
-                case E_LETREC: {
-                    if (stxs.size() != 3) throw(RuntimeError("Wrong format in Letrec"));
-                    if (dynamic_cast<List *>(stxs[1].get())) {
-                        List *temp_ls = dynamic_cast<List *>(stxs[1].get());
-                        vector<pair<string, Expr> > parameters;
-                        parameters.clear();
-
-                        // First collect all names and create a temporary env with placeholders
-                        Assoc temp_env = env;
-                        for (int i = 0; i < temp_ls->stxs.size(); i++) {
-                            List *temp_lst = dynamic_cast<List *>(temp_ls->stxs[i].get());
-                            if (temp_lst != nullptr && temp_lst->stxs.size() == 2) {
-                                if (dynamic_cast<SymbolSyntax *>(temp_lst->stxs[0].get())) {
-                                    string name = dynamic_cast<SymbolSyntax *>(temp_lst->stxs[0].get())->s;
-                                    // add placeholder so that bindings can refer to each other during parsing
-                                    temp_env = extend(name, VoidV(), temp_env);
-                                } else throw(RuntimeError("Wrong in Letrec"));
-                            } else throw(RuntimeError("Wrong in Letrec's parameters"));
-                        }
-                        for (int i = 0; i < temp_ls->stxs.size(); i++) {
-                            List *temp_lst = dynamic_cast<List *>(temp_ls->stxs[i].get());
-                            string name = dynamic_cast<SymbolSyntax *>(temp_lst->stxs[0].get())->s;
-                            Expr rhs = temp_lst->stxs[1]->parse(temp_env);
-                            parameters.push_back({name, rhs});
-                        }
-                        Expr e = nullptr;
-                        vector<Expr> temp;
-                        temp.clear();
-                        if (stxs.size() == 3) e = stxs[2]->parse(temp_env);
-                        else {
-                            for (int i = 2; i < stxs.size(); i++) temp.push_back(stxs[i]->parse(temp_env));
-                            e = Expr(new Begin(temp));
-                        }
-                        return Expr(new Letrec(parameters, e));
-                    } else throw (RuntimeError("Wrong in Letrec"));
-                }
-                case E_SET: {
-                    if (stxs.size() != 3) throw(RuntimeError("Wrong format in Set"));
-                    if (dynamic_cast<SymbolSyntax *>(stxs[1].get())) {
-                        string name = dynamic_cast<SymbolSyntax *>(stxs[1].get())->s;
-                        if (find(name, env).get() != nullptr)return Expr(new Set(name, stxs[2]->parse(env)));
-                        else throw(RuntimeError("Undefined var"));
-                    } else throw(RuntimeError("Wrong in Set"));
-                }
-                default:
-                    throw RuntimeError("Unknown reserved word: " + op);
-            }
-        }
-        vector<Expr> parameters;
-        parameters.clear();
-        for (int i = 1; i < stxs.size(); i++)parameters.push_back(stxs[i]->parse(env));
-        return Expr(new Apply(new Var(dynamic_cast<SymbolSyntax *>(stxs[0].get())->s), parameters));
-        //default: use Apply to be an expression
-        //TODO: TO COMPLETE THE PARSER LOGIC
-        throw(RuntimeError("Unable to parse: " + op));
-    }
-}
+/**
+ * @file parser.cpp
+ * @brief Parsing implementation for Scheme syntax tree to expression tree conversion
+ * 
+ * This file implements the parsing logic that converts syntax trees into
+ * expression trees that can be evaluated.
+ * primitive operations, and function applications.
+ */
+
+#include "RE.hpp"
+#include "Def.hpp"
+#include "syntax.hpp"
+#include "value.hpp"
+#include "expr.hpp"
+#include <map>
+#include <string>
+#include <iostream>
+
+#define mp make_pair
+using std::string;
+using std::vector;
+using std::pair;
+
+
+/**
+ * @brief Default parse method (should be overridden by subclasses)
+ */
+Expr Syntax::parse(Assoc &env) {
+    throw RuntimeError("Unimplemented parse method");
+}
+
+Expr Number::parse(Assoc &env) {
+    return Expr(new Fixnum(n));
+}
+
+Expr RationalSyntax::parse(Assoc &env) {
+    return Expr(new RationalNum(numerator, denominator));
+}
+
+bool try_parse_as_number(const std::string &);
+
+/**
+ * @brief Classifies an identifier once, so that evaluation never inspects names
+ *
+ * The first character of a variable name cannot be a digit or one of {.@},
+ * a name that reads as a number is that number, and #, ', " and ` may not
+ * appear anywhere. A primitive or reserved word not shadowed by a local
+ * binding refers to the built-in procedure.
+ */
+Expr SymbolSyntax::parse(Assoc &env) {
+    const string &name = *s;
+    if (name.empty() || name[0] == '.' || name[0] == '@' || isdigit(static_cast<unsigned char>(name[0])))
+        return Expr(new InvalidVar(s));
+    if (try_parse_as_number(name)) {
+        bool neg = false;
+        int n = 0;
+        int i = 0;
+        if (name[0] == '-') {
+            i += 1;
+            neg = true;
+        } else if (name[0] == '+') {
+            i += 1;
+        }
+        for (; i < (int) name.size(); i++) {
+            if (isdigit(name[i])) n = n * 10 + name[i] - '0';
+        }
+        return Expr(new Fixnum(neg ? -n : n));
+    }
+    if (name.find_first_of("#'\"`") != string::npos) return Expr(new InvalidVar(s));
+    if (find(s, env).get() == nullptr && findBuiltin(name) != nullptr)
+        return Expr(new PrimitiveVar(s));
+    return Expr(new Var(s));
+}
+
+Expr StringSyntax::parse(Assoc &env) {
+    return Expr(new StringExpr(s));
+}
+
+Expr TrueSyntax::parse(Assoc &env) {
+    return Expr(new True());
+}
+
+Expr FalseSyntax::parse(Assoc &env) {
+    return Expr(new False());
+}
+
+/**
+ * @brief Collects the calls of a named let's name in ex, part of its body
+ * and in tail position of it if tail is set
+ *
+ * Fails if the name is used any other way: called with other than n
+ * operands or out of tail position, used as a value, rebound or assigned.
+ * Everything inside a lambda is out of tail position.
+ */
+static bool loopCalls(Expr &ex, Sym name, int n, bool tail, vector<Expr *> &calls) {
+    switch (ex->e_type) {
+        case E_VAR:
+            return static_cast<Var *>(ex.get())->x != name;
+        case E_APPLY: {
+            Apply *a = static_cast<Apply *>(ex.get());
+            for (Expr &i : a->rand)
+                if (!loopCalls(i, name, n, false, calls)) return false;
+            if (a->rator->e_type == E_VAR && static_cast<Var *>(a->rator.get())->x == name) {
+                if (!tail || a->rand.size() != n) return false;
+                calls.push_back(&ex);
+                return true;
+            }
+            return loopCalls(a->rator, name, n, false, calls);
+        }
+        case E_IF: {
+            If *i = static_cast<If *>(ex.get());
+            return loopCalls(i->cond, name, n, false, calls) && loopCalls(i->conseq, name, n, tail, calls) &&
+                   loopCalls(i->alter, name, n, tail, calls);
+        }
+        case E_COND: {
+            for (vector<Expr> &clause : static_cast<Cond *>(ex.get())->clauses)
+                for (int j = 0; j < clause.size(); j++)
+                    if (!loopCalls(clause[j], name, n, tail && j > 0 && j + 1 == clause.size(), calls)) return false;
+            return true;
+        }
+        case E_AND:
+        case E_OR:
+        case E_BEGIN: {
+            vector<Expr> &es = ex->e_type == E_AND ? static_cast<AndVar *>(ex.get())->rands
+                             : ex->e_type == E_OR ? static_cast<OrVar *>(ex.get())->rands
+                             : static_cast<Begin *>(ex.get())->es;
+            for (int j = 0; j < es.size(); j++)
+                if (!loopCalls(es[j], name, n, tail && j + 1 == es.size(), calls)) return false;
+            return true;
+        }
+        case E_LET:
+        case E_LOOP: {
+            Let *l = static_cast<Let *>(ex.get());
+            for (pair<Sym, Expr> &b : l->bind)
+                if (b.first == name || !loopCalls(b.second, name, n, false, calls)) return false;
+            return loopCalls(l->body, name, n, tail, calls);
+        }
+        case E_LETREC: {
+            Letrec *l = static_cast<Letrec *>(ex.get());
+            for (pair<Sym, Expr> &b : l->bind)
+                if (b.first == name || !loopCalls(b.second, name, n, false, calls)) return false;
+            return loopCalls(l->body, name, n, tail, calls);
+        }
+        case E_DEFINE:
+            if (static_cast<Define *>(ex.get())->var == name) return false;
+            return loopCalls(static_cast<Define *>(ex.get())->e, name, n, false, calls);
+        case E_SET:
+            if (static_cast<Set *>(ex.get())->var == name) return false;
+            return loopCalls(static_cast<Set *>(ex.get())->e, name, n, false, calls);
+        default: {
+            vector<Expr *> sub;
+            ex->subexprs(sub);
+            for (Expr *i : sub)
+                if (!loopCalls(*i, name, n, false, calls)) return false;
+            return true;
+        }
+    }
+}
+
+/**
+ * @brief A named let: a Loop when the body only calls its name from its
+ * tail, otherwise a letrec binding the name to a procedure called at once
+ */
+static Expr namedLet(Sym name, const vector<pair<Sym, Expr> > &bind, const Expr &body) {
+    Loop *loop = new Loop(bind, body);
+    Expr ex(loop);
+    vector<Expr *> calls;
+    if (loopCalls(loop->body, name, bind.size(), true, calls)) {
+        for (Expr *c : calls) *c = Expr(new Recur(loop, static_cast<Apply *>(c->get())->rand));
+        return ex;
+    }
+    vector<Sym> parameters;
+    vector<Expr> inits;
+    for (const pair<Sym, Expr> &b : bind) {
+        parameters.push_back(b.first);
+        inits.push_back(b.second);
+    }
+    Lambda *lam = new Lambda(parameters, body);
+    lam->name = name;
+    return Expr(new Apply(Expr(new Letrec({{name, Expr(lam)}}, Expr(new Var(name)))), inits));
+}
+
+Expr List::parse(Assoc &env) {
+    if (stxs.empty()) {
+        return Expr(new Quote(Syntax(new List())));
+    }
+    //TODO: check if the first element is a symbol
+    //If not, use Apply function to package to a closure;
+    //If so, find whether it's a variable or a keyword;
+    SymbolSyntax *id = asSymbol(stxs[0]);
+    if (id == nullptr) {
+        //TODO: TO COMPLETE THE LOGIC
+        vector<Expr> listed;
+        listed.clear();
+        Expr ex = stxs[0]->parse(env);
+        if (stxs.size()==1) {
+            return Expr(new Apply(ex,listed));
+        }
+        if (stxs.size() >= 2) {
+            for (int i = 1; i < stxs.size(); i++)listed.push_back(stxs[i]->parse(env));
+            return Expr(new Apply(ex, listed));
+        }
+        throw(RuntimeError("Unable to parse"));
+    } else {
+        string op = *id->s;
+        if (find(id->s, env).get() != nullptr) {
+            Value found = find(id->s, env);
+            if (found.get() != nullptr) {
+                vector<Expr> parameters;
+                for (int i = 1; i < stxs.size(); ++i) {
+                    parameters.push_back(stxs[i]->parse(env));
+                }
+                Expr e = stxs[0]->parse(env);
+                return Expr(new Apply(e, parameters));
+            }
+            //TODO: TO COMPLETE THE PARAMETER PARSER LOGIC
+        }
+        const Builtin *builtin = findBuiltin(op);
+        if (builtin != nullptr && builtin->make != nullptr) {
+            vector<Expr> parameters;
+            for (int i = 1; i < stxs.size(); i++)parameters.push_back(stxs[i]->parse(env));
+            int n = parameters.size();
+            if (n < builtin->min_args || (builtin->max_args >= 0 && n > builtin->max_args))
+                throw(RuntimeError("Wrong number of arguments for " + op));
+            return builtin->make(parameters);
+        }
+        if (builtin != nullptr) {
+            switch (builtin->type) {
+                case E_QUOTE: {
+                    if (stxs.size() == 2)return Expr(new Quote(stxs[1]));
+                    else throw(RuntimeError("Wrong expr numbers in Quote"));
+                }
+                case E_BEGIN: {
+                    vector<Expr> temp;
+                    temp.clear();
+                    for (int i = 1; i < stxs.size(); i++)temp.emplace_back(stxs[i]->parse(env));
+                    return Expr(new Begin(temp));
+                }
+                case E_IF: {
+                    if (stxs.size() == 4)
+                        return Expr(new If(stxs[1]->parse(env), stxs[2]->parse(env),
+                                           stxs[3]->parse(env)));
+                    throw ("Wrong in IF");
+                }
+                case E_COND: {
+                    vector<vector<Expr> > temp;
+                    temp.clear();
+                    for (int i = 1; i < stxs.size(); i++) {
+                        if (asList(stxs[i])) {
+                            vector<Expr> tep;
+                            tep.clear();
+                            List *temp_ls = asList(stxs[i]);
+                            if (asSymbol(temp_ls->stxs[0]) && asSymbol(temp_ls->stxs[0])->s == intern("else"))
+                                tep.push_back(Expr(new True));
+                            else tep.push_back(temp_ls->stxs[0]->parse(env));
+                            for (int j = 1; j < temp_ls->stxs.size(); j++)tep.push_back(temp_ls->stxs[j]->parse(env));
+                            temp.push_back(tep);
+                        } else throw (RuntimeError("Wrong in Cond"));
+                    }
+                    return Expr(new Cond(temp));
+                }
+                case E_LAMBDA: {
+                    if (stxs.size() >= 3) {
+                        if (asList(stxs[1])) {
+                            List *temp_ls = asList(stxs[1]);
+                            vector<Sym> parameters;
+                            parameters.clear();
+                            Assoc temp_as = env;
+                            for (int i = 0; i < temp_ls->stxs.size(); i++) {
+                                if (asSymbol(temp_ls->stxs[i])) {
+                                    parameters.push_back(asSymbol(temp_ls->stxs[i])->s);
+                                    temp_as = extend(parameters.back(), VoidV(), temp_as);
+                                } else throw(RuntimeError("Wrong in Lambda"));
+                            }
+                            Expr e = nullptr;
+                            vector<Expr> temp;
+                            temp.clear();
+                            if (stxs.size() == 3)e = stxs[2]->parse(temp_as);
+                            else {
+                                for (int i = 2; i < stxs.size(); i++)temp.push_back(stxs[i]->parse(temp_as));
+                                e = Expr(new Begin(temp));
+                            }
+                            return Expr(new Lambda(parameters, e));
+                        } else throw(RuntimeError("Wrong format in Lambada"));
+                    } else throw(RuntimeError("Wrong format in Lambada"));
+                }
+                case E_DEFINE: {
+                    if (stxs.size() < 3) throw(RuntimeError("Wrong format in Define"));
+                    if (asSymbol(stxs[1])) {
+                        Sym name = asSymbol(stxs[1])->s;
+                        env = extend(name, VoidV(), env);
+                        Expr ex=stxs[2]->parse(env);
+                        if (stxs.size() == 3)return Expr(new Define(name, ex));
+                        else throw(RuntimeError("Couldn't bind several procedures to a VAR identifier"));
+                    }
+                    if (asList(stxs[1])) {
+                        List *stx1_ls = asList(stxs[1]);
+                        Sym name;
+                        if (asSymbol(stx1_ls->stxs[0]))
+                            name = asSymbol(stx1_ls->stxs[0])->s;
+                        else throw(RuntimeError("Wrong in Define a Procedure"));
+                        vector<Sym> parameters;
+                        parameters.clear();
+                        Assoc temp_as = env;
+                        temp_as= extend(name, VoidV(), temp_as);
+                        for (int i = 1; i < stx1_ls->stxs.size(); i++) {
+                            if (asSymbol(stx1_ls->stxs[i])) {
+                                parameters.push_back(asSymbol(stx1_ls->stxs[i])->s);
+                                temp_as = extend(parameters.back(), VoidV(), temp_as);
+                            } else throw(RuntimeError("Wrong in Define a Procedure"));
+                        }
+                        if (stxs.size() == 3)return Expr(new Define(name, new Lambda(parameters,stxs[2]->parse(temp_as))));
+                        else {
+                            vector<Expr> temp_ls;
+                            temp_ls.clear();
+                            for (int i = 2; i < stxs.size(); i++)temp_ls.emplace_back(stxs[i]->parse(temp_as));
+                            return Expr(new Define(name, new Lambda(parameters,new Begin(temp_ls))));
+                        }
+                    }
+                }
+                case E_LET: {
+                    if (stxs.size() < 3) throw(RuntimeError("Wrong format in Let"));
+                    if (asSymbol(stxs[1])) {
+                        // named let: the name is bound in the body only
+                        if (stxs.size() < 4 || !asList(stxs[2])) throw(RuntimeError("Wrong format in Let"));
+                        Sym name = asSymbol(stxs[1])->s;
+                        List *temp_ls = asList(stxs[2]);
+                        vector<pair<Sym, Expr> > parameters;
+                        Assoc temp_env = extend(name, VoidV(), env);
+                        for (int i = 0; i < temp_ls->stxs.size(); i++) {
+                            List *temp_lst = asList(temp_ls->stxs[i]);
+                            if (temp_lst == nullptr || temp_lst->stxs.size() != 2 || !asSymbol(temp_lst->stxs[0]))
+                                throw(RuntimeError("Wrong in Let's parameters"));
+                            parameters.push_back({asSymbol(temp_lst->stxs[0])->s, temp_lst->stxs[1]->parse(env)});
+                            temp_env = extend(parameters.back().first, VoidV(), temp_env);
+                        }
+                        Expr e = nullptr;
+                        if (stxs.size() == 4) e = stxs[3]->parse(temp_env);
+                        else {
+                            vector<Expr> temp;
+                            for (int i = 3; i < stxs.size(); i++) temp.push_back(stxs[i]->parse(temp_env));
+                            e = Expr(new Begin(temp));
+                        }
+                        return namedLet(name, parameters, e);
+                    }
+                    if (asList(stxs[1])) {
+                        List *temp_ls = asList(stxs[1]);
+                        vector<pair<Sym, Expr> > parameters;
+                        parameters.clear();
+                        Assoc temp_env = env;
+                        for (int i = 0; i < temp_ls->stxs.size(); i++) {
+                            List *temp_lst = asList(temp_ls->stxs[i]);
+                            if (temp_lst != nullptr && temp_lst->stxs.size() == 2) {
+                                if (asSymbol(temp_lst->stxs[0])) {
+                                    parameters.push_back({
+                                        asSymbol(temp_lst->stxs[0])->s,
+                                        temp_lst->stxs[1]->parse(env)
+                                    });
+                                    temp_env = extend(asSymbol(temp_lst->stxs[0])->s, VoidV(),
+                                                      temp_env);
+                                } else throw(RuntimeError("Wrong in Let"));
+                            } else throw(RuntimeError("Wrong in Let's parameters"));
+                        }
+                        Expr e = nullptr;
+                        vector<Expr> temp;
+                        temp.clear();
+                        if (stxs.size() == 3)e = stxs[2]->parse(temp_env);
+                        else {
+                            for (int i = 2; i < stxs.size(); i++)temp.push_back(stxs[i]->parse(temp_env));
+                            e = Expr(new Begin(temp));
+                        }
+                        return Expr(new Let(parameters, e));
+                    } else throw (RuntimeError("Wrong in Let"));
+                }
+                case E_LETREC: {
+                    if (stxs.size() != 3) throw(RuntimeError("Wrong format in Letrec"));
+                    if (asList(stxs[1])) {
+                        List *temp_ls = asList(stxs[1]);
+                        vector<pair<Sym, Expr> > parameters;
+                        parameters.clear();
+
+                        // First collect all names and create a temporary env with placeholders
+                        Assoc temp_env = env;
+                        for (int i = 0; i < temp_ls->stxs.size(); i++) {
+                            List *temp_lst = asList(temp_ls->stxs[i]);
+                            if (temp_lst != nullptr && temp_lst->stxs.size() == 2) {
+                                if (asSymbol(temp_lst->stxs[0])) {
+                                    Sym name = asSymbol(temp_lst->stxs[0])->s;
+                                    // add placeholder so that bindings can refer to each other during parsing
+                                    temp_env = extend(name, VoidV(), temp_env);
+                                } else throw(RuntimeError("Wrong in Letrec"));
+                            } else throw(RuntimeError("Wrong in Letrec's parameters"));
+                        }
+                        for (int i = 0; i < temp_ls->stxs.size(); i++) {
+                            List *temp_lst = asList(temp_ls->stxs[i]);
+                            Sym name = asSymbol(temp_lst->stxs[0])->s;
+                            Expr rhs = temp_lst->stxs[1]->parse(temp_env);
+                            parameters.push_back({name, rhs});
+                        }
+                        Expr e = nullptr;
+                        vector<Expr> temp;
+                        temp.clear();
+                        if (stxs.size() == 3) e = stxs[2]->parse(temp_env);
+                        else {
+                            for (int i = 2; i < stxs.size(); i++) temp.push_back(stxs[i]->parse(temp_env));
+                            e = Expr(new Begin(temp));
+                        }
+                        return Expr(new Letrec(parameters, e));
+                    } else throw (RuntimeError("Wrong in Letrec"));
+                }
+                case E_LOOP: {
+                    // (do ((var init step) ...) (test expr ...) command ...)
+                    if (stxs.size() < 3 || !asList(stxs[1]) || !asList(stxs[2]) || asList(stxs[2])->stxs.empty())
+                        throw(RuntimeError("Wrong format in Do"));
+                    List *specs = asList(stxs[1]);
+                    vector<pair<Sym, Expr> > parameters;
+                    Assoc temp_env = env;
+                    for (int i = 0; i < specs->stxs.size(); i++) {
+                        List *spec = asList(specs->stxs[i]);
+                        if (spec == nullptr || spec->stxs.size() < 2 || spec->stxs.size() > 3 || !asSymbol(spec->stxs[0]))
+                            throw(RuntimeError("Wrong in Do's variables"));
+                        parameters.push_back({asSymbol(spec->stxs[0])->s, spec->stxs[1]->parse(env)});
+                        temp_env = extend(parameters.back().first, VoidV(), temp_env);
+                    }
+                    // a variable without step keeps its value
+                    vector<Expr> steps;
+                    for (int i = 0; i < specs->stxs.size(); i++) {
+                        List *spec = asList(specs->stxs[i]);
+                        if (spec->stxs.size() == 3) steps.push_back(spec->stxs[2]->parse(temp_env));
+                        else steps.push_back(Expr(new Var(parameters[i].first)));
+                    }
+                    List *exit = asList(stxs[2]);
+                    Expr test = exit->stxs[0]->parse(temp_env);
+                    vector<Expr> result;
+                    for (int i = 1; i < exit->stxs.size(); i++) result.push_back(exit->stxs[i]->parse(temp_env));
+                    vector<Expr> commands;
+                    for (int i = 3; i < stxs.size(); i++) commands.push_back(stxs[i]->parse(temp_env));
+                    Loop *loop = new Loop(parameters, nullptr);
+                    Expr ex(loop);
+                    commands.push_back(Expr(new Recur(loop, steps)));
+                    Expr done = result.empty() ? Expr(new MakeVoid())
+                              : result.size() == 1 ? result[0] : Expr(new Begin(result));
+                    Expr next = commands.size() == 1 ? commands[0] : Expr(new Begin(commands));
+                    loop->body = Expr(new If(test, done, next));
+                    return ex;
+                }
+                case E_SET: {
+                    if (stxs.size() != 3) throw(RuntimeError("Wrong format in Set"));
+                    if (asSymbol(stxs[1])) {
+                        Sym name = asSymbol(stxs[1])->s;
+                        if (find(name, env).get() != nullptr)return Expr(new Set(name, stxs[2]->parse(env)));
+                        else throw(RuntimeError("Undefined var"));
+                    } else throw(RuntimeError("Wrong in Set"));
+                }
+                default:
+                    throw RuntimeError("Unknown reserved word: " + op);
+            }
+        }
+        vector<Expr> parameters;
+        parameters.clear();
+        for (int i = 1; i < stxs.size(); i++)parameters.push_back(stxs[i]->parse(env));
+        return Expr(new Apply(stxs[0]->parse(env), parameters));
+        //default: use Apply to be an expression
+        //TODO: TO COMPLETE THE PARSER LOGIC
+        throw(RuntimeError("Unable to parse: " + op));
+    }
+}
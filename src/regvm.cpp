@@ -0,0 +1,934 @@
+/**
+ * @file regvm.cpp
+ * @brief Register machine: bytecode over the numbered registers of a call
+ *
+ * Like the stack VM of vm.cpp, evalReg compiles a resolved expression tree
+ * to bytecode, and a Lambda keeps its compiled body once called. Here the
+ * operands of an instruction name registers of the running call instead
+ * of stack slots: the parameters are registers 0 to n - 1, the procedure
+ * itself register n, and the bindings of let, letrec and internal defines
+ * as well as intermediate values the registers after them. A parameter or
+ * local used as an operand is read where it lives, without an instruction
+ * to fetch it.
+ *
+ * The registers of all pending calls are windows of one register file.
+ * A call evaluates its operator and operands into consecutive registers,
+ * and the operands become the parameter registers of the callee's window.
+ *
+ * A comparison or null? testing an if or cond clause compiles to one
+ * instruction that branches on its operands, and an AddImm to one adding
+ * its literal, so that neither builds a value only to inspect it.
+ *
+ * Dispatch is by computed goto: once a chunk is compiled, the opcode of
+ * each instruction is replaced by the address of its handler in execute
+ * (direct threading).
+ *
+ * A body holding a form the compiler does not handle is run by the tree
+ * walker instead, in an ordinary frame.
+ *
+ * call/ec calls its procedure like any call, with an escape continuation
+ * holding the number of pending calls; resuming it drops the calls made
+ * since and returns from the call/ec's own.
+ */
+
+#include "Def.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include "RE.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Instructions; d is the register receiving the value
+ */
+enum RegOp {
+    I_MOVE,        ///< d s: copy a register
+    I_CONST,       ///< d k: consts[k]
+    I_GLOBAL,      ///< d k: the global read by GlobalVar nodes[k]
+    I_GLOBALPROC,  ///< d k: same, failing unless it holds a procedure
+    I_EVAL,        ///< d k: nodes[k]->eval, for leaves
+    I_UNBOX,       ///< d s: content of the Box in s
+    I_CAPTURED,    ///< d s k: free variable k of the procedure in s
+    I_CAPTUREDBOX, ///< d s k: content of the Box in that free variable
+    I_BOX,         ///< r: put r in a new Box
+    I_SETBOX,      ///< r s: store s in the Box in r
+    I_CHECKPROC,   ///< r: fail unless r holds a procedure
+    I_JUMP,        ///< target
+    I_JUMPF,       ///< r target: jump if r is #f
+    I_JUMPT,       ///< r target: jump unless r is #f
+    I_INLINED,     ///< k target: jump unless Inline nodes[k] is current
+    I_JUMPNLT,     ///< a b k target: jump unless a < b, through Binary nodes[k] unless both are fixnums
+    I_JUMPNLE,     ///< a b k target: jump unless a <= b, same
+    I_JUMPNEQ,     ///< a b k target: jump unless a = b, same
+    I_JUMPNGE,     ///< a b k target: jump unless a >= b, same
+    I_JUMPNGT,     ///< a b k target: jump unless a > b, same
+    I_JUMPNNULL,   ///< r target: jump unless r is the empty list
+    I_ADD,         ///< d a b k: a + b, through Binary nodes[k] unless both are fixnums
+    I_SUB,         ///< d a b k: a - b, same
+    I_MUL,         ///< d a b k: a * b, same
+    I_LT,          ///< d a b k: a < b, same
+    I_LE,          ///< d a b k: a <= b, same
+    I_EQ,          ///< d a b k: a = b, same
+    I_GE,          ///< d a b k: a >= b, same
+    I_GT,          ///< d a b k: a > b, same
+    I_ADDI,        ///< d a i k: a + i, through AddImm nodes[k] unless a is a fixnum
+    I_PRIM,        ///< d a n k: nodes[k]->applyRator on a to a + n - 1
+    I_CLOSURE,     ///< d k a: closure of Lambda nodes[k], free variables from a on
+    I_CALL,        ///< a n d: call a with a + 1 to a + n
+    I_TAILCALL,    ///< a n: same, in place of the running call
+    I_RET,         ///< r: return r to the pending call
+    I_CALLEC,      ///< a n d: I_CALL, with an escape continuation in a + 1 returning to the next instruction
+    I_ENDEC,       ///< the innermost escape continuation dies
+    I_PREPARE,     ///< k: Define::prepare of nodes[k]
+    I_DEFINE,      ///< d k s: Define::store of nodes[k], a global, with s
+    I_SET,         ///< d k s: Set::store of nodes[k], a global, with s
+    I_FAIL,        ///< k: raise consts[k], a string
+    I_COUNT
+};
+
+// Operands following each opcode
+static const int operands[I_COUNT] = {
+    2, 2, 2, 2, 2, 2, 3, 3, 1, 2, 1, // I_MOVE to I_CHECKPROC
+    1, 2, 2, 2, 4, 4, 4, 4, 4, 2,    // jumps
+    4, 4, 4, 4, 4, 4, 4, 4, 4,       // I_ADD to I_ADDI
+    4, 3, 3, 2, 1, 3, 0, 1, 3, 3, 1  // I_PRIM to I_FAIL
+};
+
+/**
+ * @brief Compiled code of a procedure body or top-level form
+ */
+struct RegChunk {
+    std::vector<intptr_t> code;    ///< Opcodes are handler addresses once compiled
+    std::vector<Value> consts;
+    std::vector<ExprBase *> nodes; ///< Nodes the code refers to, owned by the tree
+    int size = 0;                  ///< Registers of a call's window
+    bool compiled = false;         ///< Unset when the tree walker runs the body
+};
+
+// Raised by the compiler on a form it leaves to the tree walker
+struct Unsupported {};
+
+static Value execute(const RegChunk *, std::vector<Value> &, size_t);
+
+// Handler addresses, by opcode, published by execute
+static const void *const *handlers = nullptr;
+
+// ============================================================================
+// Compiler
+// ============================================================================
+
+// Whether evaluating ex may assign a local variable of the running call
+static bool assigns(ExprBase *ex) {
+    if (ex->e_type == E_SET || ex->e_type == E_DEFINE) return true;
+    if (ex->e_type == E_LAMBDA) return false;
+    std::vector<Expr *> kids;
+    ex->subexprs(kids);
+    for (Expr *i : kids)
+        if (assigns(i->get())) return true;
+    return false;
+}
+
+struct RegCompiler {
+    RegChunk &ch;
+    std::vector<std::vector<int> > frames; ///< Registers of the frames resolution addresses, innermost last
+    std::vector<std::pair<Loop *, int> > loops; ///< Loops being compiled, and where their body starts
+    int top;                               ///< First free register
+
+    explicit RegCompiler(RegChunk &ch) : ch(ch), top(0) {}
+
+    void emit(std::initializer_list<intptr_t> xs) { ch.code.insert(ch.code.end(), xs); }
+
+    // Reserves n consecutive registers
+    int alloc(int n) {
+        int r = top;
+        top += n;
+        ch.size = std::max(ch.size, top);
+        return r;
+    }
+
+    int constant(const Value &v) {
+        ch.consts.push_back(v);
+        return ch.consts.size() - 1;
+    }
+
+    int node(ExprBase *x) {
+        ch.nodes.push_back(x);
+        return ch.nodes.size() - 1;
+    }
+
+    // Emits a jump testing r, unless op is I_JUMP; returns its target field
+    int jump(RegOp op, int r) {
+        if (op == I_JUMP) emit({op, -1});
+        else emit({op, r, -1});
+        return ch.code.size() - 1;
+    }
+
+    void land(int at) { ch.code[at] = ch.code.size(); }
+
+    void fail(const char *message) { emit({I_FAIL, constant(StringV(message))}); }
+
+    // Register of the binding at a lexical address of the running call
+    int reg(int depth, int slot) { return frames[frames.size() - 1 - depth][slot]; }
+
+    // Opens a frame of n bindings in fresh registers
+    int open(int n) {
+        int r = alloc(n);
+        std::vector<int> f;
+        for (int i = 0; i < n; i++) f.push_back(r + i);
+        frames.push_back(f);
+        return r;
+    }
+
+    // Stores s into the local binding at a
+    void store(const Address &a, bool boxed, int s) {
+        int r = reg(a.depth, a.slot);
+        if (a.captured >= 0) {
+            int t = alloc(1);
+            emit({I_CAPTURED, t, r, a.captured});
+            r = t;
+        }
+        if (boxed) emit({I_SETBOX, r, s});
+        else if (r != s) emit({I_MOVE, r, s});
+    }
+
+    int operand(ExprBase *x);
+
+    void rands(ExprBase *left, ExprBase *right, int &a, int &b);
+
+    int branch(ExprBase *x);
+
+    void compile(ExprBase *x, int d, bool tail);
+
+    void body(Lambda *lam);
+
+    void thread();
+};
+
+// A register holding the value of x: where it lives for a plain local
+int RegCompiler::operand(ExprBase *x) {
+    if (x->e_type == E_LOCALVAR && !static_cast<LocalVar *>(x)->boxed) {
+        LocalVar *v = static_cast<LocalVar *>(x);
+        return reg(v->depth, v->slot);
+    }
+    int t = alloc(1);
+    compile(x, t, false);
+    return t;
+}
+
+// Registers holding the operands of a Binary node, evaluated right operand
+// first as Binary::eval; the right one is read in place only if the left
+// one cannot assign it
+void RegCompiler::rands(ExprBase *left, ExprBase *right, int &a, int &b) {
+    if (assigns(left)) {
+        b = alloc(1);
+        compile(right, b, false);
+    } else b = operand(right);
+    a = operand(left);
+}
+
+// Comparisons with a compare-and-branch instruction
+static RegOp branchOp(ExprType t) {
+    switch (t) {
+        case E_LT: return I_JUMPNLT;
+        case E_LE: return I_JUMPNLE;
+        case E_EQ: return I_JUMPNEQ;
+        case E_GE: return I_JUMPNGE;
+        case E_GT: return I_JUMPNGT;
+        default: return I_COUNT;
+    }
+}
+
+/**
+ * @brief Emits a jump taken when the test x fails; returns its target
+ * field. Comparisons and null? branch on their operands, without building
+ * the Boolean.
+ */
+int RegCompiler::branch(ExprBase *x) {
+    std::vector<Expr *> kids;
+    x->subexprs(kids);
+    RegOp op = kids.size() == 2 ? branchOp(x->e_type) : I_COUNT;
+    if (op != I_COUNT) {
+        int a, b;
+        rands(kids[0]->get(), kids[1]->get(), a, b);
+        emit({op, a, b, node(x), -1});
+        return ch.code.size() - 1;
+    }
+    if (x->e_type == E_NULLQ) return jump(I_JUMPNNULL, operand(kids[0]->get()));
+    return jump(I_JUMPF, operand(x));
+}
+
+// Binary operators with a fixnum instruction
+static RegOp fastOp(ExprType t) {
+    switch (t) {
+        case E_PLUS: return I_ADD;
+        case E_MINUS: return I_SUB;
+        case E_MUL: return I_MUL;
+        case E_LT: return I_LT;
+        case E_LE: return I_LE;
+        case E_EQ: return I_EQ;
+        case E_GE: return I_GE;
+        case E_GT: return I_GT;
+        default: return I_COUNT;
+    }
+}
+
+/**
+ * @brief Emits code leaving the value of x in register d, and returning it
+ * if tail is set. Temporaries are released on the way out.
+ */
+void RegCompiler::compile(ExprBase *x, int d, bool tail) {
+    int saved = top;
+    switch (x->e_type) {
+        case E_FIXNUM:
+        case E_RATIONAL:
+        case E_TRUE:
+        case E_FALSE: {
+            Assoc none = empty();
+            emit({I_CONST, d, constant(x->eval(none))});
+            break;
+        }
+        case E_LOCALVAR: {
+            LocalVar *v = static_cast<LocalVar *>(x);
+            int r = reg(v->depth, v->slot);
+            if (v->boxed) emit({I_UNBOX, d, r});
+            else if (r != d) emit({I_MOVE, d, r});
+            break;
+        }
+        case E_CLOSUREVAR: {
+            ClosureVar *v = static_cast<ClosureVar *>(x);
+            emit({v->boxed ? I_CAPTUREDBOX : I_CAPTURED, d, reg(v->depth, v->slot), v->captured});
+            break;
+        }
+        case E_GLOBALVAR:
+            emit({I_GLOBAL, d, node(x)});
+            break;
+        case E_IF: {
+            If *i = static_cast<If *>(x);
+            int alter = branch(i->cond.get());
+            top = saved;
+            compile(i->conseq.get(), d, tail);
+            int end = tail ? -1 : jump(I_JUMP, 0);
+            land(alter);
+            compile(i->alter.get(), d, tail);
+            if (tail) return;
+            land(end);
+            break;
+        }
+        case E_COND: {
+            std::vector<int> ends;
+            for (std::vector<Expr> &clause : static_cast<Cond *>(x)->clauses) {
+                if (clause.empty()) {
+                    fail("No predict?");
+                    break;
+                }
+                if (clause.size() == 1) {
+                    // the value of the test is the value of the clause
+                    compile(clause[0].get(), d, false);
+                    ends.push_back(jump(I_JUMPT, d));
+                    continue;
+                }
+                int next = branch(clause[0].get());
+                top = saved;
+                for (int j = 1; j < clause.size(); j++) compile(clause[j].get(), d, tail && j + 1 == clause.size());
+                if (!tail) ends.push_back(jump(I_JUMP, 0));
+                land(next);
+            }
+            fail("Wrong in Cond");
+            for (int at : ends) land(at);
+            break;
+        }
+        case E_AND:
+        case E_OR: {
+            std::vector<Expr> &rands = x->e_type == E_AND ? static_cast<AndVar *>(x)->rands
+                                                          : static_cast<OrVar *>(x)->rands;
+            if (rands.empty()) {
+                emit({I_CONST, d, constant(BooleanV(x->e_type == E_AND))});
+                break;
+            }
+            std::vector<int> ends;
+            for (int i = 0; i + 1 < rands.size(); i++) {
+                compile(rands[i].get(), d, false);
+                ends.push_back(jump(x->e_type == E_AND ? I_JUMPF : I_JUMPT, d));
+            }
+            compile(rands.back().get(), d, tail);
+            if (tail && ends.empty()) return;
+            for (int at : ends) land(at);
+            break;
+        }
+        case E_BEGIN: {
+            Begin *b = static_cast<Begin *>(x);
+            if (b->es.empty()) {
+                emit({I_CONST, d, constant(VoidV())});
+                break;
+            }
+            if (!b->defs.empty()) {
+                // internal defines get fresh bindings, filled in by their define
+                int r = open(b->defs.size());
+                for (int i = 0; i < b->defs.size(); i++) {
+                    emit({I_CONST, r + i, constant(NullV())});
+                    if (b->boxed[i]) emit({I_BOX, r + i});
+                }
+            }
+            for (int i = 0; i < b->es.size(); i++) compile(b->es[i].get(), d, tail && i + 1 == b->es.size());
+            if (!b->defs.empty()) frames.pop_back();
+            top = saved;
+            if (tail) return;
+            break;
+        }
+        case E_APPLY: {
+            Apply *a = static_cast<Apply *>(x);
+            int n = a->rand.size();
+            // operator, operands and the callee's procedure register
+            int f = alloc(n + 2);
+            if (a->rator->e_type == E_GLOBALVAR) emit({I_GLOBALPROC, f, node(a->rator.get())});
+            else {
+                compile(a->rator.get(), f, false);
+                emit({I_CHECKPROC, f});
+            }
+            for (int i = 0; i < n; i++) compile(a->rand[i].get(), f + 1 + i, false);
+            top = saved;
+            if (tail) {
+                emit({I_TAILCALL, f, n});
+                return;
+            }
+            emit({I_CALL, f, n, d});
+            break;
+        }
+        case E_INLINE: {
+            Inline *in = static_cast<Inline *>(x);
+            emit({I_INLINED, node(x), -1});
+            int call = ch.code.size() - 1;
+            compile(in->body.get(), d, tail);
+            int end = tail ? -1 : jump(I_JUMP, 0);
+            land(call);
+            compile(in->call.get(), d, tail);
+            if (tail) return;
+            land(end);
+            break;
+        }
+        case E_DEFINE: {
+            Define *df = static_cast<Define *>(x);
+            int k = node(x);
+            emit({I_PREPARE, k});
+            int s = operand(df->e.get());
+            if (df->addr.depth < 0) emit({I_DEFINE, d, k, s});
+            else {
+                store(df->addr, df->boxed, s);
+                emit({I_CONST, d, constant(NonereturnV())});
+            }
+            break;
+        }
+        case E_SET: {
+            Set *st = static_cast<Set *>(x);
+            int s = operand(st->e.get());
+            if (st->addr.depth < 0) emit({I_SET, d, node(x), s});
+            else {
+                store(st->addr, st->boxed, s);
+                emit({I_CONST, d, constant(VoidV())});
+            }
+            break;
+        }
+        case E_LET:
+        case E_LOOP: {
+            Let *l = static_cast<Let *>(x);
+            int n = l->bind.size();
+            int r = alloc(n);
+            for (int i = 0; i < n; i++) {
+                compile(l->bind[i].second.get(), r + i, false);
+                if (l->boxed[i]) emit({I_BOX, r + i});
+            }
+            std::vector<int> f;
+            for (int i = 0; i < n; i++) f.push_back(r + i);
+            frames.push_back(f);
+            if (x->e_type == E_LOOP) loops.push_back({static_cast<Loop *>(x), (int) ch.code.size()});
+            compile(l->body.get(), d, tail);
+            if (x->e_type == E_LOOP) loops.pop_back();
+            frames.pop_back();
+            top = saved;
+            if (tail) return;
+            break;
+        }
+        case E_LETREC: {
+            Letrec *l = static_cast<Letrec *>(x);
+            int r = open(l->bind.size());
+            for (int i = 0; i < l->bind.size(); i++) {
+                emit({I_CONST, r + i, constant(NullV())});
+                if (l->boxed[i]) emit({I_BOX, r + i});
+            }
+            for (int i = 0; i < l->bind.size(); i++) {
+                int t = alloc(1);
+                compile(l->bind[i].second.get(), t, false);
+                if (l->boxed[i]) emit({I_SETBOX, r + i, t});
+                else emit({I_MOVE, r + i, t});
+            }
+            compile(l->body.get(), d, tail);
+            frames.pop_back();
+            top = saved;
+            if (tail) return;
+            break;
+        }
+        case E_ADDI: {
+            AddImm *p = static_cast<AddImm *>(x);
+            emit({I_ADDI, d, operand(p->rand1.get()), p->k, node(x)});
+            break;
+        }
+        case E_RECUR: {
+            // the next values go to the loop's registers, and the body
+            // starts over
+            Recur *rc = static_cast<Recur *>(x);
+            int n = rc->rands.size();
+            int t = alloc(n);
+            for (int i = 0; i < n; i++) compile(rc->rands[i].get(), t + i, false);
+            for (int i = 0; i < n; i++) {
+                emit({I_MOVE, reg(rc->depth, i), t + i});
+                if (rc->loop->boxed[i]) emit({I_BOX, reg(rc->depth, i)});
+            }
+            int k = loops.size() - 1;
+            while (loops[k].first != rc->loop) k--;
+            emit({I_JUMP, loops[k].second});
+            top = saved;
+            return;
+        }
+        case E_CALLEC:
+        case E_CALLCC: {
+            // the procedure, its continuation and the callee's procedure
+            // register, as for a call
+            int f = alloc(3);
+            compile(static_cast<CallEC *>(x)->rand.get(), f, false);
+            emit({I_CHECKPROC, f});
+            top = saved;
+            emit({I_CALLEC, f, 1, d});
+            emit({I_ENDEC});
+            break;
+        }
+        case E_LAMBDA: {
+            std::vector<Address> &caps = static_cast<Lambda *>(x)->captures;
+            int a = alloc(caps.size());
+            for (int i = 0; i < caps.size(); i++) {
+                int r = reg(caps[i].depth, caps[i].slot);
+                if (caps[i].captured >= 0) emit({I_CAPTURED, a + i, r, caps[i].captured});
+                else emit({I_MOVE, a + i, r});
+            }
+            emit({I_CLOSURE, d, node(x), a});
+            break;
+        }
+        default: {
+            std::vector<Expr *> kids;
+            x->subexprs(kids);
+            if (kids.empty()) {
+                emit({I_EVAL, d, node(x)});
+                break;
+            }
+            if (builtinOf(x->e_type) == nullptr) throw Unsupported();
+            int n = kids.size();
+            RegOp op = n == 2 ? fastOp(x->e_type) : I_COUNT;
+            if (op != I_COUNT) {
+                int a, b;
+                rands(kids[0]->get(), kids[1]->get(), a, b);
+                emit({op, d, a, b, node(x)});
+                break;
+            }
+            if (n == 1) {
+                emit({I_PRIM, d, operand(kids[0]->get()), 1, node(x)});
+                break;
+            }
+            int a = alloc(n);
+            if (n == 2 && x->e_type != E_LIST) {
+                // a Binary node, right operand first
+                compile(kids[1]->get(), a + 1, false);
+                compile(kids[0]->get(), a, false);
+            } else {
+                for (int i = 0; i < n; i++) compile(kids[i]->get(), a + i, false);
+            }
+            emit({I_PRIM, d, a, n, node(x)});
+        }
+    }
+    top = saved;
+    if (tail) emit({I_RET, d});
+}
+
+// Compiles the body of lam; parameters start in registers 0 to n - 1
+void RegCompiler::body(Lambda *lam) {
+    int n = lam->x.size();
+    open(n + 1);
+    for (int i = 0; i < n; i++)
+        if (lam->boxed[i]) emit({I_BOX, i});
+    compile(lam->e.get(), alloc(1), true);
+}
+
+// Replaces opcodes by the address of their handler
+void RegCompiler::thread() {
+    if (handlers == nullptr) {
+        std::vector<Value> none;
+        execute(nullptr, none, 0);
+    }
+    for (size_t i = 0; i < ch.code.size();) {
+        intptr_t op = ch.code[i];
+        ch.code[i] = reinterpret_cast<intptr_t>(handlers[op]);
+        i += 1 + operands[op];
+    }
+    ch.compiled = true;
+}
+
+// The compiled body of a procedure, compiled on its first call
+static const RegChunk *registersOf(Lambda *lam) {
+    if (lam->registers == nullptr) {
+        lam->registers = std::make_shared<RegChunk>();
+        RegCompiler c(*lam->registers);
+        try {
+            c.body(lam);
+            c.thread();
+        } catch (const Unsupported &) {
+            lam->registers->code.clear();
+        }
+    }
+    return lam->registers.get();
+}
+
+// ============================================================================
+// Machine
+// ============================================================================
+
+/**
+ * @brief Where a pending call resumes
+ */
+struct RegFrame {
+    const RegChunk *ch;
+    const intptr_t *pc;
+    size_t base; ///< Window of the caller in the register file
+    intptr_t d;  ///< Register of the caller receiving the value
+};
+
+// #f is the only false value
+static bool isFalse(const Value &v) {
+    return v.isFalse();
+}
+
+/**
+ * @brief A call the machine does not enter: a primitive, or a procedure
+ * whose body the tree walker runs. f holds the procedure and its operands.
+ */
+static Value applyOutside(const Value *f, int n) {
+    const Value &proc = f[0];
+    if (proc.type() == V_PROC) {
+        Lambda *lam = static_cast<Procedure *>(proc.get())->lambda();
+        if (lam->x.size() != n) throw RuntimeError("Wrong number of arguments");
+        Assoc env = frame(n + 1, empty());
+        Value *slots = env->slots();
+        for (int i = 0; i < n; i++) slots[i] = lam->boxed[i] ? BoxV(f[1 + i]) : f[1 + i];
+        slots[n] = proc;
+        return lam->e->eval(env);
+    }
+    std::vector<Value> args(f + 1, f + 1 + n);
+    return static_cast<Primitive *>(proc.get())->call(args);
+}
+
+// The compiled body a call of proc with n operands enters, or nullptr
+static const RegChunk *entered(const Value &proc, int n) {
+    if (proc.type() != V_PROC) return nullptr;
+    Lambda *lam = static_cast<Procedure *>(proc.get())->lambda();
+    if (lam->x.size() != n) return nullptr;
+    const RegChunk *ch = registersOf(lam);
+    return ch->compiled ? ch : nullptr;
+}
+
+/**
+ * @brief Runs ch in the window of regs at base until it returns
+ *
+ * Called with a null chunk, only publishes the handler addresses.
+ */
+static Value execute(const RegChunk *ch, std::vector<Value> &regs, size_t base) {
+    static const void *const labels[I_COUNT] = {
+        &&L_MOVE, &&L_CONST, &&L_GLOBAL, &&L_GLOBALPROC, &&L_EVAL, &&L_UNBOX, &&L_CAPTURED,
+        &&L_CAPTUREDBOX, &&L_BOX, &&L_SETBOX, &&L_CHECKPROC, &&L_JUMP, &&L_JUMPF, &&L_JUMPT,
+        &&L_INLINED, &&L_JUMPNLT, &&L_JUMPNLE, &&L_JUMPNEQ, &&L_JUMPNGE, &&L_JUMPNGT,
+        &&L_JUMPNNULL, &&L_ADD, &&L_SUB, &&L_MUL, &&L_LT, &&L_LE, &&L_EQ, &&L_GE, &&L_GT, &&L_ADDI,
+        &&L_PRIM, &&L_CLOSURE, &&L_CALL, &&L_TAILCALL, &&L_RET, &&L_CALLEC, &&L_ENDEC,
+        &&L_PREPARE, &&L_DEFINE, &&L_SET, &&L_FAIL,
+    };
+    if (ch == nullptr) {
+        handlers = labels;
+        return Value(nullptr);
+    }
+    std::vector<RegFrame> frames;
+    const intptr_t *code = ch->code.data();
+    const intptr_t *pc = code;
+    Value *R = regs.data() + base;
+    Value result(nullptr);
+    Assoc none = empty();
+    Escapes escapes;
+    Continuation *k = nullptr; ///< Resumed by a call
+
+#define NEXT goto *reinterpret_cast<const void *>(*pc++)
+// Makes room for the window of the chunk being entered
+#define RESERVE(next)                                                           \
+    if (base + (next)->size > regs.size()) {                                    \
+        regs.resize(std::max(2 * regs.size(), base + (next)->size), Value(nullptr)); \
+        R = regs.data() + base;                                                 \
+    }
+#define FIXNUM_OP(label, expr)                                                  \
+    label: {                                                                    \
+        const Value &x = R[pc[1]], &y = R[pc[2]];                               \
+        Value v(nullptr);                                                       \
+        if (x.type() == V_INT && y.type() == V_INT) {                         \
+            int a = x.fixnum();                         \
+            int b = y.fixnum();                         \
+            v = expr;                                                           \
+        } else v = static_cast<Binary *>(ch->nodes[pc[3]])->specialized(x, y); \
+        R[pc[0]] = std::move(v);                                                \
+        pc += 4;                                                                \
+        NEXT;                                                                   \
+    }
+#define BRANCH_OP(label, test)                                                  \
+    label: {                                                                    \
+        const Value &x = R[pc[0]], &y = R[pc[1]];                               \
+        bool holds;                                                             \
+        if (x.type() == V_INT && y.type() == V_INT) {                         \
+            int a = x.fixnum();                         \
+            int b = y.fixnum();                         \
+            holds = test;                                                       \
+        } else holds = !isFalse(static_cast<Binary *>(ch->nodes[pc[2]])->specialized(x, y)); \
+        pc = holds ? pc + 4 : code + pc[3];                                     \
+        NEXT;                                                                   \
+    }
+
+    NEXT;
+
+L_MOVE:
+    R[pc[0]] = R[pc[1]];
+    pc += 2;
+    NEXT;
+L_CONST:
+    R[pc[0]] = ch->consts[pc[1]];
+    pc += 2;
+    NEXT;
+L_GLOBAL: {
+    GlobalVar *g = static_cast<GlobalVar *>(ch->nodes[pc[1]]);
+    R[pc[0]] = g->slot->get() != nullptr ? *g->slot : g->eval(none);
+    pc += 2;
+    NEXT;
+}
+L_GLOBALPROC: {
+    GlobalVar *g = static_cast<GlobalVar *>(ch->nodes[pc[1]]);
+    Value v = g->slot->get() != nullptr ? *g->slot : g->eval(none);
+    if (v.type() != V_PROC && v.type() != V_PRIM && v.type() != V_CONT) throw RuntimeError("Attempt to apply a non-procedure");
+    R[pc[0]] = std::move(v);
+    pc += 2;
+    NEXT;
+}
+L_EVAL:
+    R[pc[0]] = ch->nodes[pc[1]]->eval(none);
+    pc += 2;
+    NEXT;
+L_UNBOX:
+    R[pc[0]] = static_cast<Box *>(R[pc[1]].get())->v;
+    pc += 2;
+    NEXT;
+L_CAPTURED:
+    R[pc[0]] = static_cast<Procedure *>(R[pc[1]].get())->captured[pc[2]];
+    pc += 3;
+    NEXT;
+L_CAPTUREDBOX: {
+    Value &v = static_cast<Procedure *>(R[pc[1]].get())->captured[pc[2]];
+    R[pc[0]] = static_cast<Box *>(v.get())->v;
+    pc += 3;
+    NEXT;
+}
+L_BOX:
+    R[pc[0]] = BoxV(R[pc[0]]);
+    pc += 1;
+    NEXT;
+L_SETBOX:
+    static_cast<Box *>(R[pc[0]].get())->v = R[pc[1]];
+    pc += 2;
+    NEXT;
+L_CHECKPROC: {
+    ValueType t = R[pc[0]].type();
+    if (t != V_PROC && t != V_PRIM && t != V_CONT) throw RuntimeError("Attempt to apply a non-procedure");
+    pc += 1;
+    NEXT;
+}
+L_JUMP:
+    pc = code + pc[0];
+    NEXT;
+L_JUMPF:
+    pc = isFalse(R[pc[0]]) ? code + pc[1] : pc + 2;
+    NEXT;
+L_JUMPT:
+    pc = isFalse(R[pc[0]]) ? pc + 2 : code + pc[1];
+    NEXT;
+L_INLINED:
+    pc = static_cast<Inline *>(ch->nodes[pc[0]])->current() ? pc + 2 : code + pc[1];
+    NEXT;
+
+    BRANCH_OP(L_JUMPNLT, a < b)
+    BRANCH_OP(L_JUMPNLE, a <= b)
+    BRANCH_OP(L_JUMPNEQ, a == b)
+    BRANCH_OP(L_JUMPNGE, a >= b)
+    BRANCH_OP(L_JUMPNGT, a > b)
+
+L_JUMPNNULL:
+    pc = R[pc[0]].type() == V_NULL ? pc + 2 : code + pc[1];
+    NEXT;
+
+    FIXNUM_OP(L_ADD, IntegerV(a + b))
+    FIXNUM_OP(L_SUB, IntegerV(a - b))
+    FIXNUM_OP(L_MUL, IntegerV(a * b))
+    FIXNUM_OP(L_LT, BooleanV(a < b))
+    FIXNUM_OP(L_LE, BooleanV(a <= b))
+    FIXNUM_OP(L_EQ, BooleanV(a == b))
+    FIXNUM_OP(L_GE, BooleanV(a >= b))
+    FIXNUM_OP(L_GT, BooleanV(a > b))
+
+L_ADDI: {
+    const Value &x = R[pc[1]];
+    Value v = x.type() == V_INT ? IntegerV(x.fixnum() + static_cast<int>(pc[2]))
+                                 : static_cast<AddImm *>(ch->nodes[pc[3]])->add(x);
+    R[pc[0]] = std::move(v);
+    pc += 4;
+    NEXT;
+}
+
+L_PRIM: {
+    Value v = ch->nodes[pc[3]]->applyRator(R + pc[1], pc[2]);
+    R[pc[0]] = std::move(v);
+    pc += 4;
+    NEXT;
+}
+L_CLOSURE: {
+    Lambda *lam = static_cast<Lambda *>(ch->nodes[pc[1]]);
+    std::vector<Value> values(R + pc[2], R + pc[2] + lam->captures.size());
+    R[pc[0]] = ProcedureV(Expr(lam->shared_from_this()), std::move(values));
+    pc += 3;
+    NEXT;
+}
+L_CALL: {
+    intptr_t f = pc[0];
+    int n = pc[1];
+    const RegChunk *next = entered(R[f], n);
+    if (next == nullptr) {
+        if (R[f].type() == V_CONT && n == 1) {
+            k = static_cast<Continuation *>(R[f].get());
+            result = R[f + 1];
+            goto resume;
+        }
+        Value v(nullptr);
+        try {
+            v = applyOutside(R + f, n);
+        } catch (const Unwind &u) {
+            // resumed by a body the tree walker runs
+            if (u.k->owner != &escapes) throw;
+            k = u.k;
+            result = u.v;
+            if (k->depth < frames.size()) goto resume;
+            // the continuation of this very call
+            escapes.cut(k);
+            v = result;
+        }
+        R[pc[2]] = std::move(v);
+        pc += 3;
+        NEXT;
+    }
+    if (frames.size() >= options.max_depth) throw RuntimeError("Recursion depth limit exceeded");
+    frames.push_back(RegFrame{ch, pc + 3, base, pc[2]});
+    // the operator register is not read again
+    R[f + 1 + n] = std::move(R[f]);
+    base += f + 1;
+    RESERVE(next);
+    R = regs.data() + base;
+    ch = next;
+    code = pc = ch->code.data();
+    NEXT;
+}
+L_TAILCALL: {
+    intptr_t f = pc[0];
+    int n = pc[1];
+    const RegChunk *next = entered(R[f], n);
+    if (next == nullptr) {
+        if (R[f].type() == V_CONT && n == 1) {
+            k = static_cast<Continuation *>(R[f].get());
+            result = R[f + 1];
+            goto resume;
+        }
+        try {
+            result = applyOutside(R + f, n);
+        } catch (const Unwind &u) {
+            if (u.k->owner != &escapes) throw;
+            k = u.k;
+            result = u.v;
+            goto resume;
+        }
+        goto leave;
+    }
+    Value proc = std::move(R[f]);
+    for (int i = 0; i < n; i++) R[i] = std::move(R[f + 1 + i]);
+    R[n] = std::move(proc);
+    RESERVE(next);
+    ch = next;
+    code = pc = ch->code.data();
+    NEXT;
+}
+L_CALLEC:
+    R[pc[0] + 1] = escapes.capture(frames.size(), 0);
+    goto L_CALL;
+L_ENDEC:
+    escapes.release();
+    NEXT;
+resume:
+    // result goes to the call/ec of k, whose call is pending in frames
+    if (k->owner != &escapes) k->unwind(result);
+    escapes.cut(k);
+    frames.erase(frames.begin() + k->depth + 1, frames.end());
+    goto leave;
+L_RET:
+    // the window is left for good
+    result = std::move(R[pc[0]]);
+leave:
+    if (frames.empty()) return result;
+    {
+        const RegFrame &back = frames.back();
+        ch = back.ch;
+        code = ch->code.data();
+        pc = back.pc;
+        base = back.base;
+        R = regs.data() + base;
+        R[back.d] = std::move(result);
+        frames.pop_back();
+    }
+    NEXT;
+L_PREPARE:
+    static_cast<Define *>(ch->nodes[pc[0]])->prepare();
+    pc += 1;
+    NEXT;
+L_DEFINE:
+    R[pc[0]] = static_cast<Define *>(ch->nodes[pc[1]])->store(none, R[pc[2]]);
+    pc += 3;
+    NEXT;
+L_SET:
+    R[pc[0]] = static_cast<Set *>(ch->nodes[pc[1]])->store(none, R[pc[2]]);
+    pc += 3;
+    NEXT;
+L_FAIL:
+    throw RuntimeError(static_cast<String *>(ch->consts[pc[0]].get())->s);
+
+#undef BRANCH_OP
+#undef FIXNUM_OP
+#undef RESERVE
+#undef NEXT
+}
+
+Value evalReg(ExprBase *root, Assoc &env) {
+    RegChunk top;
+    RegCompiler c(top);
+    try {
+        c.compile(root, c.alloc(1), true);
+        c.thread();
+    } catch (const Unsupported &) {
+        return root->eval(env);
+    }
+    std::vector<Value> regs(std::max(top.size, 1024), Value(nullptr));
+    return execute(&top, regs, 0);
+}
@@ -0,0 +1,340 @@
+/**
+ * @file resolve.cpp
+ * @brief Lexical addressing pass run between parsing and evaluation
+ *
+ * Every binding construct (lambda, let, letrec and a begin holding internal
+ * defines) pushes one scope. A variable bound inside the current procedure
+ * is rewritten into a LocalVar carrying its (depth, slot) coordinate, one
+ * bound outside it into a ClosureVar naming a captured value, and every
+ * other plain identifier into a GlobalVar, so evaluation never has to
+ * compare names along the environment chain.
+ */
+
+#include "Def.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include "RE.hpp"
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+using std::string;
+using std::vector;
+using std::pair;
+
+/**
+ * @brief One name bound by a scope, with what the program does to it
+ *
+ * A binding lives in a Box when closures could otherwise see a stale copy
+ * of it: it is captured and assigned, or captured before letrec or an
+ * internal define has given it its value.
+ */
+struct Binding {
+    Sym name;
+    bool ready;    ///< Holds its value already, at the point being resolved
+    bool assigned; ///< Target of set! or of a repeated define
+    bool captured;
+    bool early;    ///< Captured while not ready
+    vector<bool *> uses; ///< boxed flags of the nodes accessing this binding
+    Binding(Sym name, bool ready)
+        : name(name), ready(ready), assigned(false), captured(false), early(false) {}
+};
+
+/**
+ * @brief Compile-time mirror of one frame of the runtime environment
+ *
+ * A binding's slot is its position among names. The frame of a lambda
+ * scope has one more slot, after the parameters, holding the running
+ * procedure, and no parent at runtime: names bound outside are copied into
+ * the procedure when it is created.
+ */
+struct Scope {
+    vector<Binding> names;
+    Scope *parent;
+    Lambda *lambda;  ///< Lambda owning this scope, if any
+    Binding *self;   ///< Binding that never holds anything but this lambda's procedure
+    Scope(const vector<Sym> &xs, Scope *parent, bool ready = true, Lambda *lambda = nullptr)
+        : parent(parent), lambda(lambda), self(nullptr) {
+        for (Sym x : xs) names.push_back(Binding(x, ready));
+    }
+    void finish(vector<bool> &boxed);
+};
+
+// Decides which bindings get boxed once the whole scope has been seen
+void Scope::finish(vector<bool> &boxed) {
+    boxed.assign(names.size(), false);
+    for (size_t i = 0; i < names.size(); i++) {
+        boxed[i] = names[i].early || (names[i].assigned && names[i].captured);
+        for (bool *use : names[i].uses) *use = boxed[i];
+    }
+}
+
+// Names the form being resolved may assign other than by initializing them
+static std::unordered_set<Sym> targets;
+
+/**
+ * @brief Assignment analysis: collects every set! target, and every define
+ * that is not a statement of a body
+ *
+ * It runs over the whole form before resolution so that a binding is known
+ * to be immutable before its first reference is resolved. Names are not
+ * told apart by scope, which only errs on the side of assuming mutation.
+ */
+static void collectTargets(Expr &ex) {
+    if (ex->e_type == E_SET) targets.insert(static_cast<Set *>(ex.get())->var);
+    if (ex->e_type == E_DEFINE) targets.insert(static_cast<Define *>(ex.get())->var);
+    vector<Expr *> sub;
+    ex->subexprs(sub);
+    for (Expr *i : sub) {
+        if (ex->e_type == E_BEGIN && (*i)->e_type == E_DEFINE) collectTargets(static_cast<Define *>(i->get())->e);
+        else collectTargets(*i);
+    }
+}
+
+/**
+ * @brief Finds the innermost binding of x
+ *
+ * Crossing a lambda scope turns the binding into a free variable of that
+ * lambda, which records where to copy it from when the closure is created,
+ * unless the binding is the lambda's own immutable name: then the
+ * procedure is read from its frame and b is set to nullptr.
+ * @return address of the binding, with depth -1 for a global
+ */
+static Address lookup(Sym x, Scope *sc, Binding *&b) {
+    for (int depth = 0; sc != nullptr; sc = sc->parent, depth++) {
+        for (int slot = (int) sc->names.size() - 1; slot >= 0; slot--) {
+            if (sc->names[slot].name == x) {
+                b = &sc->names[slot];
+                return Address{depth, slot, -1};
+            }
+        }
+        if (sc->lambda == nullptr) continue;
+        Address from = lookup(x, sc->parent, b);
+        if (from.depth < 0) return from;
+        if (b != nullptr && b == sc->self) {
+            b = nullptr;
+            return Address{depth, (int) sc->names.size(), -1};
+        }
+        if (b != nullptr) {
+            b->captured = true;
+            if (!b->ready) b->early = true;
+        }
+        vector<Address> &caps = sc->lambda->captures;
+        int k = 0;
+        while (k < (int) caps.size() && (caps[k].depth != from.depth || caps[k].slot != from.slot ||
+                                         caps[k].captured != from.captured)) k++;
+        if (k == (int) caps.size()) caps.push_back(from);
+        return Address{depth, (int) sc->names.size(), k};
+    }
+    b = nullptr;
+    return Address{-1, -1, -1};
+}
+
+// A body consisting of a single define still needs a scope of its own
+static void resolveBody(Expr &body, Scope *sc) {
+    if (body->e_type == E_DEFINE) body = Expr(new Begin({body}));
+    resolveExpr(body, sc);
+}
+
+static void resolveLambda(Lambda *lam, Scope *sc, Binding *self) {
+    lam->captures.clear();
+    Scope inner(lam->x, sc, true, lam);
+    inner.self = self;
+    resolveBody(lam->e, &inner);
+    inner.finish(lam->boxed);
+}
+
+// Resolves the expression giving b its value; a lambda bound to a name
+// nothing else writes may refer to itself without capturing that name
+static void resolveInit(Expr &init, Scope *sc, Binding *b) {
+    if (init->e_type == E_LAMBDA && !b->assigned && targets.count(b->name) == 0)
+        resolveLambda(static_cast<Lambda *>(init.get()), sc, b);
+    else resolveExpr(init, sc);
+    b->ready = true;
+}
+
+void resolveExpr(Expr &ex, Scope *sc) {
+    Sym x;
+    if (ex->e_type == E_VAR) x = static_cast<Var *>(ex.get())->x;
+    else if (ex->e_type == E_PRIMVAR) x = static_cast<PrimitiveVar *>(ex.get())->x;
+    else {
+        ex->resolve(sc);
+        return;
+    }
+    Binding *b;
+    Address a = lookup(x, sc, b);
+    if (a.depth < 0) {
+        // a primitive name stays a PrimitiveVar
+        if (ex->e_type == E_VAR) ex = Expr(new GlobalVar(x));
+    } else if (a.captured < 0) {
+        LocalVar *v = new LocalVar(x, a.depth, a.slot);
+        if (b != nullptr) b->uses.push_back(&v->boxed);
+        ex = Expr(v);
+    } else {
+        ClosureVar *v = new ClosureVar(x, a.depth, a.slot, a.captured);
+        if (b != nullptr) b->uses.push_back(&v->boxed);
+        ex = Expr(v);
+    }
+}
+
+void resolveProgram(Expr &ex) {
+    foldProgram(ex);
+    inlineProgram(ex);
+    targets.clear();
+    collectTargets(ex);
+    resolveExpr(ex, nullptr);
+#ifdef COUNT_EVALS
+    countEvals(ex);
+#endif
+}
+
+void ExprBase::resolve(Scope *sc) {}
+
+void Unary::resolve(Scope *sc) {
+    resolveExpr(rand, sc);
+}
+
+void Binary::resolve(Scope *sc) {
+    resolveExpr(rand1, sc);
+    resolveExpr(rand2, sc);
+}
+
+void Variadic::resolve(Scope *sc) {
+    for (Expr &i : rands) resolveExpr(i, sc);
+}
+
+void AndVar::resolve(Scope *sc) {
+    for (Expr &i : rands) resolveExpr(i, sc);
+}
+
+void OrVar::resolve(Scope *sc) {
+    for (Expr &i : rands) resolveExpr(i, sc);
+}
+
+void Begin::resolve(Scope *sc) {
+    // At the top level internal defines are global definitions
+    vector<Sym> repeated;
+    if (sc != nullptr) {
+        for (Expr &i : es) {
+            if (i->e_type != E_DEFINE) continue;
+            Sym var = static_cast<Define *>(i.get())->var;
+            bool seen = false;
+            for (Sym d : defs) seen = seen || d == var;
+            if (!seen) defs.push_back(var);
+            else repeated.push_back(var);
+        }
+    }
+    if (defs.empty()) {
+        for (Expr &i : es) resolveExpr(i, sc);
+        return;
+    }
+    Scope inner(defs, sc, false);
+    for (Binding &b : inner.names)
+        for (Sym r : repeated) b.assigned = b.assigned || b.name == r;
+    for (Expr &i : es) {
+        Define *d = i->e_type == E_DEFINE ? static_cast<Define *>(i.get()) : nullptr;
+        int k = 0;
+        while (d != nullptr && inner.names[k].name != d->var) k++;
+        if (d == nullptr || inner.names[k].ready) {
+            resolveExpr(i, &inner);
+            continue;
+        }
+        // the first define of a name initializes it
+        resolveInit(d->e, &inner, &inner.names[k]);
+        d->addr = Address{0, k, -1};
+        inner.names[k].uses.push_back(&d->boxed);
+    }
+    inner.finish(boxed);
+}
+
+void If::resolve(Scope *sc) {
+    resolveExpr(cond, sc);
+    resolveExpr(conseq, sc);
+    resolveExpr(alter, sc);
+}
+
+void Cond::resolve(Scope *sc) {
+    for (vector<Expr> &clause : clauses)
+        for (Expr &i : clause) resolveExpr(i, sc);
+}
+
+void Apply::resolve(Scope *sc) {
+    resolveExpr(rator, sc);
+    for (Expr &i : rand) resolveExpr(i, sc);
+}
+
+void Inline::resolve(Scope *sc) {
+    resolveExpr(body, sc);
+    std::vector<Expr> rand;
+    for (pair<Sym, Expr> &b : static_cast<Let *>(body.get())->bind) rand.push_back(b.second);
+    call = Expr(new Apply(Expr(new GlobalVar(name)), rand));
+}
+
+void Lambda::resolve(Scope *sc) {
+    resolveLambda(this, sc, nullptr);
+}
+
+void Define::resolve(Scope *sc) {
+    resolveExpr(e, sc);
+    if (sc == nullptr) {
+        slot = global_env.slot(var);
+        return;
+    }
+    Binding *b;
+    addr = lookup(var, sc, b);
+    if (addr.depth < 0) throw RuntimeError("Define outside of a body: " + *var);
+    b->assigned = true;
+    b->uses.push_back(&boxed);
+}
+
+void Let::resolve(Scope *sc) {
+    vector<Sym> names;
+    for (pair<Sym, Expr> &b : bind) {
+        resolveExpr(b.second, sc);
+        names.push_back(b.first);
+    }
+    Scope inner(names, sc);
+    resolveBody(body, &inner);
+    inner.finish(boxed);
+}
+
+void Letrec::resolve(Scope *sc) {
+    vector<Sym> names;
+    for (pair<Sym, Expr> &b : bind) names.push_back(b.first);
+    Scope inner(names, sc, false);
+    for (int i = 0; i < bind.size(); i++) resolveInit(bind[i].second, &inner, &inner.names[i]);
+    resolveBody(body, &inner);
+    inner.finish(boxed);
+}
+
+void Loop::resolve(Scope *sc) {
+    vector<Sym> names;
+    for (pair<Sym, Expr> &b : bind) {
+        resolveExpr(b.second, sc);
+        names.push_back(b.first);
+    }
+    Scope inner(names, sc);
+    scope = &inner;
+    resolveBody(body, &inner);
+    scope = nullptr;
+    inner.finish(boxed);
+}
+
+void Recur::resolve(Scope *sc) {
+    for (Expr &i : rands) resolveExpr(i, sc);
+    // the parser only makes a Recur outside any lambda of the loop's body
+    depth = 0;
+    for (Scope *s = sc; s != loop->scope; s = s->parent) depth++;
+}
+
+void Set::resolve(Scope *sc) {
+    resolveExpr(e, sc);
+    Binding *b;
+    addr = lookup(var, sc, b);
+    if (addr.depth < 0) {
+        slot = global_env.slot(var);
+        return;
+    }
+    b->assigned = true;
+    b->uses.push_back(&boxed);
+}
@@ -1,75 +1,82 @@
-#ifndef SYNTAX 
-#define SYNTAX
-
-#include <cstring>
-#include <memory>
-#include <vector>
-#include "Def.hpp"
-
-struct SyntaxBase {
-    virtual Expr parse(Assoc &) = 0;
-    virtual void show(std::ostream &) = 0;
-    virtual ~SyntaxBase() = default;
-};
-
-struct Syntax {
-    std::shared_ptr<SyntaxBase> ptr;
-    Syntax(SyntaxBase *);
-    SyntaxBase* operator->() const;
-    SyntaxBase& operator*();
-    SyntaxBase* get() const;
-    Expr parse(Assoc &);
-};
-
-struct Number : SyntaxBase {
-    int n;
-    Number(int);
-    virtual Expr parse(Assoc &) override;
-    virtual void show(std::ostream &) override;
-};
-
-struct RationalSyntax : SyntaxBase {
-    int numerator;
-    int denominator;
-    RationalSyntax(int num, int den);
-    virtual Expr parse(Assoc &) override;
-    virtual void show(std::ostream &) override;
-};
-
-struct TrueSyntax : SyntaxBase {
-    // This will not match
-    virtual Expr parse(Assoc &) override;
-    virtual void show(std::ostream &) override;
-};
-
-struct FalseSyntax : SyntaxBase {
-    // FalseSyntax();
-    virtual Expr parse(Assoc &) override;
-    virtual void show(std::ostream &) override;
-};
-
-struct SymbolSyntax : SyntaxBase {
-    std::string s;
-    SymbolSyntax(const std::string &);
-    virtual Expr parse(Assoc &) override;
-    virtual void show(std::ostream &) override;
-};
-
-struct StringSyntax : SyntaxBase {
-    std::string s;
-    StringSyntax(const std::string &);
-    virtual Expr parse(Assoc &) override;
-    virtual void show(std::ostream &) override;
-};
-
-struct List : SyntaxBase {
-    std::vector<Syntax> stxs;
-    List();
-    virtual Expr parse(Assoc &) override;
-    virtual void show(std::ostream &) override;
-};
-
-Syntax readSyntax(std::istream &);
-
-std::istream &operator>>(std::istream &, Syntax);
+#ifndef SYNTAX 
+#define SYNTAX
+
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "Def.hpp"
+
+struct SyntaxBase {
+    SyntaxType s_type;
+    SyntaxBase(SyntaxType);
+    virtual Expr parse(Assoc &) = 0;
+    virtual void show(std::ostream &) = 0;
+    virtual ~SyntaxBase() = default;
+};
+
+struct Syntax {
+    std::shared_ptr<SyntaxBase> ptr;
+    Syntax(SyntaxBase *);
+    SyntaxBase* operator->() const;
+    SyntaxBase& operator*();
+    SyntaxBase* get() const;
+    Expr parse(Assoc &);
+};
+
+struct Number : SyntaxBase {
+    int n;
+    Number(int);
+    virtual Expr parse(Assoc &) override;
+    virtual void show(std::ostream &) override;
+};
+
+struct RationalSyntax : SyntaxBase {
+    int numerator;
+    int denominator;
+    RationalSyntax(int num, int den);
+    virtual Expr parse(Assoc &) override;
+    virtual void show(std::ostream &) override;
+};
+
+struct TrueSyntax : SyntaxBase {
+    // This will not match
+    TrueSyntax();
+    virtual Expr parse(Assoc &) override;
+    virtual void show(std::ostream &) override;
+};
+
+struct FalseSyntax : SyntaxBase {
+    FalseSyntax();
+    virtual Expr parse(Assoc &) override;
+    virtual void show(std::ostream &) override;
+};
+
+struct SymbolSyntax : SyntaxBase {
+    Sym s;
+    SymbolSyntax(Sym);
+    virtual Expr parse(Assoc &) override;
+    virtual void show(std::ostream &) override;
+};
+
+struct StringSyntax : SyntaxBase {
+    std::string s;
+    StringSyntax(const std::string &);
+    virtual Expr parse(Assoc &) override;
+    virtual void show(std::ostream &) override;
+};
+
+struct List : SyntaxBase {
+    std::vector<Syntax> stxs;
+    List();
+    virtual Expr parse(Assoc &) override;
+    virtual void show(std::ostream &) override;
+};
+
+// The node as a symbol or a list, or nullptr when it is something else
+SymbolSyntax *asSymbol(const Syntax &);
+List *asList(const Syntax &);
+
+Syntax readSyntax(std::istream &);
+
+std::istream &operator>>(std::istream &, Syntax);
 #endif
\ No newline at end of file
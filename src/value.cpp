@@ -1,269 +1,370 @@
-/**
- * @file value.cpp
- * @brief Implementation of value types and environment operations
- * 
- * This file implements all value types, their constructors, show methods,
- * and environment (association list) operations for the Scheme interpreter.
- */
-
-#include "value.hpp"
-
-// ============================================================================
-// Base ValueBase Implementation
-// ============================================================================
-
-ValueBase::ValueBase(ValueType vt) : v_type(vt) {}
-
-void ValueBase::showCdr(std::ostream &os) {
-    os << " . ";
-    show(os);
-    os << ')';
-}
-
-// ============================================================================
-// Value Smart Pointer Implementation
-// ============================================================================
-
-Value::Value(ValueBase *ptr) : ptr(ptr) {}
-
-ValueBase* Value::operator->() const { 
-    return ptr.get(); 
-}
-
-ValueBase& Value::operator*() { 
-    return *ptr; 
-}
-
-ValueBase* Value::get() const { 
-    return ptr.get(); 
-}
-
-void Value::show(std::ostream &os) {
-    ptr->show(os);
-}
-
-// ============================================================================
-// Environment (Association List) Implementation
-// ============================================================================
-
-AssocList::AssocList(const std::string &x, const Value &v, Assoc &next)
-    : x(x), v(v), next(next) {}
-
-Assoc::Assoc(AssocList *x) : ptr(x) {}
-
-AssocList* Assoc::operator->() const { 
-    return ptr.get(); 
-}
-
-AssocList& Assoc::operator*() { 
-    return *ptr; 
-}
-
-AssocList* Assoc::get() const { 
-    return ptr.get(); 
-}
-
-Assoc empty() {
-    return Assoc(nullptr);
-}
-
-Assoc extend(const std::string &x, const Value &v, Assoc &lst) {
-    return Assoc(new AssocList(x, v, lst));
-}
-
-void modify(const std::string &x, const Value &v, Assoc &lst) {
-    for (auto i = lst; i.get() != nullptr; i = i->next) {
-        if (x == i->x) {
-            i->v = v;
-            return;
-        }
-    }
-}
-
-Value find(const std::string &x, Assoc &l) {
-    for (auto i = l; i.get() != nullptr; i = i->next) {
-        if (x == i->x) {
-            return i->v;
-        }
-    }
-    return Value(nullptr);
-}
-
-// ============================================================================
-// Simple Value Types Implementation
-// ============================================================================
-Nonereturn::Nonereturn() : ValueBase(V_NONERETURN) {}
-void Nonereturn::show(std::ostream &os) {
-}
-Value NonereturnV() {
-    return Value(new Nonereturn());
-}
-// Void
-Void::Void() : ValueBase(V_VOID) {}
-
-void Void::show(std::ostream &os) {
-    os << "#<void>";
-}
-
-Value VoidV() {
-    return Value(new Void());
-}
-
-// Integer
-Integer::Integer(int n) : ValueBase(V_INT), n(n) {}
-
-void Integer::show(std::ostream &os) {
-    os << n;
-}
-
-Value IntegerV(int n) {
-    return Value(new Integer(n));
-}
-
-// Rational
-// Helper function to calculate greatest common divisor
-static int gcd(int a, int b) {
-    if (a < 0) a = -a;
-    if (b < 0) b = -b;
-    while (b != 0) {
-        int temp = b;
-        b = a % b;
-        a = temp;
-    }
-    return a;
-}
-
-Rational::Rational(int num, int den) : ValueBase(V_RATIONAL) {
-    if (den == 0) {
-        throw std::runtime_error("Division by zero");
-    }
-    
-    // Simplify the fraction
-    int g = gcd(num, den);
-    numerator = num / g;
-    denominator = den / g;
-    
-    // Ensure denominator is positive
-    if (denominator < 0) {
-        numerator = -numerator;
-        denominator = -denominator;
-    }
-}
-
-void Rational::show(std::ostream &os) {
-    if (denominator == 1) {
-        os << numerator;
-    } else {
-        os << numerator << "/" << denominator;
-    }
-}
-
-Value RationalV(int num, int den) {
-    return Value(new Rational(num, den));
-}
-
-// Boolean
-Boolean::Boolean(bool b) : ValueBase(V_BOOL), b(b) {}
-
-void Boolean::show(std::ostream &os) {
-    os << (b ? "#t" : "#f");
-}
-
-Value BooleanV(bool b) {
-    return Value(new Boolean(b));
-}
-
-// Symbol
-Symbol::Symbol(const std::string &s) : ValueBase(V_SYM), s(s) {}
-
-void Symbol::show(std::ostream &os) {
-    os << s;
-}
-
-Value SymbolV(const std::string &s) {
-    return Value(new Symbol(s));
-}
-
-// String
-String::String(const std::string &s) : ValueBase(V_STRING), s(s) {}
-
-void String::show(std::ostream &os) {
-    os << "\"" << s << "\"";
-}
-
-Value StringV(const std::string &s) {
-    return Value(new String(s));
-}
-
-// ============================================================================
-// Special Value Types Implementation
-// ============================================================================
-
-// Null
-Null::Null() : ValueBase(V_NULL) {}
-
-void Null::show(std::ostream &os) {
-    os << "()";
-}
-
-void Null::showCdr(std::ostream &os) {
-    os << ')';
-}
-
-Value NullV() {
-    return Value(new Null());
-}
-
-// Terminate
-Terminate::Terminate() : ValueBase(V_TERMINATE) {}
-
-void Terminate::show(std::ostream &os) {
-    os << "()";
-}
-
-Value TerminateV() {
-    return Value(new Terminate());
-}
-
-// ============================================================================
-// Composite Value Types Implementation
-// ============================================================================
-
-// Pair
-Pair::Pair(const Value &car, const Value &cdr) 
-    : ValueBase(V_PAIR), car(car), cdr(cdr) {}
-
-void Pair::show(std::ostream &os) {
-    os << '(' << car;
-    cdr->showCdr(os);
-}
-
-void Pair::showCdr(std::ostream &os) {
-    os << ' ' << car;
-    cdr->showCdr(os);
-}
-
-Value PairV(const Value &car, const Value &cdr) {
-    return Value(new Pair(car, cdr));
-}
-
-// Procedure
-Procedure::Procedure(const std::vector<std::string> &xs, const Expr &e, const Assoc &env)
-    : ValueBase(V_PROC), parameters(xs), e(e), env(env) {}
-
-void Procedure::show(std::ostream &os) {
-    os << "#<procedure>";
-}
-
-Value ProcedureV(const std::vector<std::string> &xs, const Expr &e, const Assoc &env) {
-    return Value(new Procedure(xs, e, env));
-}
-
-// ============================================================================
-// Utility Functions Implementation
-// ============================================================================
-
-std::ostream &operator<<(std::ostream &os, Value &v) {
-    v->show(os);
-    return os;
-}
+/**
+ * @file value.cpp
+ * @brief Implementation of value types and environment operations
+ * 
+ * This file implements all value types, their constructors, show methods,
+ * and environment (association list) operations for the Scheme interpreter.
+ */
+
+#include "value.hpp"
+#include "RE.hpp"
+
+// ============================================================================
+// Base ValueBase Implementation
+// ============================================================================
+
+ValueBase::ValueBase(ValueType vt) : v_type(vt), refs(0) {}
+
+void ValueBase::showCdr(std::ostream &os) {
+    os << " . ";
+    show(os);
+    os << ')';
+}
+
+// ============================================================================
+// Value Word Implementation
+// ============================================================================
+
+void Value::show(std::ostream &os) const {
+    switch (type()) {
+        case V_INT: os << fixnum(); break;
+        case V_BOOL: os << (isFalse() ? "#f" : "#t"); break;
+        case V_NULL: case V_TERMINATE: os << "()"; break;
+        case V_VOID: os << "#<void>"; break;
+        case V_NONERETURN: break;
+        default: get()->show(os);
+    }
+}
+
+void Value::showCdr(std::ostream &os) const {
+    if (isHeap()) get()->showCdr(os);
+    else if (type() == V_NULL) os << ')';
+    else {
+        os << " . ";
+        show(os);
+        os << ')';
+    }
+}
+
+// ============================================================================
+// Environment (Association List) Implementation
+// ============================================================================
+
+AssocList::AssocList(int n, const Assoc &next)
+    : refs(0), n(n), x(nullptr), next(next) {}
+
+// Free lists of released frames, indexed by slot count
+static const int kPooledSlots = 8;
+static std::vector<void *> frame_pool[kPooledSlots + 1];
+
+static void releaseFrame(AssocList *f) {
+    int n = f->n;
+    for (int i = 0; i < n; i++) f->slots()[i].~Value();
+    f->~AssocList();
+    if (n <= kPooledSlots) frame_pool[n].push_back(f);
+    else ::operator delete(f);
+}
+
+Assoc::Assoc(AssocList *x) : ptr(x) {
+    if (ptr != nullptr) ptr->refs++;
+}
+
+Assoc::Assoc(const Assoc &other) : ptr(other.ptr) {
+    if (ptr != nullptr) ptr->refs++;
+}
+
+Assoc &Assoc::operator=(const Assoc &other) {
+    AssocList *old = ptr;
+    ptr = other.ptr;
+    if (ptr != nullptr) ptr->refs++;
+    if (old != nullptr && --old->refs == 0) releaseFrame(old);
+    return *this;
+}
+
+Assoc::~Assoc() {
+    if (ptr != nullptr && --ptr->refs == 0) releaseFrame(ptr);
+}
+
+AssocList* Assoc::operator->() const { 
+    return ptr; 
+}
+
+AssocList& Assoc::operator*() { 
+    return *ptr; 
+}
+
+AssocList* Assoc::get() const { 
+    return ptr; 
+}
+
+Assoc empty() {
+    return Assoc(nullptr);
+}
+
+// New frame of n unbound slots below next
+Assoc frame(int n, const Assoc &next) {
+    void *mem;
+    if (n <= kPooledSlots && !frame_pool[n].empty()) {
+        mem = frame_pool[n].back();
+        frame_pool[n].pop_back();
+    } else {
+        mem = ::operator new(sizeof(AssocList) + n * sizeof(Value));
+    }
+    AssocList *f = new (mem) AssocList(n, next);
+    for (int i = 0; i < n; i++) new (&f->slots()[i]) Value(nullptr);
+    return Assoc(f);
+}
+
+Assoc extend(Sym x, const Value &v, Assoc &lst) {
+    Assoc f = frame(1, lst);
+    f->x = x;
+    f->slots()[0] = v;
+    return f;
+}
+
+void modify(Sym x, const Value &v, Assoc &lst) {
+    for (AssocList *i = lst.get(); i != nullptr; i = i->next.get()) {
+        if (x == i->x) {
+            i->slots()[0] = v;
+            return;
+        }
+    }
+}
+
+Value find(Sym x, Assoc &l) {
+    for (AssocList *i = l.get(); i != nullptr; i = i->next.get()) {
+        if (x == i->x) {
+            return i->slots()[0];
+        }
+    }
+    return Value(nullptr);
+}
+
+// Binding at a lexical address computed by the resolver
+Value &locate(const Address &a, Assoc &l) {
+    Value &v = enclosing(a.depth, l)->slots()[a.slot];
+    if (a.captured < 0) return v;
+    return static_cast<Procedure *>(v.get())->captured[a.captured];
+}
+
+// ============================================================================
+// Global Environment Implementation
+// ============================================================================
+
+Value *GlobalEnv::slot(Sym x) {
+    auto it = table.find(x);
+    if (it != table.end()) return it->second;
+    slots.emplace_back(nullptr);
+    table[x] = &slots.back();
+    return &slots.back();
+}
+
+Value GlobalEnv::find(Sym x) const {
+    auto it = table.find(x);
+    if (it == table.end()) return Value(nullptr);
+    return *it->second;
+}
+
+void GlobalEnv::assign(Value *slot, const Value &v) {
+    if (slot->get() != nullptr && slot->type() == V_PROC) version++;
+    *slot = v;
+}
+
+GlobalEnv global_env;
+
+// ============================================================================
+// Simple Value Types Implementation
+// ============================================================================
+// Rational
+// Helper function to calculate greatest common divisor
+static int gcd(int a, int b) {
+    if (a < 0) a = -a;
+    if (b < 0) b = -b;
+    while (b != 0) {
+        int temp = b;
+        b = a % b;
+        a = temp;
+    }
+    return a;
+}
+
+Rational::Rational(int num, int den) : ValueBase(V_RATIONAL) {
+    if (den == 0) {
+        throw std::runtime_error("Division by zero");
+    }
+    
+    // Simplify the fraction
+    int g = gcd(num, den);
+    numerator = num / g;
+    denominator = den / g;
+    
+    // Ensure denominator is positive
+    if (denominator < 0) {
+        numerator = -numerator;
+        denominator = -denominator;
+    }
+}
+
+void Rational::show(std::ostream &os) {
+    if (denominator == 1) {
+        os << numerator;
+    } else {
+        os << numerator << "/" << denominator;
+    }
+}
+
+Value RationalV(int num, int den) {
+    return Value(new Rational(num, den));
+}
+
+// Symbol
+Symbol::Symbol(Sym s) : ValueBase(V_SYM), s(s) {}
+
+void Symbol::show(std::ostream &os) {
+    os << *s;
+}
+
+Value SymbolV(Sym s) {
+    return Value(new Symbol(s));
+}
+
+// String
+String::String(const std::string &s) : ValueBase(V_STRING), s(s) {}
+
+void String::show(std::ostream &os) {
+    os << "\"" << s << "\"";
+}
+
+Value StringV(const std::string &s) {
+    return Value(new String(s));
+}
+
+// ============================================================================
+// Composite Value Types Implementation
+// ============================================================================
+
+// Pair
+Pair::Pair(const Value &car, const Value &cdr) 
+    : ValueBase(V_PAIR), car(car), cdr(cdr) {}
+
+// A long list is walked along its cdrs rather than recursively, here and
+// when it is released
+Pair::~Pair() {
+    Value next = std::move(cdr);
+    while (next.isHeap() && next->refs == 1 && next->v_type == V_PAIR) {
+        Value after = std::move(static_cast<Pair *>(next.get())->cdr);
+        next = std::move(after);
+    }
+}
+
+static void showElements(std::ostream &os, Value rest) {
+    while (rest.type() == V_PAIR) {
+        Pair *p = static_cast<Pair *>(rest.get());
+        os << ' ' << p->car;
+        rest = p->cdr;
+    }
+    rest.showCdr(os);
+}
+
+void Pair::show(std::ostream &os) {
+    os << '(' << car;
+    showElements(os, cdr);
+}
+
+void Pair::showCdr(std::ostream &os) {
+    os << ' ' << car;
+    showElements(os, cdr);
+}
+
+Value PairV(const Value &car, const Value &cdr) {
+    return Value(new Pair(car, cdr));
+}
+
+// Procedure
+Procedure::Procedure(const Expr &code, std::vector<Value> captured)
+    : ValueBase(V_PROC), code(code), captured(std::move(captured)) {}
+
+Lambda *Procedure::lambda() const {
+    return static_cast<Lambda *>(code.get());
+}
+
+void Procedure::show(std::ostream &os) {
+    os << "#<procedure>";
+}
+
+Value ProcedureV(const Expr &code, std::vector<Value> captured) {
+    return Value(new Procedure(code, std::move(captured)));
+}
+
+// Box
+Box::Box(const Value &v) : ValueBase(V_BOX), v(v) {}
+
+void Box::show(std::ostream &os) {
+    v.show(os);
+}
+
+Value BoxV(const Value &v) {
+    return Value(new Box(v));
+}
+
+// Primitive
+Primitive::Primitive(const Builtin *info) : ValueBase(V_PRIM), info(info) {}
+
+Value Primitive::call(const std::vector<Value> &args) {
+    int n = args.size();
+    if (n < info->min_args || (info->max_args >= 0 && n > info->max_args))
+        throw RuntimeError("Wrong number of arguments");
+    return info->fn(args);
+}
+
+void Primitive::show(std::ostream &os) {
+    os << "#<procedure>";
+}
+
+Value PrimitiveV(const Builtin *info) {
+    return Value(new Primitive(info));
+}
+
+// Continuation
+Continuation::Continuation(Escapes *owner, size_t depth, size_t height)
+    : ValueBase(V_CONT), owner(owner), depth(depth), height(height) {}
+
+void Continuation::unwind(const Value &v) {
+    if (owner == nullptr && saved == nullptr) throw RuntimeError("Continuation resumed after its extent");
+    throw Unwind{this, v};
+}
+
+void Continuation::show(std::ostream &os) {
+    os << "#<continuation>";
+}
+
+Value Escapes::capture(size_t depth, size_t height) {
+    live.push_back(Value(new Continuation(this, depth, height)));
+    return live.back();
+}
+
+void Escapes::release() {
+    static_cast<Continuation *>(live.back().get())->owner = nullptr;
+    live.pop_back();
+}
+
+void Escapes::cut(Continuation *k) {
+    while (live.back().get() != k) release();
+}
+
+void Escapes::clear() {
+    while (!live.empty()) release();
+}
+
+Escapes::~Escapes() {
+    clear();
+}
+
+// ============================================================================
+// Utility Functions Implementation
+// ============================================================================
+
+std::ostream &operator<<(std::ostream &os, const Value &v) {
+    v.show(os);
+    return os;
+}
@@ -1,206 +1,371 @@
-#ifndef VALUE 
-#define VALUE
-
-/**
- * @file value.hpp
- * @brief Value system and environment definitions for the Scheme interpreter
- * 
- * This file defines the value types, environment (association list) system,
- * and all related operations for the Scheme interpreter runtime.
- */
-
-#include "Def.hpp"
-#include "expr.hpp"
-#include <memory>
-#include <cstring>
-#include <vector>
-
-// ============================================================================
-// Base classes and smart pointer wrappers
-// ============================================================================
-
-/**
- * @brief Base class for all values in the Scheme interpreter
- */
-struct ValueBase {
-    ValueType v_type;
-    ValueBase(ValueType);
-    virtual void show(std::ostream &) = 0;
-    virtual void showCdr(std::ostream &);
-    virtual ~ValueBase() = default;
-};
-
-/**
- * @brief Smart pointer wrapper for ValueBase objects
- */
-struct Value {
-    std::shared_ptr<ValueBase> ptr;
-    Value(ValueBase *);
-    void show(std::ostream &);
-    ValueBase* operator->() const;
-    ValueBase& operator*();
-    ValueBase* get() const;
-};
-
-// ============================================================================
-// Environment (Association Lists)
-// ============================================================================
-
-/**
- * @brief Smart pointer wrapper for AssocList (Environment)
- */
-struct Assoc {
-    std::shared_ptr<AssocList> ptr;
-    Assoc(AssocList *);
-    AssocList* operator->() const;
-    AssocList& operator*();
-    AssocList* get() const;
-};
-
-/**
- * @brief Association list node for variable bindings
- */
-struct AssocList {
-    std::string x;      ///< Variable name
-    Value v;            ///< Variable value
-    Assoc next;         ///< Next binding in the chain
-    AssocList(const std::string &, const Value &, Assoc &);
-};
-
-// Environment operations
-Assoc empty();
-Assoc extend(const std::string&, const Value &, Assoc &);
-void modify(const std::string&, const Value &, Assoc &);
-Value find(const std::string &, Assoc &);
-
-// ============================================================================
-// Simple Value Types
-// ============================================================================
-
-/**
- * @brief Void value (represents no meaningful return value)
- */
-struct Nonereturn: ValueBase {
-  Nonereturn();
-  virtual void show(std::ostream &) override;
-};
-Value NonereturnV();
-struct Void : ValueBase {
-    Void();
-    virtual void show(std::ostream &) override;
-};
-Value VoidV();
-
-/**
- * @brief Integer value
- */
-struct Integer : ValueBase {
-    int n;
-    Integer(int);
-    virtual void show(std::ostream &) override;
-};
-Value IntegerV(int);
-
-/**
- * @brief Rational number value
- */
-struct Rational : ValueBase {
-    int numerator;
-    int denominator;
-    Rational(int, int);
-    Rational &operator=(const Rational &other){
-        this->numerator=other.numerator;
-        this->denominator=other.denominator;
-        return *this;
-    }
-    virtual void show(std::ostream &) override;
-};
-Value RationalV(int, int);
-
-/**
- * @brief Boolean value
- */
-struct Boolean : ValueBase {
-    bool b;
-    Boolean(bool);
-    virtual void show(std::ostream &) override;
-};
-Value BooleanV(bool);
-
-/**
- * @brief Symbol value
- */
-struct Symbol : ValueBase {
-    std::string s;
-    Symbol(const std::string &);
-    virtual void show(std::ostream &) override;
-};
-Value SymbolV(const std::string &);
-
-/**
- * @brief String value
- */
-struct String : ValueBase {
-    std::string s;
-    String(const std::string &);
-    virtual void show(std::ostream &) override;
-};
-Value StringV(const std::string &);
-
-// ============================================================================
-// Special Value Types
-// ============================================================================
-
-/**
- * @brief Null value (empty list)
- */
-struct Null : ValueBase {
-    Null();
-    virtual void show(std::ostream &) override;
-    virtual void showCdr(std::ostream &) override;
-};
-Value NullV();
-
-/**
- * @brief Termination signal value
- */
-struct Terminate : ValueBase {
-    Terminate();
-    virtual void show(std::ostream &) override;
-};
-Value TerminateV();
-
-// ============================================================================
-// Composite Value Types
-// ============================================================================
-
-/**
- * @brief Pair value (cons cell)
- */
-struct Pair : ValueBase {
-    Value car;  ///< First element
-    Value cdr;  ///< Second element
-    Pair(const Value &, const Value &);
-    virtual void show(std::ostream &) override;
-    virtual void showCdr(std::ostream &) override;
-};
-Value PairV(const Value &, const Value &);
-/**
- * @brief Procedure (function) value
- */
-struct Procedure : ValueBase {
-    std::vector<std::string> parameters;   ///< Parameter names
-    Expr e;                                ///< Function body expression
-    Assoc env;                             ///< Closure environment
-    Procedure(const std::vector<std::string> &, const Expr &, const Assoc &);
-    virtual void show(std::ostream &) override;
-};
-Value ProcedureV(const std::vector<std::string> &, const Expr &, const Assoc &);
-
-// ============================================================================
-// Utility Functions
-// ============================================================================
-
-std::ostream &operator<<(std::ostream &, Value &);
-
+#ifndef VALUE 
+#define VALUE
+
+/**
+ * @file value.hpp
+ * @brief Value system and environment definitions for the Scheme interpreter
+ * 
+ * This file defines the value types, environment (association list) system,
+ * and all related operations for the Scheme interpreter runtime.
+ */
+
+#include "Def.hpp"
+#include "expr.hpp"
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+
+// ============================================================================
+// Base classes and smart pointer wrappers
+// ============================================================================
+
+/**
+ * @brief Base class for all values in the Scheme interpreter
+ *
+ * Only values that live on the heap derive from it; refs counts the Value
+ * words pointing to one.
+ */
+struct ValueBase {
+    ValueType v_type;
+    unsigned refs;
+    ValueBase(ValueType);
+    virtual void show(std::ostream &) = 0;
+    virtual void showCdr(std::ostream &);
+    virtual ~ValueBase() = default;
+};
+
+/**
+ * @brief A value in one tagged word
+ *
+ * Fixnums (low bit 1) and booleans, '(), void and the other singletons
+ * (low bits 10) are immediates held in the word itself, so making one
+ * allocates nothing. Any other word points to a ValueBase, whose reference
+ * count is kept there; the null word is an unbound slot. get() and
+ * operator-> give the word as a pointer, which only a heap value may
+ * dereference: check type() first.
+ */
+struct Value {
+    uint64_t w;
+
+    Value(ValueBase *p) : w(reinterpret_cast<uintptr_t>(p)) {
+        if (p != nullptr) p->refs++;
+    }
+    Value(const Value &o) : w(o.w) { retain(); }
+    Value(Value &&o) : w(o.w) { o.w = 0; }
+    Value &operator=(const Value &o) {
+        Value t(o);
+        std::swap(w, t.w);
+        return *this;
+    }
+    Value &operator=(Value &&o) {
+        std::swap(w, o.w);
+        return *this;
+    }
+    ~Value() { release(); }
+
+    // Value of an immediate word
+    static Value immediate(uint64_t w) {
+        Value v(nullptr);
+        v.w = w;
+        return v;
+    }
+    static constexpr uint64_t singleton(ValueType t, uint64_t payload = 0) {
+        return payload << 16 | static_cast<uint64_t>(t) << 3 | 2;
+    }
+
+    bool isHeap() const { return (w & 3) == 0 && w != 0; }
+    bool isFalse() const { return w == singleton(V_BOOL, 0); }
+    ValueType type() const {
+        if (w & 1) return V_INT;
+        if (w & 2) return static_cast<ValueType>(w >> 3 & 0x1fff);
+        return get()->v_type;
+    }
+    int fixnum() const { return static_cast<int>(static_cast<int64_t>(w) >> 1); }
+    bool operator==(const Value &o) const { return w == o.w; }
+    bool operator!=(const Value &o) const { return w != o.w; }
+
+    void show(std::ostream &) const;
+    void showCdr(std::ostream &) const;
+    ValueBase* operator->() const { return get(); }
+    ValueBase& operator*() const { return *get(); }
+    ValueBase* get() const { return reinterpret_cast<ValueBase *>(static_cast<uintptr_t>(w)); }
+
+private:
+    void retain() {
+        if (isHeap()) get()->refs++;
+    }
+    void release() {
+        if (isHeap() && --get()->refs == 0) delete get();
+    }
+};
+
+// ============================================================================
+// Environment (Association Lists)
+// ============================================================================
+
+/**
+ * @brief Reference-counted pointer to an AssocList frame
+ *
+ * The count lives in the frame itself, so a frame costs one allocation.
+ */
+struct Assoc {
+    AssocList *ptr;
+    Assoc(AssocList *);
+    Assoc(const Assoc &);
+    Assoc &operator=(const Assoc &);
+    ~Assoc();
+    AssocList* operator->() const;
+    AssocList& operator*();
+    AssocList* get() const;
+};
+
+/**
+ * @brief Environment frame holding all bindings of one scope
+ *
+ * The n values are stored right behind the frame in the same allocation.
+ * Frames of resolved code are addressed by (depth, slot) and carry no
+ * names; only frames made by extend, as the parser uses them, are named.
+ * Released frames are kept on a free list per size and reused.
+ */
+struct AssocList {
+    int refs;           ///< Number of Assoc pointing here
+    int n;              ///< Number of slots
+    Sym x;              ///< Name of the slot of a frame made by extend
+    Assoc next;         ///< Enclosing frame
+    AssocList(int, const Assoc &);
+    Value *slots() { return reinterpret_cast<Value *>(this + 1); }
+};
+
+// Environment operations
+Assoc empty();
+Assoc frame(int, const Assoc &);
+Assoc extend(Sym, const Value &, Assoc &);
+void modify(Sym, const Value &, Assoc &);
+Value find(Sym, Assoc &);
+Value &locate(const Address &, Assoc &);
+
+/**
+ * @brief A procedure call left pending by ExprBase::evalTail
+ *
+ * body is nullptr when there is none.
+ */
+struct TailCall {
+    ExprBase *body;
+    Assoc env;   ///< Frame of the callee, holding its arguments
+};
+
+// Frame depth hops up from the current one
+inline AssocList *enclosing(int depth, const Assoc &e) {
+    AssocList *f = e.get();
+    while (depth-- > 0) f = f->next.get();
+    return f;
+}
+
+// ============================================================================
+// Global Environment
+// ============================================================================
+
+/**
+ * @brief Hash-indexed table of top-level bindings
+ *
+ * Every name gets one slot the first time it is mentioned. Slots never move,
+ * so resolved references keep a pointer to theirs; an unbound slot holds a
+ * null Value. Slots are written through assign, which bumps version when a
+ * procedure is replaced so that call sites caching it notice.
+ */
+struct GlobalEnv {
+    std::unordered_map<Sym, Value *> table;
+    std::deque<Value> slots;
+    unsigned version = 0;
+    Value *slot(Sym);
+    Value find(Sym) const;
+    void assign(Value *, const Value &);
+};
+
+extern GlobalEnv global_env;
+
+// ============================================================================
+// Simple Value Types
+// ============================================================================
+
+// Values held in the word itself, see Value
+inline Value NonereturnV() {
+    return Value::immediate(Value::singleton(V_NONERETURN));
+}
+inline Value VoidV() {
+    return Value::immediate(Value::singleton(V_VOID));
+}
+inline Value IntegerV(int n) {
+    return Value::immediate(static_cast<uint64_t>(static_cast<int64_t>(n)) << 1 | 1);
+}
+inline Value BooleanV(bool b) {
+    return Value::immediate(Value::singleton(V_BOOL, b));
+}
+inline Value NullV() {
+    return Value::immediate(Value::singleton(V_NULL));
+}
+inline Value TerminateV() {
+    return Value::immediate(Value::singleton(V_TERMINATE));
+}
+
+/**
+ * @brief Rational number value
+ */
+struct Rational : ValueBase {
+    int numerator;
+    int denominator;
+    Rational(int, int);
+    Rational &operator=(const Rational &other){
+        this->numerator=other.numerator;
+        this->denominator=other.denominator;
+        return *this;
+    }
+    virtual void show(std::ostream &) override;
+};
+Value RationalV(int, int);
+
+/**
+ * @brief Symbol value
+ */
+struct Symbol : ValueBase {
+    Sym s;
+    Symbol(Sym);
+    virtual void show(std::ostream &) override;
+};
+Value SymbolV(Sym);
+
+/**
+ * @brief String value
+ */
+struct String : ValueBase {
+    std::string s;
+    String(const std::string &);
+    virtual void show(std::ostream &) override;
+};
+Value StringV(const std::string &);
+
+// ============================================================================
+// Composite Value Types
+// ============================================================================
+
+/**
+ * @brief Pair value (cons cell)
+ */
+struct Pair : ValueBase {
+    Value car;  ///< First element
+    Value cdr;  ///< Second element
+    Pair(const Value &, const Value &);
+    ~Pair();
+    virtual void show(std::ostream &) override;
+    virtual void showCdr(std::ostream &) override;
+};
+Value PairV(const Value &, const Value &);
+/**
+ * @brief Procedure (function) value
+ *
+ * A flat closure: it keeps only the values of the lambda's free variables.
+ * Variables that are both captured and assigned are shared through a Box.
+ */
+struct Procedure : ValueBase {
+    Expr code;                     ///< Lambda the procedure was created from
+    std::vector<Value> captured;   ///< Free variable values, in Lambda::captures order
+    Procedure(const Expr &, std::vector<Value>);
+    Lambda *lambda() const;
+    virtual void show(std::ostream &) override;
+};
+Value ProcedureV(const Expr &, std::vector<Value>);
+
+/**
+ * @brief Mutable cell holding a variable that closures share
+ */
+struct Box : ValueBase {
+    Value v;
+    Box(const Value &);
+    virtual void show(std::ostream &) override;
+};
+Value BoxV(const Value &);
+
+/**
+ * @brief Built-in procedure implemented in C++
+ *
+ * There is exactly one per primitive, see primitiveProc.
+ */
+struct Primitive : ValueBase {
+    const Builtin *info; ///< Name, arity bounds and implementation
+    Primitive(const Builtin *);
+    // Checks the argument count and applies the primitive
+    Value call(const std::vector<Value> &);
+    virtual void show(std::ostream &) override;
+};
+Value PrimitiveV(const Builtin *);
+
+/**
+ * @brief Whole continuation of ENGINE_CEK, see cek.cpp
+ */
+struct SavedKont;
+
+struct Escapes;
+
+/**
+ * @brief Continuation captured by call/ec or call/cc, applied to one value
+ *
+ * An escape continuation records how deep the control and value stacks of
+ * the engine run capturing it were; resuming it cuts both back and returns
+ * from its call/ec, without unwinding frame by frame. It dies once that
+ * call/ec has returned. Under ENGINE_CEK, call/cc saves the whole
+ * continuation instead, which can be resumed any number of times.
+ */
+struct Continuation : ValueBase {
+    Escapes *owner; ///< Run that may resume it, nullptr once dead or for a saved one
+    size_t depth;   ///< Control stack depth of the run when captured
+    size_t height;  ///< Value stack height of the run when captured
+    std::shared_ptr<SavedKont> saved;
+    Continuation(Escapes *, size_t, size_t);
+    // Resumes it from inside a run nested in its owner, or for a saved one
+    // in an ENGINE_CEK run, by raising Unwind
+    [[noreturn]] void unwind(const Value &);
+    virtual void show(std::ostream &) override;
+};
+
+/**
+ * @brief Raised to resume a continuation from inside a run nested in its
+ * owner, which catches it
+ */
+struct Unwind {
+    Continuation *k;
+    Value v;
+};
+
+/**
+ * @brief Escape continuations of one engine run whose call/ec has not
+ * returned yet, innermost last
+ *
+ * Those still alive when the run is left by an error die with it.
+ */
+struct Escapes {
+    std::vector<Value> live;
+    Value capture(size_t depth, size_t height);
+    // Kills the innermost one, whose call/ec returns
+    void release();
+    // Kills those captured after k, whose extents an escape to k leaves
+    void cut(Continuation *k);
+    void clear();
+    ~Escapes();
+};
+
+/**
+ * @brief The procedure value of a primitive, or nullptr if x names none
+ */
+const Value *primitiveProc(Sym x);
+
+// ============================================================================
+// Utility Functions
+// ============================================================================
+
+std::ostream &operator<<(std::ostream &, const Value &);
+
 #endif // VALUE
\ No newline at end of file
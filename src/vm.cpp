@@ -0,0 +1,742 @@
+/**
+ * @file vm.cpp
+ * @brief Bytecode compiler and stack virtual machine
+ *
+ * evalVM compiles a resolved expression tree into a flat array of
+ * instructions and runs it on a value stack. A Lambda is compiled the first
+ * time the VM calls it and keeps its Chunk, so procedures are shared with
+ * the other engines: frames, Procedure values and boxes have the same
+ * layout, and forms the compiler does not handle itself are evaluated by
+ * their own eval method from the bytecode.
+ *
+ * Calls do not recurse on the C++ stack. Each pending call keeps a Return
+ * record, and a call in tail position reuses the caller's.
+ *
+ * Every instruction is also a Routine that the JIT calls from native
+ * code. With options.jit set, a procedure called options.jit_threshold
+ * times gets native code, which the machine runs instead of interpreting
+ * the chunk whenever control enters it.
+ *
+ * An escape continuation holds the number of pending calls and the stack
+ * height at its call/ec; resuming it truncates both and takes the Return
+ * of the call/ec's own call.
+ *
+ * callVM runs a single procedure body, for the tiered engine that moves
+ * hot procedures here from the tree walker, and callEC a call/ec for the
+ * tree walker.
+ */
+
+#include "Def.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include "RE.hpp"
+#include "vm.hpp"
+#include <vector>
+
+// ============================================================================
+// Compiler
+// ============================================================================
+
+struct Compiler {
+    Chunk &ch;
+    std::vector<std::pair<Loop *, int> > loops; ///< Loops being compiled, and where their body starts
+
+    explicit Compiler(Chunk &ch) : ch(ch) {}
+
+    void emit(int x) { ch.code.push_back(x); }
+
+    int constant(const Value &v) {
+        ch.consts.push_back(v);
+        return ch.consts.size() - 1;
+    }
+
+    int node(ExprBase *x) {
+        ch.nodes.push_back(x);
+        return ch.nodes.size() - 1;
+    }
+
+    // Emits a jump and returns where its target goes
+    int jump(int op) {
+        emit(op);
+        emit(-1);
+        return ch.code.size() - 1;
+    }
+
+    void land(int at) { ch.code[at] = ch.code.size(); }
+
+    void fail(const char *message) {
+        emit(OP_FAIL);
+        emit(constant(StringV(message)));
+    }
+
+    void compile(ExprBase *x, bool tail);
+};
+
+void Compiler::compile(ExprBase *x, bool tail) {
+    switch (x->e_type) {
+        case E_FIXNUM:
+        case E_TRUE:
+        case E_FALSE: {
+            Assoc none = empty();
+            emit(OP_CONST);
+            emit(constant(x->eval(none)));
+            return;
+        }
+        case E_LOCALVAR: {
+            LocalVar *v = static_cast<LocalVar *>(x);
+            emit(v->boxed ? OP_LOCALBOX : OP_LOCAL);
+            emit(v->depth);
+            emit(v->slot);
+            return;
+        }
+        case E_CLOSUREVAR: {
+            ClosureVar *v = static_cast<ClosureVar *>(x);
+            emit(v->boxed ? OP_CAPTUREDBOX : OP_CAPTURED);
+            emit(v->depth);
+            emit(v->slot);
+            emit(v->captured);
+            return;
+        }
+        case E_GLOBALVAR: {
+            emit(OP_GLOBAL);
+            emit(node(x));
+            return;
+        }
+        case E_IF: {
+            If *i = static_cast<If *>(x);
+            compile(i->cond.get(), false);
+            int alter = jump(OP_JUMPF);
+            compile(i->conseq.get(), tail);
+            int end = jump(OP_JUMP);
+            land(alter);
+            compile(i->alter.get(), tail);
+            land(end);
+            return;
+        }
+        case E_COND: {
+            std::vector<int> ends;
+            for (std::vector<Expr> &clause : static_cast<Cond *>(x)->clauses) {
+                if (clause.empty()) {
+                    fail("No predict?");
+                    break;
+                }
+                compile(clause[0].get(), false);
+                if (clause.size() == 1) {
+                    // the value of the test is the value of the clause
+                    ends.push_back(jump(OP_JUMPT_KEEP));
+                    continue;
+                }
+                int next = jump(OP_JUMPF);
+                for (int j = 1; j < clause.size(); j++) {
+                    if (j > 1) emit(OP_POP);
+                    compile(clause[j].get(), tail && j + 1 == clause.size());
+                }
+                ends.push_back(jump(OP_JUMP));
+                land(next);
+            }
+            fail("Wrong in Cond");
+            for (int at : ends) land(at);
+            return;
+        }
+        case E_AND:
+        case E_OR: {
+            std::vector<Expr> &rands = x->e_type == E_AND ? static_cast<AndVar *>(x)->rands
+                                                          : static_cast<OrVar *>(x)->rands;
+            if (rands.empty()) {
+                emit(OP_CONST);
+                emit(constant(BooleanV(x->e_type == E_AND)));
+                return;
+            }
+            std::vector<int> ends;
+            for (int i = 0; i + 1 < rands.size(); i++) {
+                compile(rands[i].get(), false);
+                ends.push_back(jump(x->e_type == E_AND ? OP_JUMPF_KEEP : OP_JUMPT_KEEP));
+            }
+            compile(rands.back().get(), tail);
+            for (int at : ends) land(at);
+            return;
+        }
+        case E_BEGIN: {
+            Begin *b = static_cast<Begin *>(x);
+            if (b->es.empty()) {
+                emit(OP_CONST);
+                emit(constant(VoidV()));
+                return;
+            }
+            if (!b->defs.empty()) {
+                emit(OP_BEGIN);
+                emit(node(x));
+            }
+            for (int i = 0; i < b->es.size(); i++) {
+                if (i > 0) emit(OP_POP);
+                compile(b->es[i].get(), tail && i + 1 == b->es.size());
+            }
+            if (!b->defs.empty() && !tail) emit(OP_LEAVE);
+            return;
+        }
+        case E_APPLY: {
+            Apply *a = static_cast<Apply *>(x);
+            compile(a->rator.get(), false);
+            emit(OP_CHECKPROC);
+            for (Expr &i : a->rand) compile(i.get(), false);
+            emit(tail ? OP_TAILCALL : OP_CALL);
+            emit(a->rand.size());
+            return;
+        }
+        case E_INLINE: {
+            Inline *in = static_cast<Inline *>(x);
+            emit(OP_INLINED);
+            emit(node(x));
+            int call = ch.code.size();
+            emit(-1);
+            compile(in->body.get(), tail);
+            int end = jump(OP_JUMP);
+            land(call);
+            compile(in->call.get(), tail);
+            land(end);
+            return;
+        }
+        case E_DEFINE: {
+            Define *d = static_cast<Define *>(x);
+            int k = node(x);
+            emit(OP_PREPARE);
+            emit(k);
+            compile(d->e.get(), false);
+            emit(OP_DEFINE);
+            emit(k);
+            return;
+        }
+        case E_SET: {
+            compile(static_cast<Set *>(x)->e.get(), false);
+            emit(OP_SET);
+            emit(node(x));
+            return;
+        }
+        case E_LET:
+        case E_LOOP: {
+            Let *l = static_cast<Let *>(x);
+            for (auto &b : l->bind) compile(b.second.get(), false);
+            emit(OP_LET);
+            emit(node(x));
+            if (x->e_type == E_LOOP) loops.push_back({static_cast<Loop *>(x), (int) ch.code.size()});
+            compile(l->body.get(), tail);
+            if (x->e_type == E_LOOP) loops.pop_back();
+            if (!tail) emit(OP_LEAVE);
+            return;
+        }
+        case E_RECUR: {
+            // the next iteration: new values in the loop's frame, and back
+            // to the start of its body
+            Recur *r = static_cast<Recur *>(x);
+            for (Expr &i : r->rands) compile(i.get(), false);
+            emit(OP_RECUR);
+            emit(node(x));
+            int i = loops.size() - 1;
+            while (loops[i].first != r->loop) i--;
+            emit(OP_JUMP);
+            emit(loops[i].second);
+            return;
+        }
+        case E_LETREC: {
+            Letrec *l = static_cast<Letrec *>(x);
+            int k = node(x);
+            emit(OP_LETREC);
+            emit(k);
+            for (int i = 0; i < l->bind.size(); i++) {
+                compile(l->bind[i].second.get(), false);
+                emit(OP_INIT);
+                emit(k);
+                emit(i);
+            }
+            compile(l->body.get(), tail);
+            if (!tail) emit(OP_LEAVE);
+            return;
+        }
+        case E_CALLEC:
+        case E_CALLCC: {
+            compile(static_cast<CallEC *>(x)->rand.get(), false);
+            emit(OP_CALLEC);
+            emit(OP_ENDEC);
+            return;
+        }
+        default: {
+            std::vector<Expr *> kids;
+            x->subexprs(kids);
+            if (builtinOf(x->e_type) != nullptr && !kids.empty()) {
+                for (Expr *i : kids) compile(i->get(), false);
+                emit(OP_PRIM);
+                emit(node(x));
+                emit(kids.size());
+                return;
+            }
+            emit(OP_EVAL);
+            emit(node(x));
+            return;
+        }
+    }
+}
+
+// The compiled body of a procedure, compiled on its first call
+static const Chunk *bytecodeOf(Lambda *lam) {
+    if (lam->bytecode == nullptr) {
+        lam->bytecode = std::make_shared<Chunk>();
+        Compiler(*lam->bytecode).compile(lam->e.get(), true);
+        lam->bytecode->code.push_back(OP_RET);
+    }
+    Chunk *ch = lam->bytecode.get();
+    // the JIT compiles the body once it has been entered often enough
+    if (options.jit && ch->calls++ == options.jit_threshold) {
+        ch->native = jitCompile(*ch);
+        if (ch->native != nullptr && options.tier_log)
+            std::cerr << "tier: " << lam->label() << " compiled to native code" << std::endl;
+    }
+    return ch;
+}
+
+// ============================================================================
+// Machine
+// ============================================================================
+
+// Pops the top n values
+static void drop(std::vector<Value> &stack, size_t n) {
+    while (n-- > 0) stack.pop_back();
+}
+
+// #f is the only false value
+static bool isFalse(const Value &v) {
+    return v.isFalse();
+}
+
+// Instructions, as functions of their operands. A nonzero result is a
+// branch taken, or control having left the chunk.
+
+static inline int opConst(Machine &m, int k, int, int) {
+    m.stack.push_back(m.ch->consts[k]);
+    return 0;
+}
+
+static inline int opLocal(Machine &m, int depth, int slot, int) {
+    m.stack.push_back(enclosing(depth, m.env)->slots()[slot]);
+    return 0;
+}
+
+static inline int opLocalBox(Machine &m, int depth, int slot, int) {
+    m.stack.push_back(static_cast<Box *>(enclosing(depth, m.env)->slots()[slot].get())->v);
+    return 0;
+}
+
+static inline int opCaptured(Machine &m, int depth, int slot, int k) {
+    m.stack.push_back(static_cast<Procedure *>(enclosing(depth, m.env)->slots()[slot].get())->captured[k]);
+    return 0;
+}
+
+static inline int opCapturedBox(Machine &m, int depth, int slot, int k) {
+    Value &v = static_cast<Procedure *>(enclosing(depth, m.env)->slots()[slot].get())->captured[k];
+    m.stack.push_back(static_cast<Box *>(v.get())->v);
+    return 0;
+}
+
+static inline int opGlobal(Machine &m, int k, int, int) {
+    GlobalVar *g = static_cast<GlobalVar *>(m.ch->nodes[k]);
+    m.stack.push_back(g->slot->get() != nullptr ? *g->slot : g->eval(m.env));
+    return 0;
+}
+
+static inline int opEval(Machine &m, int k, int, int) {
+    m.stack.push_back(m.ch->nodes[k]->eval(m.env));
+    return 0;
+}
+
+static inline int opPop(Machine &m, int, int, int) {
+    m.stack.pop_back();
+    return 0;
+}
+
+static inline int opJumpF(Machine &m, int, int, int) {
+    bool jump = isFalse(m.stack.back());
+    m.stack.pop_back();
+    return jump;
+}
+
+// The top stays as the value when the branch is taken
+static inline int opJumpFKeep(Machine &m, int, int, int) {
+    if (isFalse(m.stack.back())) return 1;
+    m.stack.pop_back();
+    return 0;
+}
+
+static inline int opJumpTKeep(Machine &m, int, int, int) {
+    if (!isFalse(m.stack.back())) return 1;
+    m.stack.pop_back();
+    return 0;
+}
+
+static inline int opInlined(Machine &m, int k, int, int) {
+    return !static_cast<Inline *>(m.ch->nodes[k])->current();
+}
+
+static inline int opPrim(Machine &m, int k, int n, int) {
+    Value v = m.ch->nodes[k]->applyRator(&m.stack[m.stack.size() - n], n);
+    drop(m.stack, n);
+    m.stack.push_back(v);
+    return 0;
+}
+
+static inline int opCheckProc(Machine &m, int, int, int) {
+    ValueType t = m.stack.back().type();
+    if (t != V_PROC && t != V_PRIM && t != V_CONT) throw RuntimeError("Attempt to apply a non-procedure");
+    return 0;
+}
+
+static inline int opRet(Machine &m, int, int, int) {
+    if (m.calls.empty()) {
+        m.done = true;
+        return 1;
+    }
+    m.ch = m.calls.back().ch;
+    m.pc = m.calls.back().pc;
+    m.env = m.calls.back().env;
+    m.calls.pop_back();
+    return 1;
+}
+
+// Returns v from the call/ec that captured k, one of m's: the calls and
+// values pushed since are dropped, and the call's Return taken
+static void resume(Machine &m, Continuation *k, const Value &v) {
+    m.escapes.cut(k);
+    m.calls.erase(m.calls.begin() + k->depth + 1, m.calls.end());
+    m.stack.erase(m.stack.begin() + k->height, m.stack.end());
+    m.stack.push_back(v);
+    opRet(m, 0, 0, 0);
+}
+
+// A call resuming at offset next of the chunk, or replacing the running
+// procedure for next < 0. A primitive is applied right away.
+static inline int call(Machine &m, int n, int next) {
+    size_t base = m.stack.size() - n - 1;
+    Value proc = m.stack[base];
+    if (proc.type() == V_PROC && static_cast<Procedure *>(proc.get())->lambda()->x.size() == n) {
+        Lambda *lam = static_cast<Procedure *>(proc.get())->lambda();
+        Assoc f = frame(n + 1, empty());
+        Value *slots = f->slots();
+        for (int i = 0; i < n; i++)
+            slots[i] = lam->boxed[i] ? BoxV(m.stack[base + 1 + i]) : m.stack[base + 1 + i];
+        slots[n] = proc;
+        drop(m.stack, m.stack.size() - base);
+        if (next >= 0) {
+            if (m.calls.size() >= options.max_depth) throw RuntimeError("Recursion depth limit exceeded");
+            m.calls.push_back(Return{m.ch, m.ch->code.data() + next, m.env});
+        }
+        m.ch = bytecodeOf(lam);
+        m.pc = m.ch->code.data();
+        m.env = f;
+        return 1;
+    }
+    if (proc.type() == V_CONT && n == 1) {
+        Continuation *k = static_cast<Continuation *>(proc.get());
+        Value v = m.stack.back();
+        if (k->owner != &m.escapes) k->unwind(v);
+        resume(m, k, v);
+        return 1;
+    }
+    if (proc.type() != V_PRIM) throw RuntimeError("Wrong number of arguments");
+    m.args.assign(m.stack.begin() + base + 1, m.stack.end());
+    drop(m.stack, m.stack.size() - base);
+    m.stack.push_back(static_cast<Primitive *>(proc.get())->call(m.args));
+    if (next < 0) return opRet(m, 0, 0, 0);
+    return 0;
+}
+
+static inline int opCall(Machine &m, int n, int next, int) {
+    return call(m, n, next);
+}
+
+static inline int opTailCall(Machine &m, int n, int, int) {
+    return call(m, n, -1);
+}
+
+// The procedure on top gets a continuation returning to the next
+// instruction, the OP_ENDEC that ends its extent
+static inline int opCallEC(Machine &m, int, int next, int) {
+    opCheckProc(m, 0, 0, 0);
+    m.stack.push_back(m.escapes.capture(m.calls.size(), m.stack.size() - 1));
+    return call(m, 1, next);
+}
+
+static inline int opEndEC(Machine &m, int, int, int) {
+    m.escapes.release();
+    return 0;
+}
+
+static inline int opPrepare(Machine &m, int k, int, int) {
+    static_cast<Define *>(m.ch->nodes[k])->prepare();
+    return 0;
+}
+
+static inline int opDefine(Machine &m, int k, int, int) {
+    m.stack.back() = static_cast<Define *>(m.ch->nodes[k])->store(m.env, m.stack.back());
+    return 0;
+}
+
+static inline int opSet(Machine &m, int k, int, int) {
+    m.stack.back() = static_cast<Set *>(m.ch->nodes[k])->store(m.env, m.stack.back());
+    return 0;
+}
+
+static inline int opLet(Machine &m, int k, int, int) {
+    Let *l = static_cast<Let *>(m.ch->nodes[k]);
+    int n = l->bind.size();
+    size_t base = m.stack.size() - n;
+    Assoc f = frame(n, m.env);
+    for (int i = 0; i < n; i++) f->slots()[i] = l->boxed[i] ? BoxV(m.stack[base + i]) : m.stack[base + i];
+    drop(m.stack, m.stack.size() - base);
+    m.env = f;
+    return 0;
+}
+
+static inline int opRecur(Machine &m, int k, int, int) {
+    Recur *r = static_cast<Recur *>(m.ch->nodes[k]);
+    int n = r->rands.size();
+    AssocList *f = enclosing(r->depth, m.env);
+    size_t base = m.stack.size() - n;
+    for (int i = 0; i < n; i++) f->slots()[i] = r->loop->boxed[i] ? BoxV(m.stack[base + i]) : m.stack[base + i];
+    drop(m.stack, n);
+    m.env = Assoc(f);
+    return 0;
+}
+
+static inline int opLetrec(Machine &m, int k, int, int) {
+    m.env = static_cast<Letrec *>(m.ch->nodes[k])->open(m.env);
+    return 0;
+}
+
+static inline int opInit(Machine &m, int k, int i, int) {
+    static_cast<Letrec *>(m.ch->nodes[k])->init(m.env, i, m.stack.back());
+    m.stack.pop_back();
+    return 0;
+}
+
+static inline int opBegin(Machine &m, int k, int, int) {
+    m.env = static_cast<Begin *>(m.ch->nodes[k])->open(m.env);
+    return 0;
+}
+
+static inline int opLeave(Machine &m, int, int, int) {
+    Assoc next = m.env->next;
+    m.env = next;
+    return 0;
+}
+
+static inline int opFail(Machine &m, int k, int, int) {
+    throw RuntimeError(static_cast<String *>(m.ch->consts[k].get())->s);
+}
+
+// Routine of an instruction that may raise an error
+template <int (*op)(Machine &, int, int, int)>
+static int guarded(Machine *m, int a, int b, int c) {
+    try {
+        return op(*m, a, b, c);
+    } catch (...) {
+        m->error = std::current_exception();
+        return 1;
+    }
+}
+
+// Routine of an instruction that cannot
+template <int (*op)(Machine &, int, int, int)>
+static int plain(Machine *m, int a, int b, int c) {
+    return op(*m, a, b, c);
+}
+
+const Routine routines[OP_COUNT] = {
+    {guarded<opConst>,       1, R_STEP},   // OP_CONST
+    {guarded<opLocal>,       2, R_STEP},   // OP_LOCAL
+    {guarded<opLocalBox>,    2, R_STEP},   // OP_LOCALBOX
+    {guarded<opCaptured>,    3, R_STEP},   // OP_CAPTURED
+    {guarded<opCapturedBox>, 3, R_STEP},   // OP_CAPTUREDBOX
+    {guarded<opGlobal>,      1, R_STEP},   // OP_GLOBAL
+    {guarded<opEval>,        1, R_STEP},   // OP_EVAL
+    {plain<opPop>,           0, R_STEP},   // OP_POP
+    {nullptr,                1, R_JUMP},   // OP_JUMP
+    {plain<opJumpF>,         1, R_BRANCH}, // OP_JUMPF
+    {plain<opJumpFKeep>,     1, R_BRANCH}, // OP_JUMPF_KEEP
+    {plain<opJumpTKeep>,     1, R_BRANCH}, // OP_JUMPT_KEEP
+    {plain<opInlined>,       2, R_BRANCH}, // OP_INLINED
+    {guarded<opPrim>,        2, R_STEP},   // OP_PRIM
+    {guarded<opCheckProc>,   0, R_STEP},   // OP_CHECKPROC
+    {guarded<opCall>,        1, R_STEP},   // OP_CALL
+    {guarded<opTailCall>,    1, R_LEAVE},  // OP_TAILCALL
+    {plain<opRet>,           0, R_LEAVE},  // OP_RET
+    {guarded<opCallEC>,      0, R_STEP},   // OP_CALLEC
+    {plain<opEndEC>,         0, R_STEP},   // OP_ENDEC
+    {guarded<opPrepare>,     1, R_STEP},   // OP_PREPARE
+    {guarded<opDefine>,      1, R_STEP},   // OP_DEFINE
+    {guarded<opSet>,         1, R_STEP},   // OP_SET
+    {guarded<opLet>,         1, R_STEP},   // OP_LET
+    {guarded<opRecur>,       1, R_STEP},   // OP_RECUR
+    {guarded<opLetrec>,      1, R_STEP},   // OP_LETREC
+    {guarded<opInit>,        2, R_STEP},   // OP_INIT
+    {guarded<opBegin>,       1, R_STEP},   // OP_BEGIN
+    {plain<opLeave>,         0, R_STEP},   // OP_LEAVE
+    {guarded<opFail>,        1, R_LEAVE},  // OP_FAIL
+};
+
+Machine::Machine(const Chunk *ch, const Assoc &env) : ch(ch), pc(ch->code.data()), env(env), done(false) {
+    stack.reserve(256);
+}
+
+// Interprets m.ch from m.pc until control leaves it
+static void interpret(Machine &m) {
+    const int *code = m.ch->code.data();
+    const int *pc = m.pc;
+    while (true) {
+        switch (*pc++) {
+            case OP_CONST:
+                opConst(m, pc[0], 0, 0);
+                pc += 1;
+                break;
+            case OP_LOCAL:
+                opLocal(m, pc[0], pc[1], 0);
+                pc += 2;
+                break;
+            case OP_LOCALBOX:
+                opLocalBox(m, pc[0], pc[1], 0);
+                pc += 2;
+                break;
+            case OP_CAPTURED:
+                opCaptured(m, pc[0], pc[1], pc[2]);
+                pc += 3;
+                break;
+            case OP_CAPTUREDBOX:
+                opCapturedBox(m, pc[0], pc[1], pc[2]);
+                pc += 3;
+                break;
+            case OP_GLOBAL:
+                opGlobal(m, pc[0], 0, 0);
+                pc += 1;
+                break;
+            case OP_EVAL:
+                opEval(m, pc[0], 0, 0);
+                pc += 1;
+                break;
+            case OP_POP:
+                opPop(m, 0, 0, 0);
+                break;
+            case OP_JUMP:
+                pc = code + *pc;
+                break;
+            case OP_JUMPF:
+                pc = opJumpF(m, 0, 0, 0) ? code + *pc : pc + 1;
+                break;
+            case OP_JUMPF_KEEP:
+                pc = opJumpFKeep(m, 0, 0, 0) ? code + *pc : pc + 1;
+                break;
+            case OP_JUMPT_KEEP:
+                pc = opJumpTKeep(m, 0, 0, 0) ? code + *pc : pc + 1;
+                break;
+            case OP_INLINED:
+                pc = opInlined(m, pc[0], 0, 0) ? code + pc[1] : pc + 2;
+                break;
+            case OP_PRIM:
+                opPrim(m, pc[0], pc[1], 0);
+                pc += 2;
+                break;
+            case OP_CHECKPROC:
+                opCheckProc(m, 0, 0, 0);
+                break;
+            case OP_CALL:
+                if (opCall(m, pc[0], pc + 1 - code, 0)) return;
+                pc += 1;
+                break;
+            case OP_TAILCALL:
+                opTailCall(m, pc[0], 0, 0);
+                return;
+            case OP_RET:
+                opRet(m, 0, 0, 0);
+                return;
+            case OP_CALLEC:
+                if (opCallEC(m, 0, pc - code, 0)) return;
+                break;
+            case OP_ENDEC:
+                opEndEC(m, 0, 0, 0);
+                break;
+            case OP_PREPARE:
+                opPrepare(m, pc[0], 0, 0);
+                pc += 1;
+                break;
+            case OP_DEFINE:
+                opDefine(m, pc[0], 0, 0);
+                pc += 1;
+                break;
+            case OP_SET:
+                opSet(m, pc[0], 0, 0);
+                pc += 1;
+                break;
+            case OP_LET:
+                opLet(m, pc[0], 0, 0);
+                pc += 1;
+                break;
+            case OP_RECUR:
+                opRecur(m, pc[0], 0, 0);
+                pc += 1;
+                break;
+            case OP_LETREC:
+                opLetrec(m, pc[0], 0, 0);
+                pc += 1;
+                break;
+            case OP_INIT:
+                opInit(m, pc[0], pc[1], 0);
+                pc += 2;
+                break;
+            case OP_BEGIN:
+                opBegin(m, pc[0], 0, 0);
+                pc += 1;
+                break;
+            case OP_LEAVE:
+                opLeave(m, 0, 0, 0);
+                break;
+            case OP_FAIL:
+                opFail(m, pc[0], 0, 0);
+        }
+    }
+}
+
+// Runs the machine until its outermost call returns, natively where it can
+static Value execute(Machine &m) {
+    while (!m.done) {
+        try {
+            if (m.ch->native != nullptr) jitRun(m);
+            else interpret(m);
+        } catch (const Unwind &u) {
+            // a continuation of m resumed by a node run with its own eval
+            if (u.k->owner != &m.escapes) throw;
+            resume(m, u.k, u.v);
+        }
+    }
+    return m.stack.back();
+}
+
+Value evalVM(ExprBase *root, Assoc &top_env) {
+    Chunk top;
+    Compiler(top).compile(root, false);
+    top.code.push_back(OP_RET);
+
+    Machine m(&top, top_env);
+    return execute(m);
+}
+
+Value callVM(Lambda *lam, const Assoc &frame) {
+    Machine m(bytecodeOf(lam), frame);
+    return execute(m);
+}
+
+Value callEC(const Value &f) {
+    static const Chunk apply = [] {
+        Chunk ch;
+        ch.code = {OP_CALLEC, OP_ENDEC, OP_RET};
+        return ch;
+    }();
+    Machine m(&apply, empty());
+    m.stack.push_back(f);
+    return execute(m);
+}
@@ -0,0 +1,138 @@
+#ifndef VM_HPP
+#define VM_HPP
+
+/**
+ * @file vm.hpp
+ * @brief Bytecode, machine state and the native code built from it
+ *
+ * Shared by the bytecode VM (vm.cpp) and the template JIT (jit.cpp).
+ */
+
+#include "Def.hpp"
+#include "value.hpp"
+#include <exception>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Instructions; the operands follow the opcode in the code array
+ */
+enum OpCode {
+    OP_CONST,       ///< k: push consts[k]
+    OP_LOCAL,       ///< depth slot: push a frame slot
+    OP_LOCALBOX,    ///< depth slot: push the content of a boxed frame slot
+    OP_CAPTURED,    ///< depth slot k: push free variable k of the procedure in a frame slot
+    OP_CAPTUREDBOX, ///< depth slot k: same, for a boxed free variable
+    OP_GLOBAL,      ///< k: push the global read by GlobalVar nodes[k]
+    OP_EVAL,        ///< k: push nodes[k]->eval(env)
+    OP_POP,         ///< drop the top value
+    OP_JUMP,        ///< target
+    OP_JUMPF,       ///< target: pop, and jump if it was #f
+    OP_JUMPF_KEEP,  ///< target: jump if the top is #f, else pop it
+    OP_JUMPT_KEEP,  ///< target: jump if the top is not #f, else pop it
+    OP_INLINED,     ///< k target: jump unless Inline nodes[k] is current
+    OP_PRIM,        ///< k n: replace n operands by nodes[k]->applyRator
+    OP_CHECKPROC,   ///< fail unless the top is a procedure
+    OP_CALL,        ///< n: call the procedure below n arguments
+    OP_TAILCALL,    ///< n: same, in place of the running procedure
+    OP_RET,         ///< return the top to the pending call
+    OP_CALLEC,      ///< call the top with an escape continuation resuming at the next instruction
+    OP_ENDEC,       ///< the innermost escape continuation dies
+    OP_PREPARE,     ///< k: Define::prepare of nodes[k]
+    OP_DEFINE,      ///< k: replace the top by Define::store of nodes[k]
+    OP_SET,         ///< k: replace the top by Set::store of nodes[k]
+    OP_LET,         ///< k: bind the top values of Let nodes[k] in a new frame
+    OP_RECUR,       ///< k: pop the next values of the loop of Recur nodes[k] into its frame
+    OP_LETREC,      ///< k: enter the frame of Letrec nodes[k]
+    OP_INIT,        ///< k i: pop into binding i of Letrec nodes[k]
+    OP_BEGIN,       ///< k: enter the frame of the defines of Begin nodes[k]
+    OP_LEAVE,       ///< return to the enclosing frame
+    OP_FAIL,        ///< k: raise consts[k], a string
+    OP_COUNT
+};
+
+/**
+ * @brief Machine code of one Chunk, see jit.cpp
+ */
+struct NativeCode {
+    unsigned char *mem;
+    size_t size;
+    std::vector<const unsigned char *> entry; ///< Address of each instruction, by bytecode offset
+
+    NativeCode(unsigned char *, size_t);
+    ~NativeCode();
+};
+
+/**
+ * @brief Compiled code of a procedure body or top-level form
+ */
+struct Chunk {
+    std::vector<int> code;
+    std::vector<Value> consts;
+    std::vector<ExprBase *> nodes; ///< Nodes the code refers to, owned by the tree
+    unsigned calls = 0;            ///< Calls made to it so far, for the JIT
+    std::unique_ptr<NativeCode> native;
+};
+
+/**
+ * @brief Where a pending call resumes
+ */
+struct Return {
+    const Chunk *ch;
+    const int *pc;
+    Assoc env;
+};
+
+/**
+ * @brief State of a running evalVM, shared with the native code it enters
+ */
+struct Machine {
+    std::vector<Value> stack;
+    std::vector<Return> calls;
+    std::vector<Value> args;
+    const Chunk *ch;
+    const int *pc;            ///< Next instruction of ch
+    Assoc env;
+    bool done;                ///< The outermost call has returned the top
+    std::exception_ptr error; ///< Raised under native code, to rethrow outside it
+    Escapes escapes;
+
+    Machine(const Chunk *, const Assoc &);
+};
+
+/**
+ * @brief How native code continues after running an instruction's routine
+ */
+enum RoutineKind {
+    R_STEP,   ///< falls through, or leaves the native code if the routine returns nonzero
+    R_BRANCH, ///< jumps to its last operand if the routine returns nonzero
+    R_JUMP,   ///< jumps to its operand without a routine
+    R_LEAVE   ///< always leaves: the machine continues elsewhere
+};
+
+/**
+ * @brief The precompiled code of an instruction, called with its operands
+ *
+ * OP_CALL and OP_CALLEC also get the offset of the next instruction as
+ * their second operand. A routine never lets an exception escape into native code: it
+ * stores it in Machine::error and returns nonzero.
+ */
+struct Routine {
+    int (*fn)(Machine *, int, int, int);
+    int operands;
+    RoutineKind kind;
+};
+
+extern const Routine routines[OP_COUNT];
+
+/**
+ * @brief Builds the native code of a chunk, nullptr where unsupported
+ */
+std::unique_ptr<NativeCode> jitCompile(const Chunk &);
+
+/**
+ * @brief Runs native code of m.ch from m.pc until control leaves the chunk
+ */
+void jitRun(Machine &);
+
+#endif